@@ -0,0 +1,220 @@
+#include "analysistap.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Include the octave bands of the Equalizer, which the file reports.
+#include "soundprocessor.h"
+
+// Windows of the spectrum overlap by half.
+static const size_t kHop = ANALYSIS_FFT_SIZE / 2;
+
+// Time the analysis thread sleeps when the rings are empty, in milliseconds.
+static const int kPollMs = 10;
+
+// Level in dB of power, a power ratio to full scale.
+static float powerDb(double power) {
+    return power > 0 ? (float)std::max(10 * log10(power), (double)ANALYSIS_FLOOR_DB) : ANALYSIS_FLOOR_DB;
+}
+
+AnalysisTap::AnalysisTap(unsigned int sampleRate, unsigned int channels, float fullScale,
+                         unsigned int periodMs)
+        : m_sampleRate(sampleRate),
+          m_channels(std::min(std::max(channels, 1u), (unsigned int)MAX_CHANNELS)),
+          m_fullScale(fullScale),
+          m_periodFrames(std::max((size_t)sampleRate * periodMs / 1000, (size_t)1)),
+          m_periodPos(0),
+          m_frames(0),
+          m_inRing((size_t)sampleRate * ANALYSIS_RING_SECONDS * m_channels),
+          m_outRing((size_t)sampleRate * ANALYSIS_RING_SECONDS * m_channels),
+          m_accepted(false),
+          m_droppedBlocks(0),
+          m_file(NULL),
+          m_running(false) {
+    m_block.reset(new float[kHop * m_channels]);
+    m_windowed.reset(new float[ANALYSIS_FFT_SIZE]);
+    m_re.reset(new float[ANALYSIS_BINS]);
+    m_im.reset(new float[ANALYSIS_BINS]);
+    m_fft.setSize(ANALYSIS_FFT_SIZE);
+
+    // Periodic Hann window, so that windows overlapping by half sum to 1.
+    m_hann.reset(new float[ANALYSIS_FFT_SIZE]);
+    for (size_t i = 0; i < ANALYSIS_FFT_SIZE; i++)
+        m_hann[i] = (float)(0.5 - 0.5 * cos(2 * M_PI * i / ANALYSIS_FFT_SIZE));
+
+    m_current.reset(new AnalysisMeters());
+    m_current->time = 0;
+    m_current->droppedBlocks = 0;
+    for (Meter *meter : {&m_input, &m_output}) {
+        meter->peak = 0;
+        meter->sumSquares = 0;
+        meter->window.reset(new float[ANALYSIS_FFT_SIZE]);
+        meter->filled = 0;
+        meter->power.reset(new double[ANALYSIS_BINS]);
+        std::fill(meter->power.get(), meter->power.get() + ANALYSIS_BINS, 0.0);
+        meter->windows = 0;
+    }
+    for (SignalMeters *signal : {&m_current->input, &m_current->output}) {
+        signal->peakDb = ANALYSIS_FLOOR_DB;
+        signal->rmsDb = ANALYSIS_FLOOR_DB;
+        std::fill(signal->spectrumDb, signal->spectrumDb + ANALYSIS_BINS, (float)ANALYSIS_FLOOR_DB);
+    }
+}
+
+AnalysisTap::~AnalysisTap() {
+    stop();
+}
+
+void AnalysisTap::start() {
+    if (m_running)
+        return;
+    m_running = true;
+    m_thread = std::thread(&AnalysisTap::analysisLoop, this);
+}
+
+void AnalysisTap::stop() {
+    if (!m_running)
+        return;
+    m_running = false;
+    m_thread.join();
+}
+
+void AnalysisTap::pushInput(const float *x, size_t frames) {
+    // Whole blocks or nothing, so that the input and output stay aligned.
+    size_t n = frames * m_channels;
+    m_accepted = m_inRing.writeAvailable() >= n && m_outRing.writeAvailable() >= n;
+    if (!m_accepted) {
+        m_droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    m_inRing.write(x, n);
+}
+
+void AnalysisTap::pushOutput(const float *y, size_t frames) {
+    // The analysis thread only frees room, so the output fits if the input did.
+    if (m_accepted)
+        m_outRing.write(y, frames * m_channels);
+    m_accepted = false;
+}
+
+void AnalysisTap::analysisLoop() {
+#ifdef __linux__
+    // Only take the time no other thread wants, the audio threads least of all.
+    sched_param param;
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+    while (m_running) {
+        // The output of a block is written after its input, so frames in
+        // both rings are complete.
+        size_t frames = std::min(m_inRing.readAvailable(), m_outRing.readAvailable()) / m_channels;
+        if (frames == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(kPollMs));
+            continue;
+        }
+        frames = std::min(std::min(frames, kHop), m_periodFrames - m_periodPos);
+
+        m_inRing.read(m_block.get(), frames * m_channels);
+        analyse(m_input, m_block.get(), frames);
+        m_outRing.read(m_block.get(), frames * m_channels);
+        analyse(m_output, m_block.get(), frames);
+
+        m_frames += frames;
+        m_periodPos += frames;
+        if (m_periodPos == m_periodFrames) {
+            m_current->time = (double)m_frames / m_sampleRate;
+            m_current->droppedBlocks = droppedBlocks();
+            finish(m_input, m_current->input);
+            finish(m_output, m_current->output);
+            m_meters.publish(*m_current);
+            if (m_file != NULL)
+                write(*m_current);
+            m_periodPos = 0;
+        }
+    }
+}
+
+void AnalysisTap::analyse(Meter &meter, const float *x, size_t frames) {
+    float scale = 1.0f / m_channels;
+    for (size_t i = 0; i < frames; i++) {
+        const float *frame = x + i * m_channels;
+        float sum = 0;
+        for (unsigned int ch = 0; ch < m_channels; ch++) {
+            float v = frame[ch];
+            meter.peak = std::max(meter.peak, fabsf(v));
+            meter.sumSquares += (double)v * v;
+            sum += v;
+        }
+        meter.window[meter.filled++] = sum * scale;
+        if (meter.filled == ANALYSIS_FFT_SIZE) {
+            transform(meter);
+            memmove(meter.window.get(), meter.window.get() + kHop, sizeof(float) * (ANALYSIS_FFT_SIZE - kHop));
+            meter.filled = ANALYSIS_FFT_SIZE - kHop;
+        }
+    }
+}
+
+void AnalysisTap::transform(Meter &meter) {
+    for (size_t i = 0; i < ANALYSIS_FFT_SIZE; i++)
+        m_windowed[i] = meter.window[i] * m_hann[i];
+    m_fft.forward(m_windowed.get(), m_re.get(), m_im.get());
+    for (size_t k = 0; k < ANALYSIS_BINS; k++)
+        meter.power[k] += (double)m_re[k] * m_re[k] + (double)m_im[k] * m_im[k];
+    meter.windows++;
+}
+
+void AnalysisTap::finish(Meter &meter, SignalMeters &signal) {
+    double fullScale = m_fullScale;
+    signal.peakDb = powerDb((double)meter.peak * meter.peak / (fullScale * fullScale));
+    signal.rmsDb = powerDb(meter.sumSquares / ((double)m_periodFrames * m_channels * fullScale * fullScale));
+    meter.peak = 0;
+    meter.sumSquares = 0;
+    if (meter.windows == 0)
+        return;
+
+    // A sine of amplitude A peaks at A * ANALYSIS_FFT_SIZE / 4 through the
+    // Hann window (the sum of the window, halved).
+    double sine = fullScale * ANALYSIS_FFT_SIZE / 4;
+    double norm = 1 / (sine * sine * meter.windows);
+    for (size_t k = 0; k < ANALYSIS_BINS; k++) {
+        signal.spectrumDb[k] = powerDb(meter.power[k] * norm);
+        meter.power[k] = 0;
+    }
+    meter.windows = 0;
+}
+
+void AnalysisTap::write(const AnalysisMeters &meters) {
+    fprintf(m_file, "{\"time_s\":%.3f,\"dropped_blocks\":%llu", meters.time,
+            (unsigned long long)meters.droppedBlocks);
+    writeSignal("input", meters.input);
+    writeSignal("output", meters.output);
+    fprintf(m_file, "}\n");
+    fflush(m_file);
+}
+
+void AnalysisTap::writeSignal(const char *name, const SignalMeters &signal) {
+    fprintf(m_file, ",\"%s\":{\"peak_db\":%.1f,\"rms_db\":%.1f,\"bands_db\":[", name, signal.peakDb,
+            signal.rmsDb);
+    // Octave bands around the frequencies of the Equalizer. A sine spreads
+    // over about three bins through the Hann window, which sum to 1.5 times
+    // its peak bin: the power of the bins of a band is scaled back by that,
+    // so that a full scale sine reads 0 dB in its band.
+    double binHz = (double)m_sampleRate / ANALYSIS_FFT_SIZE;
+    for (int b = 0; b < EQ_BANDS; b++) {
+        size_t lo = (size_t)ceil(kEqFrequencies[b] / M_SQRT2 / binHz);
+        size_t hi = std::min((size_t)ceil(kEqFrequencies[b] * M_SQRT2 / binHz), (size_t)ANALYSIS_BINS);
+        double power = 0;
+        for (size_t k = lo; k < hi; k++)
+            power += pow(10.0, signal.spectrumDb[k] / 10);
+        fprintf(m_file, "%s%.1f", b > 0 ? "," : "", powerDb(power / 1.5));
+    }
+    fprintf(m_file, "]}");
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdio.h>
+#include <thread>
+
+#include "fft.h"
+#include "snapshot.h"
+#include "spscring.h"
+
+// Size of the transforms of the spectrum meters, and bins of their spectra.
+#define ANALYSIS_FFT_SIZE 2048
+#define ANALYSIS_BINS (ANALYSIS_FFT_SIZE / 2 + 1)
+
+// Default length of an analysis period in milliseconds.
+#define ANALYSIS_PERIOD_MS 100
+
+// Level the meters read for silence, in dB relative to full scale.
+#define ANALYSIS_FLOOR_DB -200
+
+// Meters of one signal over one analysis period, in dB relative to full scale.
+struct SignalMeters {
+    // Largest sample, and RMS of the samples of every channel.
+    float peakDb;
+    float rmsDb;
+
+    // Power spectrum of the channels mixed down, averaged over the Hann
+    // windows (overlapping by half) that ended in the period, and scaled so
+    // that a full scale sine reads 0 dB in its bin. Bin k is at
+    // k * sampleRate / ANALYSIS_FFT_SIZE Hz. Periods shorter than half a
+    // window can end without one, and keep the spectrum of the period before.
+    float spectrumDb[ANALYSIS_BINS];
+};
+
+// Meters of the input and output of the effects over one analysis period.
+struct AnalysisMeters {
+    // Seconds of audio analysed up to the end of the period.
+    double time;
+
+    // Blocks dropped so far because the rings were full.
+    uint64_t droppedBlocks;
+
+    SignalMeters input;
+    SignalMeters output;
+};
+
+// AnalysisTap
+//
+// Peak, RMS and spectrum meters of the input and output of the effects,
+// computed away from the audio thread. The audio thread only copies every
+// block into preallocated lock-free rings (pushInput(), pushOutput()); when
+// they are full the block is dropped and counted, it never waits. A thread
+// of low priority (SCHED_IDLE on Linux) reads the rings, computes the meters
+// of every period of audio and publishes them through a Snapshot (see
+// meters()), and writes them to a file if one is set (see setOutput()).
+// The meters run on audio time: a period ends after its frames have been
+// analysed, however late that is.
+class AnalysisTap {
+    public:
+        // sampleRate: rate of the audio in Hz.
+        // channels: channels of the interleaved frames (1 to MAX_CHANNELS).
+        // fullScale: level of a full scale sample (see EffectParams::fullScale).
+        // periodMs: length of an analysis period in milliseconds.
+        // Allocates everything, rings for ANALYSIS_RING_SECONDS of audio.
+        AnalysisTap(unsigned int sampleRate, unsigned int channels, float fullScale,
+                    unsigned int periodMs = ANALYSIS_PERIOD_MS);
+
+        // Stops the analysis thread.
+        ~AnalysisTap();
+
+        // Write the meters of every period to file (NULL for none, the
+        // default), one JSON object per line with the peak, the RMS and the
+        // octave bands of the Equalizer (see kEqFrequencies) of the input and
+        // the output. The file is not closed. Call before start().
+        void setOutput(FILE *file) { m_file = file; }
+
+        // Start and stop the analysis thread. Frames pushed while it is
+        // stopped wait in the rings, or are dropped once they are full.
+        void start();
+        void stop();
+
+        // Audio thread: offer the input of a block of frames frames, before
+        // it is processed (the effects may process it in place). Copies it
+        // to the ring, or drops the block if the rings have no room for both
+        // its input and its output. Never blocks, locks or allocates.
+        void pushInput(const float *x, size_t frames);
+
+        // Audio thread: the output of the block whose input was offered
+        // last, frames frames again. Copied only if its input was.
+        void pushOutput(const float *y, size_t frames);
+
+        // Any one thread: copy the meters of the last period to meters.
+        // Returns false, leaving meters as is, if no period ended since the
+        // last call. Never blocks.
+        bool meters(AnalysisMeters &meters) { return m_meters.fetch(meters); }
+
+        // Returns the number of blocks dropped so far.
+        uint64_t droppedBlocks() const { return m_droppedBlocks.load(std::memory_order_relaxed); }
+
+    private:
+        // Seconds of audio each ring holds.
+        enum { ANALYSIS_RING_SECONDS = 1 };
+
+        // Level and spectrum of one signal over the current period.
+        struct Meter {
+            // Largest magnitude and sum of the squares of the samples.
+            float peak;
+            double sumSquares;
+
+            // Samples of the channels mixed down, the last filled of a window.
+            std::unique_ptr<float[]> window;
+            size_t filled;
+
+            // Sum of the power spectra of the windows that ended, and their number.
+            std::unique_ptr<double[]> power;
+            int windows;
+        };
+
+        // Analysis thread: analyse the frames in the rings until stopped.
+        void analysisLoop();
+
+        // Add frames interleaved frames of x to meter.
+        void analyse(Meter &meter, const float *x, size_t frames);
+
+        // Add the power spectrum of the window of meter to its sum.
+        void transform(Meter &meter);
+
+        // Set the meters of signal from meter at the end of a period, and
+        // start the next period.
+        void finish(Meter &meter, SignalMeters &signal);
+
+        // Write the meters of the period that ended to m_file.
+        void write(const AnalysisMeters &meters);
+
+        // Write the levels of signal as the JSON object name.
+        void writeSignal(const char *name, const SignalMeters &signal);
+
+        unsigned int m_sampleRate;
+        unsigned int m_channels;
+        float m_fullScale;
+
+        // Frames of a period, and frames of the current period analysed.
+        size_t m_periodFrames;
+        size_t m_periodPos;
+
+        // Frames analysed in all.
+        uint64_t m_frames;
+
+        // Rings of interleaved input and output frames, from the audio thread.
+        SpscRing<float> m_inRing;
+        SpscRing<float> m_outRing;
+
+        // Set by pushInput() when the rings had room for the block.
+        bool m_accepted;
+        std::atomic<uint64_t> m_droppedBlocks;
+
+        // Frames read from a ring, and a window of samples being transformed
+        // with its spectrum.
+        std::unique_ptr<float[]> m_block;
+        std::unique_ptr<float[]> m_windowed;
+        std::unique_ptr<float[]> m_re;
+        std::unique_ptr<float[]> m_im;
+
+        // Hann window, and the transform.
+        std::unique_ptr<float[]> m_hann;
+        Fft m_fft;
+
+        Meter m_input;
+        Meter m_output;
+
+        // Meters being filled by the analysis thread, and those published.
+        std::unique_ptr<AnalysisMeters> m_current;
+        Snapshot<AnalysisMeters> m_meters;
+
+        // Output of the meters (NULL for none).
+        FILE *m_file;
+
+        // Analysis thread, cleared to stop it.
+        std::thread m_thread;
+        std::atomic<bool> m_running;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "sampleformat.h"
+
+// Result of a blocking read or write.
+enum AudioStatus {
+    AUDIO_OK,
+    // Input samples were lost, or output had a gap, but the stream goes on.
+    AUDIO_INPUT_OVERFLOW,
+    AUDIO_OUTPUT_UNDERFLOW,
+    // The stream has ended (e.g. the input file is over).
+    AUDIO_END,
+    // The stream failed, the backend has printed why.
+    AUDIO_ERROR
+};
+
+// Status flags passed to the stream callback, set when input samples were
+// lost or output had a gap since the previous callback.
+enum AudioFlags {
+    AUDIO_FLAG_INPUT_OVERFLOW = 1,
+    AUDIO_FLAG_OUTPUT_UNDERFLOW = 2
+};
+
+// Times of a callback, in seconds on the clock of the stream: when the first
+// input sample was captured, now, and when the first output sample will be
+// played. A backend that does not know them passes 0.
+struct AudioTime {
+    double inputAdc;
+    double current;
+    double outputDac;
+};
+
+// Stream callback: process frames interleaved frames from input (NULL if
+// there is none) into output. Runs on the audio thread of the backend, so it
+// must never block, lock or allocate.
+typedef void (*AudioCallback)(const void *input, void *output, unsigned long frames,
+                              const AudioTime &time, unsigned int flags, void *userData);
+
+// Settings of a duplex stream, with as many input channels as output channels.
+struct AudioStreamSettings {
+    unsigned int channels;
+    unsigned int sampleRate;
+    unsigned int framesPerBuffer;
+    SampleFormat format;
+    // Ask for the low latency of the device (callback streams) rather than
+    // its safe default.
+    bool lowLatency;
+};
+
+// AudioBackend
+//
+// The audio device a PAudioPipe streams through: PortAudio for sound cards,
+// or a synthetic device (see NullBackend, FileBackend) for machines without
+// one. A backend opens one duplex stream at a time, which is either driven by
+// a callback on the audio thread of the backend, or read and written block by
+// block by the caller (blocking stream).
+class AudioBackend {
+    public:
+        virtual ~AudioBackend() {}
+
+        // Name of the backend, e.g. "portaudio".
+        virtual const char* name() const = 0;
+
+        // List available audio devices.
+        virtual void listDevices() = 0;
+
+        // Print the information of the audio device with given index.
+        virtual void printDeviceInfo(unsigned int index) = 0;
+
+        // Use the device with given index for input or output. Returns false,
+        // and keeps the default device, if it has no such direction.
+        virtual bool setInputDevice(unsigned int index) = 0;
+        virtual bool setOutputDevice(unsigned int index) = 0;
+
+        // Index of the device used for input or output: the one set, or else
+        // the default one. -1 if there is none.
+        virtual int inputDevice() = 0;
+        virtual int outputDevice() = 0;
+
+        // Native sample rate of the input device in Hz, 0 if any rate will do.
+        virtual unsigned int nativeRate() = 0;
+
+        // Open a stream.
+        // callback: stream callback, NULL for a blocking stream.
+        // Returns false, after printing why, if the stream cannot be opened.
+        virtual bool open(const AudioStreamSettings &settings, AudioCallback callback, void *userData) = 0;
+
+        // Start and stop the open stream. start() returns false on failure.
+        virtual bool start() = 0;
+        virtual void stop() = 0;
+
+        // Close the open stream, if any.
+        virtual void close() = 0;
+
+        // Returns true while a callback stream runs (until stop() or its end).
+        virtual bool isActive() = 0;
+
+        // Read or write frames frames of a blocking stream. read() waits
+        // until the input has been captured, write() until there is room.
+        virtual AudioStatus read(void *buffer, unsigned long frames) = 0;
+        virtual AudioStatus write(const void *buffer, unsigned long frames) = 0;
+
+        // Input plus output latency of the open stream in seconds, as the
+        // device reports it.
+        virtual double latency() = 0;
+};
@@ -0,0 +1,198 @@
+#include "batchrenderer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+#include "offlinerenderer.h"
+#include "wavfile.h"
+#include "workstealingpool.h"
+
+// One file of the batch.
+// The files are opened by the first of their chunks to run and closed by the
+// last one, so only the files being worked on are open.
+struct BatchJob {
+    std::string inPath;
+    std::string outPath;
+
+    std::once_flag openOnce;
+    bool opened = false;
+    WavFile in;
+    WavFile out;
+
+    // Chunks not rendered yet.
+    std::atomic<size_t> pending;
+};
+
+
+BatchRenderer::BatchRenderer()
+        : m_idxF(0) {
+}
+
+BatchRenderer::~BatchRenderer() {
+}
+
+bool BatchRenderer::loadManifest(const char *path) {
+    std::ifstream manifest(path);
+    if (!manifest) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+
+    m_manifest.clear();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(manifest, line)) {
+        lineNumber++;
+        std::istringstream fields(line);
+        std::string inPath, outPath, extra;
+        if (!(fields >> inPath) || inPath[0] == '#')
+            continue;
+        if (!(fields >> outPath) || (fields >> extra)) {
+            fprintf(stderr, "%s:%d: expected an input and an output path\n", path, lineNumber);
+            return false;
+        }
+        m_manifest.push_back(std::make_pair(inPath, outPath));
+    }
+    if (m_manifest.empty()) {
+        fprintf(stderr, "%s: no files to render\n", path);
+        return false;
+    }
+    return true;
+}
+
+bool BatchRenderer::render(int threads) {
+    RunStats stats = renderOnce(threads);
+    double seconds = std::max(stats.seconds, 1e-9);
+    printf("Rendered %zu files (%zu failed), %zu samples (%.2f s of audio) with %s on %d threads in %.3f s\n",
+           stats.files - stats.failed, stats.failed, stats.samples, stats.audioSeconds,
+           kCoreProcesses[m_idxF].c_str(), threads, stats.seconds);
+    printf("Throughput: %.0f samples/s (%.1fx real time), %lu chunks, %lu stolen\n",
+           stats.samples / seconds, stats.audioSeconds / seconds, stats.chunks, stats.steals);
+    return stats.failed == 0;
+}
+
+bool BatchRenderer::renderScaling(int maxThreads) {
+    std::vector<int> counts;
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(maxThreads);
+
+    // Untimed run first, so that every timed run finds the files in the page cache.
+    bool ok = renderOnce(maxThreads).failed == 0;
+
+    printf("%-8s %10s %14s %10s %10s\n", "threads", "seconds", "samples/s", "speedup", "efficiency");
+    double baseSeconds = 0;
+    for (int threads : counts) {
+        RunStats stats = renderOnce(threads);
+        ok = ok && stats.failed == 0;
+        double seconds = std::max(stats.seconds, 1e-9);
+        if (threads == 1)
+            baseSeconds = seconds;
+        double speedup = baseSeconds / seconds;
+        printf("%-8d %10.3f %14.0f %10.2f %9.0f%%\n",
+               threads, stats.seconds, stats.samples / seconds, speedup, 100 * speedup / threads);
+    }
+    return ok;
+}
+
+BatchRenderer::RunStats BatchRenderer::renderOnce(int threads) {
+    RunStats stats = RunStats();
+    WorkStealingPool pool(threads);
+
+    // One reusable processor and block per worker.
+    while ((int)m_processors.size() < pool.threads()) {
+        std::unique_ptr<SoundProcessor> processor(new SoundProcessor());
+        processor->setParams(m_params);
+        processor->setImpulseResponse(m_impulseResponse);
+        processor->setFunction(m_idxF);
+        m_processors.push_back(std::move(processor));
+        m_blocks.emplace_back(new float[OfflineRenderer::BLOCK_LEN]);
+    }
+
+    // Plan the chunks from the file headers. The planner only tells how
+    // far back the effect reads at each sample rate.
+    SoundProcessor planner;
+    planner.setParams(m_params);
+    planner.setFunction(m_idxF);
+
+    std::vector<std::unique_ptr<BatchJob>> jobs;
+    for (const auto &paths : m_manifest) {
+        stats.files++;
+        WavFile in;
+        if (!in.openRead(paths.first.c_str())) {
+            stats.failed++;
+            continue;
+        }
+        if (in.channels() > MAX_CHANNELS) {
+            fprintf(stderr, "%s: unsupported number of channels (%d)\n", paths.first.c_str(), in.channels());
+            stats.failed++;
+            continue;
+        }
+
+        planner.initialize(in.sampleRate(), in.channels());
+        size_t overlap = 0;
+        size_t frames = in.frames();
+        size_t chunkFrames = planner.feedForward(overlap) ? (size_t)CHUNK_FRAMES : std::max(frames, (size_t)1);
+        size_t chunks = std::max((frames + chunkFrames - 1) / chunkFrames, (size_t)1);
+
+        std::unique_ptr<BatchJob> job(new BatchJob());
+        job->inPath = paths.first;
+        job->outPath = paths.second;
+        job->pending = chunks;
+        BatchJob *j = job.get();
+        for (size_t i = 0; i < chunks; i++) {
+            size_t begin = i * chunkFrames;
+            size_t end = std::min(begin + chunkFrames, frames);
+            pool.submit([this, j, begin, end, overlap](int worker) {
+                renderChunk(worker, *j, begin, end, overlap);
+            });
+        }
+        stats.chunks += chunks;
+        stats.samples += frames * in.channels();
+        stats.audioSeconds += (double)frames / in.sampleRate();
+        jobs.push_back(std::move(job));
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    pool.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    stats.seconds = elapsed.count();
+    stats.steals = pool.steals();
+
+    for (const auto &job : jobs) {
+        if (!job->opened)
+            stats.failed++;
+    }
+    return stats;
+}
+
+void BatchRenderer::renderChunk(int worker, BatchJob &job, size_t begin, size_t end, size_t overlap) {
+    std::call_once(job.openOnce, [&job]() {
+        job.opened = job.in.openRead(job.inPath.c_str()) &&
+                     job.out.create(job.outPath.c_str(), job.in.format(), job.in.channels(),
+                                    job.in.sampleRate(), job.in.frames());
+    });
+
+    if (job.opened) {
+        // Resetting the processor clears the history of the last chunk.
+        SoundProcessor &processor = *m_processors[worker];
+        processor.setBlockSize(OfflineRenderer::BLOCK_LEN / job.in.channels());
+        processor.initialize(job.in.sampleRate(), job.in.channels());
+
+        size_t warmUp = std::min(overlap, begin);
+        OfflineRenderer::renderFrames(processor, job.in, job.out, begin - warmUp, begin, end,
+                                      m_blocks[worker].get());
+    }
+
+    // The last chunk closes the files, which flushes the output.
+    if (--job.pending == 0) {
+        job.in.close();
+        job.out.close();
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Include audio or sound effects producing class.
+#include "soundprocessor.h"
+
+struct BatchJob;
+
+// BatchRenderer
+//
+// Renders a batch of WAV files through one sound effect on all the cores, in
+// one process, without any audio device.
+// The files are cut into chunks that run on a WorkStealingPool, with one
+// SoundProcessor per worker reused for all the chunks it runs. Feed-forward
+// effects (see SoundProcessor::feedForward()) are cut every CHUNK_FRAMES
+// frames, each chunk first re-reading the overlap before it to warm up the
+// effect, so the output is the same as rendering the file in one go. Effects
+// with feedback or an oscillator are rendered one whole file per chunk.
+class BatchRenderer {
+    public:
+        BatchRenderer();
+        ~BatchRenderer();
+
+        // Select the audio/sound effect function.
+        // idxF: Index to the sound effect or dsp function (see kCoreProcesses).
+        void setFunction(int idxF) { m_idxF = idxF; }
+
+        // Set the effect parameters (see EffectParams).
+        void setParams(const EffectParams &params) { m_params = params; }
+
+        // Set the impulse response of Convolution Reverb (NULL for the synthetic room).
+        void setImpulseResponse(std::shared_ptr<const ImpulseResponse> ir) { m_impulseResponse = ir; }
+
+        // Read the list of files to render.
+        // path: manifest with one input and one output WAV path per line,
+        // separated by whitespace. Empty lines and lines starting with # are skipped.
+        // Returns true on success, prints the reason and returns false otherwise.
+        bool loadManifest(const char *path);
+
+        // Render all the files of the manifest on the given number of threads.
+        // Prints the aggregate throughput at the end.
+        // Returns true if every file was rendered.
+        bool render(int threads);
+
+        // Render the batch on 1, 2, 4, ... and maxThreads threads and print the
+        // throughput, speedup and scaling efficiency (speedup per thread) of each.
+        // Returns true if every file was rendered in every run.
+        bool renderScaling(int maxThreads);
+
+    private:
+        // Number of frames per chunk of the feed-forward effects.
+        enum { CHUNK_FRAMES = 1 << 18 };
+
+        // Totals of one run over the batch.
+        struct RunStats {
+            size_t files;
+            size_t failed;
+            size_t samples;
+            double audioSeconds;
+            double seconds;
+            unsigned long chunks;
+            unsigned long steals;
+        };
+
+        // Render the batch once on the given number of threads.
+        RunStats renderOnce(int threads);
+
+        // Render frames [begin, end) of a file on a worker.
+        // overlap: frames before begin re-read to warm up the effect.
+        void renderChunk(int worker, BatchJob &job, size_t begin, size_t end, size_t overlap);
+
+        // Pairs of input and output paths.
+        std::vector<std::pair<std::string, std::string>> m_manifest;
+
+        // Index for sound effect or dsp function (see kCoreProcesses).
+        int m_idxF;
+
+        // Effect parameters.
+        EffectParams m_params;
+
+        // Impulse response of Convolution Reverb.
+        std::shared_ptr<const ImpulseResponse> m_impulseResponse;
+
+        // Sound processor and conversion block of each worker.
+        std::vector<std::unique_ptr<SoundProcessor>> m_processors;
+        std::vector<std::unique_ptr<float[]>> m_blocks;
+};
@@ -0,0 +1,892 @@
+// Micro-benchmark for the sound effects in kCoreProcesses.
+//
+// Every effect is run over synthetic input at several block sizes and sample
+// rates (and channel counts in the channels suite). Each measurement is warmed up first and then repeated, and the median
+// repetition is reported as ns/sample, samples/s and cycles/sample (TSC cycles,
+// x86 only). Results are printed as a table, or as CSV/JSON so that they can be
+// diffed between builds.
+//
+// The threads suite also checks that processors are independent: instances
+// at different sample rates running at once on several threads must produce
+// the same output as each of them run alone, and the chain suite that the
+// fused and the runtime chains produce the same output, and the silence suite
+// that the bypass produces the same output in place. The benchmark exits
+// with status 1 if any check fails.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "analysistap.h"
+#include "denormals.h"
+#include "effectchain.h"
+#include "resampler.h"
+#include "simdkernels.h"
+#include "soundprocessor.h"
+#include "voicebank.h"
+
+#define PI 3.14159265359
+
+// Output format of the results.
+enum OutputFormat {
+    OUTPUT_TABLE,
+    OUTPUT_CSV,
+    OUTPUT_JSON
+};
+
+// Benchmark settings (see printUsage).
+struct BenchOptions {
+    OutputFormat format = OUTPUT_TABLE;
+    int warmup = 1;
+    int reps = 5;
+    size_t samples = 1 << 20;
+    std::vector<int> blockSizes = {16, 64, 256, 1024, 4096};
+    std::vector<int> sampleRates = {44100, 48000, 96000};
+    std::vector<int> channelCounts = {1, 2, 8};
+    int threads = 8;
+    std::vector<int> voiceCounts = {1, 16, 64, 256};
+    std::string suite;  // empty for all suites
+};
+
+// One measurement.
+struct BenchResult {
+    std::string suite;
+    std::string name;
+    int sampleRate;
+    int blockSize;
+    int channels;
+    double nsPerSample;  // per sample of one channel
+    double samplesPerSec;
+    double cyclesPerSample;  // negative if not available
+};
+
+
+static uint64_t readCycles() {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Synthetic input: a few tones plus noise in 16 bit integer range.
+static std::vector<float> makeInput(size_t n, int sampleRate) {
+    std::vector<float> x(n);
+    srand(1);
+    for (size_t i = 0; i < n; i++) {
+        double t = (double)i / sampleRate;
+        x[i] = (float)(6000 * sin(2 * PI * 220 * t)
+                     + 3000 * sin(2 * PI * 1375 * t)
+                     + (rand() % 4001 - 2000));
+    }
+    return x;
+}
+
+// Run fn (which processes samples samples) warmup + reps times.
+// Returns the result of the median repetition.
+template <typename Fn>
+static BenchResult measure(const BenchOptions &opt, size_t samples, Fn fn) {
+    std::vector<double> ns;
+    std::vector<double> cycles;
+    for (int r = 0; r < opt.warmup + opt.reps; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t c0 = readCycles();
+        fn();
+        uint64_t c1 = readCycles();
+        std::chrono::duration<double, std::nano> dt = std::chrono::steady_clock::now() - t0;
+        if (r < opt.warmup)
+            continue;
+        ns.push_back(dt.count() / samples);
+        cycles.push_back((double)(c1 - c0) / samples);
+    }
+    std::sort(ns.begin(), ns.end());
+    std::sort(cycles.begin(), cycles.end());
+
+    BenchResult res;
+    res.sampleRate = 0;
+    res.blockSize = 0;
+    res.channels = 1;
+    res.nsPerSample = ns[ns.size() / 2];
+    res.samplesPerSec = 1e9 / res.nsPerSample;
+#ifdef HAVE_TSC
+    res.cyclesPerSample = cycles[cycles.size() / 2];
+#else
+    res.cyclesPerSample = -1;
+#endif
+    return res;
+}
+
+// Run every effect in kCoreProcesses at every block size and sample rate.
+static void benchEffects(const BenchOptions &opt, std::vector<BenchResult> &results) {
+    std::vector<float> out(opt.samples);
+    std::unique_ptr<SoundProcessor> proc(new SoundProcessor());
+
+    for (int sampleRate : opt.sampleRates) {
+        std::vector<float> in = makeInput(opt.samples, sampleRate);
+        for (int idxF = 0; idxF < kNumCoreProcesses; idxF++) {
+            for (int blockSize : opt.blockSizes) {
+                proc->setBlockSize(blockSize);
+                proc->initialize(sampleRate);
+                proc->setFunction(idxF);
+                BenchResult res = measure(opt, opt.samples, [&]() {
+                    for (size_t pos = 0; pos < opt.samples; pos += blockSize) {
+                        size_t n = std::min((size_t)blockSize, opt.samples - pos);
+                        proc->processBlock(&in[pos], &out[pos], n);
+                    }
+                });
+                res.suite = "effect";
+                res.name = kCoreProcesses[idxF];
+                res.sampleRate = sampleRate;
+                res.blockSize = blockSize;
+                results.push_back(res);
+            }
+        }
+    }
+}
+
+// Run every effect in kCoreProcesses on interleaved input with several
+// channels. Time per sample of one channel should stay flat as channels grow.
+static void benchChannels(const BenchOptions &opt, std::vector<BenchResult> &results) {
+    std::vector<float> out(opt.samples);
+    std::unique_ptr<SoundProcessor> proc(new SoundProcessor());
+
+    for (int sampleRate : opt.sampleRates) {
+        std::vector<float> in = makeInput(opt.samples, sampleRate);
+        for (int idxF = 0; idxF < kNumCoreProcesses; idxF++) {
+            for (int channels : opt.channelCounts) {
+                size_t frames = opt.samples / channels;
+                for (int blockSize : opt.blockSizes) {
+                    proc->setBlockSize(blockSize);
+                    proc->initialize(sampleRate, channels);
+                    proc->setFunction(idxF);
+                    BenchResult res = measure(opt, frames * channels, [&]() {
+                        for (size_t pos = 0; pos < frames; pos += blockSize) {
+                            size_t n = std::min((size_t)blockSize, frames - pos);
+                            proc->processBlock(&in[pos * channels], &out[pos * channels], n);
+                        }
+                    });
+                    res.suite = "channels";
+                    res.name = kCoreProcesses[idxF];
+                    res.sampleRate = sampleRate;
+                    res.blockSize = blockSize;
+                    res.channels = proc->channels();
+                    results.push_back(res);
+                }
+            }
+        }
+    }
+}
+
+// Run Fuzz at every oversampling factor, to show what the anti-aliasing
+// filters cost per factor.
+static void benchOversampling(const BenchOptions &opt, std::vector<BenchResult> &results) {
+    static const int kFactors[] = {1, 2, 4, 8};
+    std::vector<float> out(opt.samples);
+    std::unique_ptr<SoundProcessor> proc(new SoundProcessor());
+
+    for (int sampleRate : opt.sampleRates) {
+        std::vector<float> in = makeInput(opt.samples, sampleRate);
+        for (int factor : kFactors) {
+            for (int blockSize : opt.blockSizes) {
+                EffectParams params;
+                params.fuzzOversampling = factor;
+                proc->initialize(sampleRate);
+                proc->setParams(params);
+                proc->setFunction(6);
+                BenchResult res = measure(opt, opt.samples, [&]() {
+                    for (size_t pos = 0; pos < opt.samples; pos += blockSize) {
+                        size_t n = std::min((size_t)blockSize, opt.samples - pos);
+                        proc->processBlock(&in[pos], &out[pos], n);
+                    }
+                });
+                res.suite = "oversampling";
+                res.name = std::string(kCoreProcesses[6]) + " " + std::to_string(factor) + "x";
+                res.sampleRate = sampleRate;
+                res.blockSize = blockSize;
+                results.push_back(res);
+            }
+        }
+    }
+}
+
+// Resample one second of a tone at freq Hz from inRate to outRate.
+// Returns the level of the output in dB relative to the tone, and the level of
+// its difference from the ideal output in error (both over the last 3/4).
+static double resampleTone(int inRate, int outRate, double freq, double &error) {
+    Resampler resampler;
+    resampler.initialize(inRate, outRate, 1);
+    std::vector<float> x(inRate);
+    for (int i = 0; i < inRate; i++)
+        x[i] = (float)sin(2 * PI * freq * i / inRate);
+    std::vector<float> y(resampler.maxOutput(inRate));
+    size_t n = resampler.process(x.data(), x.size(), y.data());
+
+    // Output j stands for input time j * inRate / outRate.
+    double power = 0, errorPower = 0;
+    for (size_t j = n / 4; j < n; j++) {
+        double ideal = sin(2 * PI * freq * j / outRate);
+        power += (double)y[j] * y[j];
+        errorPower += (y[j] - ideal) * (y[j] - ideal);
+    }
+    double tonePower = 0.5 * (n - n / 4);
+    error = 10 * log10(errorPower / tonePower);
+    return 10 * log10(power / tonePower);
+}
+
+// Run the resampler at several rate pairs, one channel, and print its quality:
+// the error of a tone at 0.38 times the lower rate (images and passband
+// ripple), and the rejection of a tone above the output Nyquist frequency.
+static void benchResampler(const BenchOptions &opt, std::vector<BenchResult> &results) {
+    static const int kRatePairs[][2] = {
+        {44100, 48000}, {48000, 44100}, {44100, 96000}, {96000, 44100}, {48000, 96000}, {44100, 47999}};
+    std::vector<float> in = makeInput(opt.samples, 44100);
+
+    for (const int *rates : kRatePairs) {
+        int lower = std::min(rates[0], rates[1]);
+        double error;
+        resampleTone(rates[0], rates[1], 0.38 * lower, error);
+        fprintf(stderr, "Resampler %d -> %d Hz: error %.1f dB at %.0f Hz", rates[0], rates[1], error, 0.38 * lower);
+        if (rates[1] < rates[0])
+            fprintf(stderr, ", alias rejection %.1f dB at %.0f Hz",
+                    -resampleTone(rates[0], rates[1], 0.55 * rates[1], error), 0.55 * rates[1]);
+        fprintf(stderr, "\n");
+
+        Resampler resampler;
+        for (int blockSize : opt.blockSizes) {
+            resampler.initialize(rates[0], rates[1], 1);
+            std::vector<float> out(resampler.maxOutput(blockSize));
+            BenchResult res = measure(opt, opt.samples, [&]() {
+                for (size_t pos = 0; pos < opt.samples; pos += blockSize) {
+                    size_t n = std::min((size_t)blockSize, opt.samples - pos);
+                    resampler.process(&in[pos], n, out.data());
+                }
+            });
+            res.suite = "resampler";
+            res.name = "Resample to " + std::to_string(rates[1]);
+            res.sampleRate = rates[0];
+            res.blockSize = blockSize;
+            results.push_back(res);
+        }
+    }
+}
+
+// Effects of the bank suite: the cheap ones a mixer runs on every voice.
+static const int kBankEffects[] = {2, 3, 5, 6, 8};  // IIR Echo, Natural Echo, Filter Out, Fuzz, Tremolo
+
+// Run the bank effects on many mono voices, once with a VoiceBank and once
+// with a SoundProcessor per voice. Time per sample of one voice should drop
+// with the bank as the voice count grows.
+static void benchBank(const BenchOptions &opt, std::vector<BenchResult> &results) {
+    for (int sampleRate : opt.sampleRates) {
+        std::vector<float> in = makeInput(opt.samples, sampleRate);
+        std::vector<float> out(opt.samples);
+        for (int idxF : kBankEffects) {
+            for (int voices : opt.voiceCounts) {
+                // Every voice gets its own slice of the input and output.
+                size_t frames = opt.samples / voices;
+                std::vector<const float*> x(voices);
+                std::vector<float*> y(voices);
+
+                VoiceBank bank;
+                bank.initialize(sampleRate, voices);
+                bank.setFunction(idxF);
+                std::vector<std::unique_ptr<SoundProcessor>> singles;
+                for (int v = 0; v < voices; v++) {
+                    singles.emplace_back(new SoundProcessor());
+                    singles.back()->initialize(sampleRate);
+                    singles.back()->setFunction(idxF);
+                }
+
+                for (int blockSize : opt.blockSizes) {
+                    BenchResult res = measure(opt, frames * voices, [&]() {
+                        for (size_t pos = 0; pos < frames; pos += blockSize) {
+                            size_t n = std::min((size_t)blockSize, frames - pos);
+                            for (int v = 0; v < voices; v++) {
+                                x[v] = &in[v * frames + pos];
+                                y[v] = &out[v * frames + pos];
+                            }
+                            bank.process(x.data(), y.data(), n);
+                        }
+                    });
+                    res.suite = "bank";
+                    res.name = kCoreProcesses[idxF];
+                    res.sampleRate = sampleRate;
+                    res.blockSize = blockSize;
+                    res.channels = voices;
+                    results.push_back(res);
+
+                    res = measure(opt, frames * voices, [&]() {
+                        for (size_t pos = 0; pos < frames; pos += blockSize) {
+                            size_t n = std::min((size_t)blockSize, frames - pos);
+                            for (int v = 0; v < voices; v++) {
+                                const float *xv = &in[v * frames + pos];
+                                float *yv = &out[v * frames + pos];
+                                singles[v]->processChannels(&xv, &yv, n);
+                            }
+                        }
+                    });
+                    res.suite = "single";
+                    res.name = kCoreProcesses[idxF];
+                    res.sampleRate = sampleRate;
+                    res.blockSize = blockSize;
+                    res.channels = voices;
+                    results.push_back(res);
+                }
+            }
+        }
+    }
+}
+
+// Effects of the denormals suite: the ones whose feedback decays toward zero.
+static const int kDenormalEffects[] = {2, 3, 4, 5, 9};  // IIR Echo, Natural Echo, Reverb, Filter Out, Equalizer
+
+// Length of the stretches of the denormals suite that are timed as one, in
+// samples (at least a block).
+#define DENORMAL_SEGMENT 4096
+
+// Run the feedback effects over a decaying impulse: one full scale sample,
+// then silence until opt.samples, with delays short enough for the echoes to
+// decay into subnormal floats within the run. Runs plain, with subnormals
+// flushed to zero (where the CPU can) and with the anti-denormal bias, at the
+// first sample rate. Every stretch of the run is timed on its own, and the
+// slowest one (median over the repetitions) is reported as the tail, next to
+// the time of the same effect on busy input (synthetic input). The tail
+// should cost no more than busy input unless the run is plain.
+static void benchDenormals(const BenchOptions &opt, std::vector<BenchResult> &results) {
+    static const char *kVariants[] = {"plain", "flush", "bias"};
+    int sampleRate = opt.sampleRates[0];
+    std::vector<float> busy = makeInput(opt.samples, sampleRate);
+    std::vector<float> impulse(opt.samples, 0.0f);
+    impulse[0] = 32767;
+    std::vector<float> out(opt.samples);
+
+    EffectParams params;
+    params.echoDelay = 0.005;
+    params.reverbDelay = 0.005;
+    std::unique_ptr<SoundProcessor> proc(new SoundProcessor());
+
+    for (int idxF : kDenormalEffects) {
+        for (int blockSize : opt.blockSizes) {
+            size_t segment = std::max((size_t)DENORMAL_SEGMENT / blockSize, (size_t)1) * blockSize;
+            size_t segments = (opt.samples + segment - 1) / segment;
+
+            // Returns the time of every segment of a run over in, in ns per
+            // sample (median over the repetitions).
+            auto run = [&](const std::vector<float> &in, int variant) {
+                std::vector<std::vector<double>> ns(segments);
+                for (int r = 0; r < opt.warmup + opt.reps; r++) {
+                    proc->initialize(sampleRate);
+                    proc->setParams(params);
+                    proc->setAntiDenormal(variant == 2);
+                    proc->setFunction(idxF);
+                    ScopedFlushDenormals flushDenormals(variant == 1);
+                    for (size_t s = 0; s < segments; s++) {
+                        size_t end = std::min(opt.samples, (s + 1) * segment);
+                        auto t0 = std::chrono::steady_clock::now();
+                        for (size_t pos = s * segment; pos < end; pos += blockSize) {
+                            size_t n = std::min((size_t)blockSize, end - pos);
+                            proc->processBlock(&in[pos], &out[pos], n);
+                        }
+                        std::chrono::duration<double, std::nano> dt = std::chrono::steady_clock::now() - t0;
+                        if (r >= opt.warmup)
+                            ns[s].push_back(dt.count() / (end - s * segment));
+                    }
+                }
+                std::vector<double> median(segments);
+                for (size_t s = 0; s < segments; s++) {
+                    std::sort(ns[s].begin(), ns[s].end());
+                    median[s] = ns[s][ns[s].size() / 2];
+                }
+                return median;
+            };
+
+            fprintf(stderr, "%s, %d frames: tail/busy", kCoreProcesses[idxF].c_str(), blockSize);
+            for (int variant = 0; variant < 3; variant++) {
+                if (variant == 1 && !canFlushDenormals())
+                    continue;
+                std::vector<double> busyTimes = run(busy, variant);
+                std::vector<double> tailTimes = run(impulse, variant);
+                std::sort(busyTimes.begin(), busyTimes.end());
+                double times[] = {busyTimes[segments / 2], *std::max_element(tailTimes.begin(), tailTimes.end())};
+                fprintf(stderr, " %s %.1fx", kVariants[variant], times[1] / times[0]);
+
+                const char *parts[] = {"busy", "tail"};
+                for (int part = 0; part < 2; part++) {
+                    BenchResult res;
+                    res.suite = "denormals";
+                    res.name = kCoreProcesses[idxF] + " " + kVariants[variant] + " " + parts[part];
+                    res.sampleRate = sampleRate;
+                    res.blockSize = blockSize;
+                    res.channels = 1;
+                    res.nsPerSample = times[part];
+                    res.samplesPerSec = 1e9 / res.nsPerSample;
+                    res.cyclesPerSample = -1;
+                    results.push_back(res);
+                }
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+}
+
+// Seconds of signal and of silence in turn in the input of the silence suite.
+#define SILENCE_TALK 1
+#define SILENCE_PAUSE 4
+
+// Level of the noise in the silence of the in-place check of the silence
+// suite (some 100 dB below full scale, under the default threshold).
+#define SILENCE_NOISE 0.3f
+
+// Run every effect over input that is mostly silent (SILENCE_TALK seconds of
+// synthetic input, then SILENCE_PAUSE seconds of silence, over and over), with
+// and without silence bypass at the default threshold, at the first sample
+// rate. Prints the share of blocks bypassed, the speedup and the largest
+// difference between the two outputs, which should stay below the threshold.
+// Then checks that the bypass gives the same output in place (as the live
+// streams run it) as out of place, with faint noise in the silence, so that
+// the history of the input matters.
+// Returns false if it does not.
+static bool benchSilence(const BenchOptions &opt, std::vector<BenchResult> &results) {
+    int sampleRate = opt.sampleRates[0];
+    std::vector<float> in = makeInput(opt.samples, sampleRate);
+    size_t period = (size_t)(SILENCE_TALK + SILENCE_PAUSE) * sampleRate;
+    for (size_t i = 0; i < opt.samples; i++) {
+        if (i % period >= (size_t)SILENCE_TALK * sampleRate)
+            in[i] = 0;
+    }
+    std::vector<float> noisy = in;
+    for (size_t i = 0; i < opt.samples; i++) {
+        if (in[i] == 0)
+            noisy[i] = SILENCE_NOISE * (rand() % 2001 - 1000) / 1000;
+    }
+    std::vector<float> out(opt.samples);
+    std::vector<float> bypassed(opt.samples);
+    std::vector<float> inPlace(opt.samples);
+    bool same = true;
+    std::unique_ptr<SoundProcessor> proc(new SoundProcessor());
+
+    for (int idxF = 0; idxF < kNumCoreProcesses; idxF++) {
+        for (int blockSize : opt.blockSizes) {
+            // The counters of the processor run on from the runs before.
+            BenchResult res[2];
+            uint64_t blocks = 0;
+            uint64_t bypassedBlocks = 0;
+            for (int bypass = 0; bypass < 2; bypass++) {
+                if (bypass) {
+                    blocks = proc->blocks();
+                    bypassedBlocks = proc->bypassedBlocks();
+                }
+                std::vector<float> &y = bypass ? bypassed : out;
+                res[bypass] = measure(opt, opt.samples, [&]() {
+                    proc->initialize(sampleRate);
+                    proc->setSilenceBypass(bypass == 1);
+                    proc->setFunction(idxF);
+                    for (size_t pos = 0; pos < opt.samples; pos += blockSize) {
+                        size_t n = std::min((size_t)blockSize, opt.samples - pos);
+                        proc->processBlock(&in[pos], &y[pos], n);
+                    }
+                });
+                res[bypass].suite = "silence";
+                res[bypass].name = kCoreProcesses[idxF] + (bypass ? " bypass" : " off");
+                res[bypass].sampleRate = sampleRate;
+                res[bypass].blockSize = blockSize;
+                results.push_back(res[bypass]);
+            }
+
+            float diff = 0;
+            for (size_t i = 0; i < opt.samples; i++)
+                diff = std::max(diff, fabsf(bypassed[i] - out[i]));
+            fprintf(stderr, "%s, %d frames: %.0f%% of blocks bypassed, %.1fx faster, "
+                    "largest difference %.0f dBFS\n",
+                    kCoreProcesses[idxF].c_str(), blockSize,
+                    100.0 * (proc->bypassedBlocks() - bypassedBlocks)
+                          / std::max(proc->blocks() - blocks, (uint64_t)1),
+                    res[0].nsPerSample / res[1].nsPerSample,
+                    diff > 0 ? 20 * log10(diff / 32767) : -INFINITY);
+
+            inPlace = noisy;
+            for (int aliased = 0; aliased < 2; aliased++) {
+                std::vector<float> &y = aliased ? inPlace : bypassed;
+                proc->initialize(sampleRate);
+                proc->setSilenceBypass(true);
+                proc->setFunction(idxF);
+                for (size_t pos = 0; pos < opt.samples; pos += blockSize) {
+                    size_t n = std::min((size_t)blockSize, opt.samples - pos);
+                    proc->processBlock(aliased ? &y[pos] : &noisy[pos], &y[pos], n);
+                }
+            }
+            if (memcmp(inPlace.data(), bypassed.data(), sizeof(float) * opt.samples) != 0) {
+                fprintf(stderr, "%s, %d frames: bypass in place differs\n",
+                        kCoreProcesses[idxF].c_str(), blockSize);
+                same = false;
+            }
+        }
+    }
+    return same;
+}
+
+// Frequency of the tone the meters of the tap suite are checked with.
+#define TAP_TONE_HZ 1000
+
+// Run every effect with and without an analysis tap (with its thread
+// running), at the first sample rate: the cost of the tap on the thread that
+// processes is the copy of every block, and blocks are dropped when the
+// analysis falls behind (it always does here, processing runs faster than
+// real time). Then checks the meters: one second of a full scale tone should
+// read 0 dBFS peak, -3 dBFS RMS and a spectrum peaking at the tone (at up
+// to 1.4 dB below 0 dBFS between two bins, through the Hann window).
+static void benchTap(const BenchOptions &opt, std::vector<BenchResult> &results) {
+    int sampleRate = opt.sampleRates[0];
+    std::vector<float> in = makeInput(opt.samples, sampleRate);
+    std::vector<float> out(opt.samples);
+    std::unique_ptr<SoundProcessor> proc(new SoundProcessor());
+
+    for (int idxF = 0; idxF < kNumCoreProcesses; idxF++) {
+        for (int blockSize : opt.blockSizes) {
+            BenchResult res[2];
+            uint64_t dropped = 0;
+            uint64_t blocks = 0;
+            for (int tapped = 0; tapped < 2; tapped++) {
+                std::unique_ptr<AnalysisTap> tap;
+                if (tapped) {
+                    tap.reset(new AnalysisTap(sampleRate, 1, 32767));
+                    tap->start();
+                }
+                proc->initialize(sampleRate);
+                proc->setFunction(idxF);
+                res[tapped] = measure(opt, opt.samples, [&]() {
+                    for (size_t pos = 0; pos < opt.samples; pos += blockSize) {
+                        size_t n = std::min((size_t)blockSize, opt.samples - pos);
+                        if (tap)
+                            tap->pushInput(&in[pos], n);
+                        proc->processBlock(&in[pos], &out[pos], n);
+                        if (tap)
+                            tap->pushOutput(&out[pos], n);
+                    }
+                });
+                if (tap) {
+                    dropped = tap->droppedBlocks();
+                    blocks = (uint64_t)(opt.warmup + opt.reps) * ((opt.samples + blockSize - 1) / blockSize);
+                }
+                res[tapped].suite = "tap";
+                res[tapped].name = kCoreProcesses[idxF] + (tapped ? " tap" : " plain");
+                res[tapped].sampleRate = sampleRate;
+                res[tapped].blockSize = blockSize;
+                results.push_back(res[tapped]);
+            }
+            fprintf(stderr, "%s, %d frames: tap costs %+.1f%%, %.0f%% of blocks dropped\n",
+                    kCoreProcesses[idxF].c_str(), blockSize,
+                    100 * (res[1].nsPerSample / res[0].nsPerSample - 1), 100.0 * dropped / blocks);
+        }
+    }
+
+    // One second fits the rings, so nothing is dropped; wait for the
+    // analysis of all of it.
+    AnalysisTap tap(sampleRate, 1, 32767);
+    std::vector<float> tone(sampleRate);
+    for (int i = 0; i < sampleRate; i++)
+        tone[i] = (float)(32767 * sin(2 * PI * TAP_TONE_HZ * i / sampleRate));
+    for (int pos = 0; pos < sampleRate; pos += CHUNK_LEN) {
+        size_t n = std::min(CHUNK_LEN, sampleRate - pos);
+        tap.pushInput(&tone[pos], n);
+        tap.pushOutput(&tone[pos], n);
+    }
+    std::unique_ptr<AnalysisMeters> meters(new AnalysisMeters());
+    meters->time = 0;
+    tap.start();
+    for (int waitMs = 0; meters->time < 0.9 && waitMs < 5000; waitMs += 10) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        tap.meters(*meters);
+    }
+    tap.stop();
+    const SignalMeters &m = meters->output;
+    int peakBin = (int)(std::max_element(m.spectrumDb, m.spectrumDb + ANALYSIS_BINS) - m.spectrumDb);
+    fprintf(stderr, "Tap meters of a full scale %d Hz tone: peak %.2f dBFS, RMS %.2f dBFS, "
+            "spectrum peak %.2f dBFS at %.0f Hz, %llu blocks dropped\n",
+            TAP_TONE_HZ, m.peakDb, m.rmsDb, m.spectrumDb[peakBin],
+            (double)peakBin * sampleRate / ANALYSIS_FFT_SIZE, (unsigned long long)meters->droppedBlocks);
+}
+
+// Run the chain Filter Out -> Fuzz -> Flanger -> Reverb, fused at compile time
+// (EffectChain) and built at run time (RuntimeEffectChain), and check that
+// both produce the same output, so that they do the same work.
+// Returns false if the outputs differ.
+static bool benchChains(const BenchOptions &opt, std::vector<BenchResult> &results) {
+    std::vector<float> out(opt.samples);
+    std::vector<float> fusedOut(opt.samples);
+    bool same = true;
+
+    for (int sampleRate : opt.sampleRates) {
+        std::vector<float> in = makeInput(opt.samples, sampleRate);
+        for (int blockSize : opt.blockSizes) {
+            auto run = [&](auto &chain) {
+                return measure(opt, opt.samples, [&]() {
+                    for (size_t pos = 0; pos < opt.samples; pos += blockSize) {
+                        size_t n = std::min((size_t)blockSize, opt.samples - pos);
+                        chain.processBlock(&in[pos], &out[pos], n);
+                    }
+                });
+            };
+
+            std::unique_ptr<EffectChain<BiQuad, Fuzz, Flanger, Reverb>> fused(
+                new EffectChain<BiQuad, Fuzz, Flanger, Reverb>());
+            fused->initialize(sampleRate);
+            BenchResult res = run(*fused);
+            res.suite = "chain";
+            res.name = "fused";
+            res.sampleRate = sampleRate;
+            res.blockSize = blockSize;
+            results.push_back(res);
+
+            fusedOut = out;
+
+            // The fused stages run the default models (Fuzz without oversampling).
+            EffectParams params;
+            params.fuzzOversampling = 1;
+            RuntimeEffectChain runtime;
+            runtime.initialize(sampleRate);
+            runtime.add(5, params);  // Filter Out
+            runtime.add(6, params);  // Fuzz
+            runtime.add(7, params);  // Flanger
+            runtime.add(4, params);  // Reverb
+            res = run(runtime);
+            if (memcmp(out.data(), fusedOut.data(), sizeof(float) * opt.samples) != 0) {
+                fprintf(stderr, "chain: fused and runtime outputs differ (%d Hz, %d frames)\n",
+                        sampleRate, blockSize);
+                same = false;
+            }
+            res.suite = "chain";
+            res.name = "runtime";
+            res.sampleRate = sampleRate;
+            res.blockSize = blockSize;
+            results.push_back(res);
+        }
+    }
+    return same;
+}
+
+// Run every effect on opt.threads processors at once, one per thread, with
+// the sample rates and block sizes taken in turn from the options, and compare
+// the output of each one with a run of the same processor on its own.
+// Returns false if any output differs.
+static bool benchThreads(const BenchOptions &opt, std::vector<BenchResult> &results) {
+    bool same = true;
+    int count = opt.threads;
+
+    std::vector<std::vector<float>> in(count), alone(count), out(count);
+    for (int t = 0; t < count; t++) {
+        in[t] = makeInput(opt.samples, opt.sampleRates[t % opt.sampleRates.size()]);
+        alone[t].resize(opt.samples);
+        out[t].resize(opt.samples);
+    }
+
+    // Render instance t of effect idxF into y.
+    auto render = [&](int idxF, int t, std::vector<float> &y) {
+        int sampleRate = opt.sampleRates[t % opt.sampleRates.size()];
+        size_t blockSize = opt.blockSizes[t % opt.blockSizes.size()];
+        std::unique_ptr<SoundProcessor> proc(new SoundProcessor());
+        proc->setBlockSize(blockSize);
+        proc->initialize(sampleRate);
+        proc->setFunction(idxF);
+        for (size_t pos = 0; pos < opt.samples; pos += blockSize) {
+            size_t n = std::min(blockSize, opt.samples - pos);
+            proc->processBlock(&in[t][pos], &y[pos], n);
+        }
+    };
+
+    for (int idxF = 0; idxF < kNumCoreProcesses; idxF++) {
+        for (int t = 0; t < count; t++)
+            render(idxF, t, alone[t]);
+
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < count; t++)
+            threads.emplace_back([&, idxF, t]() { render(idxF, t, out[t]); });
+        for (std::thread &thread : threads)
+            thread.join();
+        std::chrono::duration<double, std::nano> dt = std::chrono::steady_clock::now() - t0;
+
+        for (int t = 0; t < count; t++) {
+            if (memcmp(alone[t].data(), out[t].data(), opt.samples * sizeof(float)) != 0) {
+                fprintf(stderr, "%s: instance %d (%d Hz) differs when run on %d threads\n",
+                        kCoreProcesses[idxF].c_str(), t, opt.sampleRates[t % opt.sampleRates.size()], count);
+                same = false;
+            }
+        }
+
+        // Throughput of all the threads together.
+        BenchResult res;
+        res.suite = "threads";
+        res.name = kCoreProcesses[idxF];
+        res.sampleRate = 0;
+        res.blockSize = 0;
+        res.channels = 1;
+        res.nsPerSample = dt.count() / (opt.samples * count);
+        res.samplesPerSec = 1e9 / res.nsPerSample;
+        res.cyclesPerSample = -1;
+        results.push_back(res);
+    }
+    return same;
+}
+
+static void printResults(const BenchOptions &opt, const std::vector<BenchResult> &results) {
+    switch (opt.format) {
+        case OUTPUT_TABLE:
+            printf("SIMD kernels: %s\n", simdKernels().name);
+            printf("%-12s %-18s %8s %6s %3s %10s %14s %12s\n",
+                   "suite", "name", "rate", "block", "ch", "ns/sample", "samples/s", "cycles/sample");
+            for (const BenchResult &r : results) {
+                printf("%-12s %-18s %8d %6d %3d %10.3f %14.0f ",
+                       r.suite.c_str(), r.name.c_str(), r.sampleRate, r.blockSize, r.channels,
+                       r.nsPerSample, r.samplesPerSec);
+                if (r.cyclesPerSample >= 0)
+                    printf("%12.2f\n", r.cyclesPerSample);
+                else
+                    printf("%12s\n", "n/a");
+            }
+            break;
+        case OUTPUT_CSV:
+            printf("simd,suite,name,sample_rate,block_size,channels,ns_per_sample,samples_per_sec,cycles_per_sample\n");
+            for (const BenchResult &r : results) {
+                printf("%s,%s,%s,%d,%d,%d,%.4f,%.0f,",
+                       simdKernels().name, r.suite.c_str(), r.name.c_str(), r.sampleRate, r.blockSize,
+                       r.channels, r.nsPerSample, r.samplesPerSec);
+                if (r.cyclesPerSample >= 0)
+                    printf("%.3f\n", r.cyclesPerSample);
+                else
+                    printf("\n");
+            }
+            break;
+        case OUTPUT_JSON:
+            printf("{\n  \"simd\": \"%s\",\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"samples\": %zu,\n  \"results\": [\n",
+                   simdKernels().name, opt.warmup, opt.reps, opt.samples);
+            for (size_t i = 0; i < results.size(); i++) {
+                const BenchResult &r = results[i];
+                printf("    {\"suite\": \"%s\", \"name\": \"%s\", \"sample_rate\": %d, \"block_size\": %d, "
+                       "\"channels\": %d, \"ns_per_sample\": %.4f, \"samples_per_sec\": %.0f, ",
+                       r.suite.c_str(), r.name.c_str(), r.sampleRate, r.blockSize,
+                       r.channels, r.nsPerSample, r.samplesPerSec);
+                if (r.cyclesPerSample >= 0)
+                    printf("\"cycles_per_sample\": %.3f}", r.cyclesPerSample);
+                else
+                    printf("\"cycles_per_sample\": null}");
+                printf("%s\n", i + 1 < results.size() ? "," : "");
+            }
+            printf("  ]\n}\n");
+            break;
+    }
+}
+
+static void printUsage(const char *program) {
+    printf("Usage: %s [--csv | --json] [--warmup N] [--reps N] [--samples N]\n", program);
+    printf("          [--blocks N,N,...] [--rates N,N,...] [--simd scalar|sse2|avx2|neon]\n");
+    printf("          [--channels N,N,...] [--threads N] [--voices N,N,...]\n");
+    printf("          [--suite effect|channels|chain|threads|bank|oversampling|resampler|denormals|silence|tap]\n");
+}
+
+// Names accepted by --suite (see printUsage).
+static const char *kSuites[] = {"effect", "channels", "chain", "threads", "bank", "oversampling", "resampler",
+                                "denormals", "silence", "tap"};
+
+// Returns true if name is one of kSuites.
+static bool isSuite(const char *name) {
+    for (const char *suite : kSuites) {
+        if (strcmp(name, suite) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Parse a comma separated list of positive integers.
+static bool parseList(const char *arg, std::vector<int> &list) {
+    list.clear();
+    for (const char *p = arg; *p != '\0';) {
+        char *end;
+        long v = strtol(p, &end, 10);
+        if (end == p || v <= 0)
+            return false;
+        list.push_back((int)v);
+        p = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0')
+            return false;
+    }
+    return !list.empty();
+}
+
+int main(int argc, char *argv[]) {
+    BenchOptions opt;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        bool ok = true;
+        if (strcmp(argv[i], "--csv") == 0) {
+            opt.format = OUTPUT_CSV;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            opt.format = OUTPUT_JSON;
+        } else if (strcmp(argv[i], "--warmup") == 0 && hasValue) {
+            opt.warmup = std::max(0, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--reps") == 0 && hasValue) {
+            opt.reps = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--samples") == 0 && hasValue) {
+            opt.samples = std::max(1L, atol(argv[++i]));
+        } else if (strcmp(argv[i], "--blocks") == 0 && hasValue) {
+            ok = parseList(argv[++i], opt.blockSizes);
+        } else if (strcmp(argv[i], "--rates") == 0 && hasValue) {
+            ok = parseList(argv[++i], opt.sampleRates);
+        } else if (strcmp(argv[i], "--channels") == 0 && hasValue) {
+            ok = parseList(argv[++i], opt.channelCounts);
+        } else if (strcmp(argv[i], "--threads") == 0 && hasValue && atoi(argv[i + 1]) > 0) {
+            opt.threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--voices") == 0 && hasValue) {
+            ok = parseList(argv[++i], opt.voiceCounts);
+        } else if (strcmp(argv[i], "--suite") == 0 && hasValue) {
+            opt.suite = argv[++i];
+            ok = isSuite(opt.suite.c_str());
+        } else if (strcmp(argv[i], "--simd") == 0 && hasValue) {
+            ok = forceSimdKernels(argv[++i]);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            printUsage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    if (opt.suite.empty() || opt.suite == "effect")
+        benchEffects(opt, results);
+    if (opt.suite.empty() || opt.suite == "channels")
+        benchChannels(opt, results);
+    bool same = true;
+    if (opt.suite.empty() || opt.suite == "chain")
+        same = benchChains(opt, results);
+    if (opt.suite.empty() || opt.suite == "bank")
+        benchBank(opt, results);
+    if (opt.suite.empty() || opt.suite == "oversampling")
+        benchOversampling(opt, results);
+    if (opt.suite.empty() || opt.suite == "resampler")
+        benchResampler(opt, results);
+    if (opt.suite.empty() || opt.suite == "denormals")
+        benchDenormals(opt, results);
+    if (opt.suite.empty() || opt.suite == "silence")
+        same = benchSilence(opt, results) && same;
+    if (opt.suite.empty() || opt.suite == "tap")
+        benchTap(opt, results);
+    if (opt.suite.empty() || opt.suite == "threads")
+        same = benchThreads(opt, results) && same;
+    printResults(opt, results);
+    return same ? 0 : 1;
+}
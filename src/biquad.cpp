@@ -0,0 +1,256 @@
+#include "biquad.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "lanes.h"
+
+#define BIQUAD_PI 3.14159265358979323846
+
+// Normalize by a0 and round to float.
+static BiquadCoeffs normalized(double b0, double b1, double b2, double a0, double a1, double a2) {
+    BiquadCoeffs k;
+    k.b0 = (float)(b0 / a0);
+    k.b1 = (float)(b1 / a0);
+    k.b2 = (float)(b2 / a0);
+    k.a1 = (float)(a1 / a0);
+    k.a2 = (float)(a2 / a0);
+    return k;
+}
+
+// Angular frequency of freq in radians per sample, kept below Nyquist.
+static double omega(double freq, int sampleRate) {
+    return 2 * BIQUAD_PI * std::min(std::max(freq, 0.0), 0.49 * sampleRate) / sampleRate;
+}
+
+BiquadCoeffs BiquadCoeffs::identity() {
+    return normalized(1, 0, 0, 1, 0, 0);
+}
+
+BiquadCoeffs BiquadCoeffs::lowPass(double freq, double q, int sampleRate) {
+    double w = omega(freq, sampleRate);
+    double alpha = sin(w) / (2 * q);
+    double c = cos(w);
+    return normalized((1 - c) / 2, 1 - c, (1 - c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+BiquadCoeffs BiquadCoeffs::highPass(double freq, double q, int sampleRate) {
+    double w = omega(freq, sampleRate);
+    double alpha = sin(w) / (2 * q);
+    double c = cos(w);
+    return normalized((1 + c) / 2, -(1 + c), (1 + c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+BiquadCoeffs BiquadCoeffs::bandPass(double freq, double q, int sampleRate) {
+    double w = omega(freq, sampleRate);
+    double alpha = sin(w) / (2 * q);
+    double c = cos(w);
+    return normalized(alpha, 0, -alpha, 1 + alpha, -2 * c, 1 - alpha);
+}
+
+BiquadCoeffs BiquadCoeffs::lowShelf(double freq, double gainDb, int sampleRate) {
+    double A = pow(10, gainDb / 40);
+    double w = omega(freq, sampleRate);
+    double c = cos(w);
+    // Shelf slope 1.
+    double beta = sqrt(A) * sin(w) * sqrt(2.0);
+    return normalized(A * ((A + 1) - (A - 1) * c + beta),
+                      2 * A * ((A - 1) - (A + 1) * c),
+                      A * ((A + 1) - (A - 1) * c - beta),
+                      (A + 1) + (A - 1) * c + beta,
+                      -2 * ((A - 1) + (A + 1) * c),
+                      (A + 1) + (A - 1) * c - beta);
+}
+
+BiquadCoeffs BiquadCoeffs::highShelf(double freq, double gainDb, int sampleRate) {
+    double A = pow(10, gainDb / 40);
+    double w = omega(freq, sampleRate);
+    double c = cos(w);
+    // Shelf slope 1.
+    double beta = sqrt(A) * sin(w) * sqrt(2.0);
+    return normalized(A * ((A + 1) + (A - 1) * c + beta),
+                      -2 * A * ((A - 1) + (A + 1) * c),
+                      A * ((A + 1) + (A - 1) * c - beta),
+                      (A + 1) - (A - 1) * c + beta,
+                      2 * ((A - 1) - (A + 1) * c),
+                      (A + 1) - (A - 1) * c - beta);
+}
+
+BiquadCoeffs BiquadCoeffs::peaking(double freq, double q, double gainDb, int sampleRate) {
+    double A = pow(10, gainDb / 40);
+    double w = omega(freq, sampleRate);
+    double alpha = sin(w) / (2 * q);
+    double c = cos(w);
+    return normalized(1 + alpha * A, -2 * c, 1 - alpha * A, 1 + alpha / A, -2 * c, 1 - alpha / A);
+}
+
+
+// Input of the unused lanes (BiquadCascade::BLOCK_LEN samples).
+static const float kZeros[1024] = {0};
+
+// Run the sections coeffs[0..count) over n samples of channels x[0..w) into
+// y[0..w), side by side in W lanes.
+// The arithmetic is the same as SimdKernels::biquadPipeline.
+// frames: scratch of (W + 1) * n samples.
+// states: state of each channel (s1 and s2 of every section).
+template <int W>
+static void cascadeLanes(const float* coeffs, int count, const float* const* x, float* const* y,
+                         int w, size_t n, float* frames, float* const* states) {
+    const int L = SimdKernels::PIPELINE_LANES;
+    const float* xs[W];
+    float* ys[W];
+    lanePointers<W>(x, w, kZeros, xs);
+    lanePointers<W>(y, w, frames + W * n, ys);
+
+    // A single channel is filtered in place.
+    const float* in = W == 1 ? xs[0] : frames;
+    float* out = W == 1 ? ys[0] : frames;
+    if (W > 1)
+        simdKernels().interleave(frames, xs, W, n);
+
+    // Section after section over the whole block, so the state of a section
+    // stays in registers.
+    for (int k = 0; k < count; k++) {
+        float b0 = coeffs[k], b1 = coeffs[L + k], b2 = coeffs[2 * L + k];
+        float a1 = coeffs[3 * L + k], a2 = coeffs[4 * L + k];
+        float s1[W] = {0}, s2[W] = {0};
+        for (int l = 0; l < w; l++) {
+            s1[l] = states[l][k];
+            s2[l] = states[l][L + k];
+        }
+        for (size_t i = 0; i < n; i++) {
+            for (int l = 0; l < W; l++) {
+                float v = in[i * W + l];
+                float o = b0 * v + s1[l];
+                s1[l] = (b1 * v + s2[l]) - a1 * o;
+                s2[l] = b2 * v - a2 * o;
+                out[i * W + l] = o;
+            }
+        }
+        for (int l = 0; l < w; l++) {
+            states[l][k] = s1[l];
+            states[l][L + k] = s2[l];
+        }
+        in = out;
+    }
+    if (W > 1)
+        simdKernels().deinterleave(ys, frames, W, n);
+}
+
+
+BiquadCascade::BiquadCascade()
+        : m_channels(0),
+          m_count(0) {
+    setSections(NULL, 0);
+    setChannels(1);
+}
+
+void BiquadCascade::setChannels(int channels) {
+    if (channels != m_channels) {
+        m_channels = channels;
+        m_state.reset(new float[m_channels * STATE_LEN]);
+        // Pipeline input and output, or the frames of the channel lanes.
+        size_t pipelineLen = 2 * (BLOCK_LEN + LANES);
+        size_t framesLen = (CHANNEL_LANES + 1) * BLOCK_LEN;
+        m_scratch.reset(new float[std::max(pipelineLen, framesLen)]);
+    }
+    reset();
+}
+
+void BiquadCascade::setSections(const BiquadCoeffs *sections, int count) {
+    count = std::min(std::max(count, 0), (int)MAX_SECTIONS);
+    for (int k = 0; k < LANES; k++) {
+        BiquadCoeffs c = k < count ? sections[k] : BiquadCoeffs::identity();
+        m_coeffs[k] = c.b0;
+        m_coeffs[LANES + k] = c.b1;
+        m_coeffs[2 * LANES + k] = c.b2;
+        m_coeffs[3 * LANES + k] = c.a1;
+        m_coeffs[4 * LANES + k] = c.a2;
+    }
+    if (count != m_count) {
+        m_count = count;
+        reset();
+    }
+}
+
+void BiquadCascade::reset() {
+    if (m_state)
+        memset(m_state.get(), 0, sizeof(float) * m_channels * STATE_LEN);
+}
+
+size_t BiquadCascade::decayLength(double ratio) const {
+    size_t length = 0;
+    for (int k = 0; k < m_count; k++) {
+        // Poles of z^2 + a1 z + a2: a complex pair has a magnitude of
+        // sqrt(a2), real ones are apart by sqrt(d).
+        double a1 = m_coeffs[3 * LANES + k];
+        double a2 = m_coeffs[4 * LANES + k];
+        double d = a1 * a1 - 4 * a2;
+        double radius = d < 0 ? sqrt(a2) : (fabs(a1) + sqrt(d)) / 2;
+        if (radius > 0)
+            length += (size_t)ceil(log(ratio) / log(std::min(radius, 0.99999)));
+    }
+    return length;
+}
+
+void BiquadCascade::process(const float* const* x, float* const* y, size_t n) {
+    if (m_count == 0) {
+        for (int ch = 0; ch < m_channels; ch++) {
+            if (y[ch] != x[ch])
+                memcpy(y[ch], x[ch], sizeof(float) * n);
+        }
+        return;
+    }
+
+    // A single section gains nothing from the pipeline, and four channels
+    // fill the vector lanes by themselves.
+    bool pipelined = m_count > 1 && m_channels < 4;
+
+    for (size_t pos = 0; pos < n; pos += BLOCK_LEN) {
+        size_t len = std::min(n - pos, (size_t)BLOCK_LEN);
+        if (pipelined) {
+            for (int ch = 0; ch < m_channels; ch++)
+                pipeline(x[ch] + pos, y[ch] + pos, m_state.get() + ch * STATE_LEN, len);
+            continue;
+        }
+        for (int c0 = 0; c0 < m_channels; c0 += CHANNEL_LANES) {
+            int w = std::min((int)CHANNEL_LANES, m_channels - c0);
+            const float* xs[CHANNEL_LANES];
+            float* ys[CHANNEL_LANES];
+            float* states[CHANNEL_LANES];
+            for (int l = 0; l < w; l++) {
+                xs[l] = x[c0 + l] + pos;
+                ys[l] = y[c0 + l] + pos;
+                states[l] = m_state.get() + (c0 + l) * STATE_LEN;
+            }
+            float* frames = m_scratch.get();
+            switch (laneWidth(w)) {
+                case 1: cascadeLanes<1>(m_coeffs, m_count, xs, ys, w, len, frames, states); break;
+                case 2: cascadeLanes<2>(m_coeffs, m_count, xs, ys, w, len, frames, states); break;
+                case 4: cascadeLanes<4>(m_coeffs, m_count, xs, ys, w, len, frames, states); break;
+                default: cascadeLanes<CHANNEL_LANES>(m_coeffs, m_count, xs, ys, w, len, frames, states); break;
+            }
+        }
+    }
+}
+
+void BiquadCascade::pipeline(const float* x, float* y, float* state, size_t n) {
+    // The last lane outputs a sample LANES - 1 steps after the first lane
+    // took it in, so the pipeline holds the end of the previous block and
+    // its first LANES - 1 outputs belong to that block. To output the end of
+    // this block, a copy of the state is run on LANES - 1 more steps of zeros
+    // (only the lanes still holding this block matter), and the state itself
+    // carries on from where the input ends.
+    float* in = m_scratch.get();
+    float* out = in + BLOCK_LEN + LANES;
+    memcpy(in, x, sizeof(float) * n);
+    memset(in + n, 0, sizeof(float) * (LANES - 1));
+
+    simdKernels().biquadPipeline(out, in, m_coeffs, state, n);
+    float drain[STATE_LEN];
+    memcpy(drain, state, sizeof(drain));
+    simdKernels().biquadPipeline(out + n, in + n, m_coeffs, drain, LANES - 1);
+
+    memcpy(y, out + LANES - 1, sizeof(float) * n);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "simdkernels.h"
+
+// Coefficients of a biquad section, normalized so that a0 = 1:
+// H(z) = (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2)
+// The designs are those of the Audio EQ Cookbook (R. Bristow-Johnson),
+// computed once in double precision. Frequencies are in Hz and are kept
+// below the Nyquist frequency of sampleRate.
+struct BiquadCoeffs {
+    float b0, b1, b2, a1, a2;
+
+    // Passes the input through unchanged.
+    static BiquadCoeffs identity();
+
+    // Low-pass and high-pass with cut-off freq (q = 0.7071 for Butterworth).
+    static BiquadCoeffs lowPass(double freq, double q, int sampleRate);
+    static BiquadCoeffs highPass(double freq, double q, int sampleRate);
+
+    // Band-pass centred on freq, with a gain of 0 dB there.
+    static BiquadCoeffs bandPass(double freq, double q, int sampleRate);
+
+    // Shelves (slope 1) boosting or cutting by gainDb below or above freq.
+    static BiquadCoeffs lowShelf(double freq, double gainDb, int sampleRate);
+    static BiquadCoeffs highShelf(double freq, double gainDb, int sampleRate);
+
+    // Peaking EQ boosting or cutting by gainDb around freq.
+    static BiquadCoeffs peaking(double freq, double q, double gainDb, int sampleRate);
+};
+
+// BiquadCascade
+//
+// Up to MAX_SECTIONS biquad sections in series, applied to every channel of a
+// stream, each channel with its own state. The sections run in transposed
+// direct form II, which is well conditioned in float and lets the
+// coefficients change while streaming. One to three channels run all the
+// sections at once, as a pipeline across vector lanes (see
+// SimdKernels::biquadPipeline), so a cascade costs about as much as a single
+// section. More channels run side by side in vector lanes instead, section
+// after section. Both give the same output.
+class BiquadCascade {
+    public:
+        // Maximum number of sections.
+        enum { MAX_SECTIONS = SimdKernels::PIPELINE_LANES };
+
+        // Constructor. One channel, no sections (the output is the input).
+        BiquadCascade();
+
+        // Set the number of channels and reset the state.
+        // Allocates, so call it before streaming.
+        void setChannels(int channels);
+
+        // Set the sections (count <= MAX_SECTIONS). The state is kept if the
+        // number of sections stays the same, so gains and frequencies can be
+        // changed between blocks on the audio thread.
+        void setSections(const BiquadCoeffs *sections, int count);
+
+        // Clear the state of every channel.
+        void reset();
+
+        // Returns the number of samples it takes the output to decay by ratio
+        // (< 1) once the input stops: the sum over the sections of the decay
+        // of their slowest pole.
+        size_t decayLength(double ratio) const;
+
+        // Filter n samples of every channel.
+        // x: input samples of each channel
+        // y: output samples of each channel (can be the same buffers as x)
+        void process(const float* const* x, float* const* y, size_t n);
+
+    private:
+        enum {
+            LANES = SimdKernels::PIPELINE_LANES,
+            // Samples filtered per call of the kernels.
+            BLOCK_LEN = 1024,
+            // State of a channel: s1, s2 and the last output of every section.
+            STATE_LEN = 3 * LANES,
+            // Channels run side by side by the cascade (see lanes.h).
+            CHANNEL_LANES = 8
+        };
+
+        // Filter up to BLOCK_LEN samples of one channel through the pipeline.
+        void pipeline(const float* x, float* y, float* state, size_t n);
+
+        int m_channels;
+        int m_count;
+
+        // b0, b1, b2, a1 and a2 of every section, the unused ones pass
+        // their input through (see SimdKernels::biquadPipeline).
+        float m_coeffs[5 * LANES];
+
+        // State of every channel (STATE_LEN floats each).
+        std::unique_ptr<float[]> m_state;
+
+        // Scratch: input and output of the pipeline, or the frames of the
+        // channels run side by side.
+        std::unique_ptr<float[]> m_scratch;
+};
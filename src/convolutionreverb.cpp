@@ -0,0 +1,324 @@
+#include "convolutionreverb.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "simdkernels.h"
+#include "wavfile.h"
+
+ImpulseResponse::ImpulseResponse(int channels, size_t length, int sampleRate) :
+    m_channels(channels),
+    m_length(length),
+    m_sampleRate(sampleRate),
+    m_samples(channels * length, 0.0f)
+{
+}
+
+std::shared_ptr<const ImpulseResponse> ImpulseResponse::load(const char *path) {
+    WavFile file;
+    if (!file.openRead(path))
+        return NULL;
+    if (file.frames() == 0) {
+        fprintf(stderr, "%s has no samples\n", path);
+        return NULL;
+    }
+
+    int channels = file.channels();
+    std::shared_ptr<ImpulseResponse> ir(new ImpulseResponse(channels, file.frames(), file.sampleRate()));
+    for (size_t i = 0; i < file.frames(); i++)
+        for (int ch = 0; ch < channels; ch++) {
+            float v;
+            if (file.format() == WAV_INT16)
+                v = ((const int16_t*)file.data())[i * channels + ch] * (1.0f / 32768);
+            else
+                v = ((const float*)file.data())[i * channels + ch];
+            ir->m_samples[ch * ir->m_length + i] = v;
+        }
+    ir->normalize();
+    return ir;
+}
+
+std::shared_ptr<const ImpulseResponse> ImpulseResponse::synthetic(double seconds, int sampleRate,
+                                                                  int channels) {
+    size_t length = std::max((size_t)(seconds * sampleRate), (size_t)1);
+    std::shared_ptr<ImpulseResponse> ir(new ImpulseResponse(channels, length, sampleRate));
+
+    // Amplitude falls by 1000 (60 dB) over length samples.
+    double decay = exp(log(1e-3) / length);
+    for (int ch = 0; ch < channels; ch++) {
+        uint32_t seed = 0x9e3779b9u * (ch + 1);
+        double gain = 1;
+        float *s = ir->m_samples.data() + ch * length;
+        for (size_t i = 0; i < length; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            s[i] = (float)(gain * ((int32_t)seed * (1.0 / 2147483648.0)));
+            gain *= decay;
+        }
+    }
+    ir->normalize();
+    return ir;
+}
+
+void ImpulseResponse::normalize() {
+    double energy = 0;
+    for (int ch = 0; ch < m_channels; ch++) {
+        double e = 0;
+        for (size_t i = 0; i < m_length; i++)
+            e += (double)m_samples[ch * m_length + i] * m_samples[ch * m_length + i];
+        energy = std::max(energy, e);
+    }
+    if (energy > 0) {
+        float gain = (float)(1 / sqrt(energy));
+        for (float &v : m_samples)
+            v *= gain;
+    }
+}
+
+void ConvolutionReverb::Stage::initialize(const std::vector<float> &ir, int irChannels, size_t irLength,
+                                          size_t begin, size_t end, size_t partitionLen, int channels) {
+    len = partitionLen;
+    count = std::max((end - begin + len - 1) / len, (size_t)1);
+    fft.setSize(2 * len);
+    size_t bins = fft.bins();
+
+    irRe.reset(new float[irChannels * count * bins]);
+    irIm.reset(new float[irChannels * count * bins]);
+    std::vector<float> partition(2 * len);
+    for (int ch = 0; ch < irChannels; ch++)
+        for (size_t p = 0; p < count; p++) {
+            // Partition in the first half, zeros in the second.
+            std::fill(partition.begin(), partition.end(), 0.0f);
+            for (size_t i = 0; i < len && begin + p * len + i < end; i++)
+                partition[i] = ir[ch * irLength + begin + p * len + i];
+            size_t offset = (ch * count + p) * bins;
+            fft.forward(partition.data(), irRe.get() + offset, irIm.get() + offset);
+        }
+
+    inRe.reset(new float[channels * count * bins]());
+    inIm.reset(new float[channels * count * bins]());
+    next = 0;
+    window.reset(new float[channels * 2 * len]());
+    accRe.reset(new float[bins]);
+    accIm.reset(new float[bins]);
+    time.reset(new float[2 * len]);
+}
+
+void ConvolutionReverb::Stage::filter(int ch, int irCh, const float *in, float *out) {
+    size_t bins = fft.bins();
+
+    float *w = window.get() + ch * 2 * len;
+    memmove(w, w + len, len * sizeof(float));
+    memcpy(w + len, in, len * sizeof(float));
+    size_t slot = (ch * count + next) * bins;
+    fft.forward(w, inRe.get() + slot, inIm.get() + slot);
+
+    // Partition p of the response times the input window of p blocks ago.
+    memset(accRe.get(), 0, bins * sizeof(float));
+    memset(accIm.get(), 0, bins * sizeof(float));
+    const SimdKernels &k = simdKernels();
+    for (size_t p = 0; p < count; p++) {
+        size_t a = (irCh * count + p) * bins;
+        size_t b = (ch * count + (next + count - p) % count) * bins;
+        k.complexMac(accRe.get(), accIm.get(), irRe.get() + a, irIm.get() + a,
+                     inRe.get() + b, inIm.get() + b, bins);
+    }
+
+    // The first half of the window wraps around, the second half is valid.
+    fft.inverse(accRe.get(), accIm.get(), time.get());
+    memcpy(out, time.get() + len, len * sizeof(float));
+}
+
+ConvolutionReverb::ConvolutionReverb() :
+    m_channels(0),
+    m_irChannels(0),
+    m_length(0),
+    m_headLen(0),
+    m_tailLen(0),
+    m_tailStart(0),
+    m_hasTail(false),
+    m_dry(1.0f),
+    m_wet(0.0f),
+    m_fill(0),
+    m_samples(0),
+    m_available(0),
+    m_claimed(0),
+    m_done(0),
+    m_running(false),
+    m_pollUs(100)
+{
+}
+
+ConvolutionReverb::~ConvolutionReverb() {
+    stop();
+}
+
+size_t ConvolutionReverb::headLength(size_t blockSize) {
+    size_t len = 64;
+    while (len < blockSize && len < 4096)
+        len *= 2;
+    return len;
+}
+
+void ConvolutionReverb::initialize(const ImpulseResponse &ir, int sampleRate, int channels, size_t blockSize) {
+    stop();
+
+    // Resample linearly to the stream rate, keeping the energy.
+    m_irChannels = ir.channels();
+    size_t length = ir.length();
+    std::vector<float> samples;
+    if (ir.sampleRate() == sampleRate) {
+        samples.assign(ir.samples(0), ir.samples(0) + m_irChannels * length);
+    } else {
+        double step = (double)ir.sampleRate() / sampleRate;
+        size_t resampled = std::max((size_t)ceil(length / step), (size_t)1);
+        float gain = (float)sqrt(step);
+        samples.resize(m_irChannels * resampled);
+        for (int ch = 0; ch < m_irChannels; ch++) {
+            const float *s = ir.samples(ch);
+            for (size_t i = 0; i < resampled; i++) {
+                double pos = i * step;
+                size_t i0 = (size_t)pos;
+                float frac = (float)(pos - i0);
+                float s0 = i0 < length ? s[i0] : 0.0f;
+                float s1 = i0 + 1 < length ? s[i0 + 1] : 0.0f;
+                samples[ch * resampled + i] = gain * (s0 + frac * (s1 - s0));
+            }
+        }
+        length = resampled;
+    }
+
+    m_channels = channels;
+    m_length = length;
+    m_headLen = headLength(blockSize);
+    m_tailLen = std::min(std::max(16 * m_headLen, (size_t)1024), (size_t)16384);
+    m_tailStart = 2 * m_tailLen;
+    m_hasTail = length > m_tailStart;
+
+    m_head.initialize(samples, m_irChannels, length, 0, std::min(length, m_tailStart), m_headLen, channels);
+    m_headIn.reset(new float[channels * m_headLen]());
+    m_headOut.reset(new float[channels * m_headLen]());
+    m_fill = 0;
+    m_samples = 0;
+
+    m_available = 0;
+    m_claimed = 0;
+    m_done = 0;
+    if (m_hasTail) {
+        m_tail.initialize(samples, m_irChannels, length, m_tailStart, length, m_tailLen, channels);
+        m_tailIn.reset(new float[channels * SLOTS * m_tailLen]());
+        m_tailOut.reset(new float[channels * SLOTS * m_tailLen]());
+        m_pollUs = std::max(100u, (unsigned)(250000.0 * m_tailLen / sampleRate));
+        m_running = true;
+        m_worker = std::thread(&ConvolutionReverb::tailLoop, this);
+    }
+}
+
+void ConvolutionReverb::setMix(float mix) {
+    m_dry = 1.0f - mix;
+    m_wet = mix;
+}
+
+void ConvolutionReverb::process(const float* const* x, float* const* y, size_t n) {
+    if (m_channels == 0)
+        return;
+
+    size_t done = 0;
+    while (done < n) {
+        size_t k = std::min(n - done, m_headLen - m_fill);
+        for (int ch = 0; ch < m_channels; ch++) {
+            // Input first, y can be x.
+            memcpy(m_headIn.get() + ch * m_headLen + m_fill, x[ch] + done, k * sizeof(float));
+            memcpy(y[ch] + done, m_headOut.get() + ch * m_headLen + m_fill, k * sizeof(float));
+        }
+        m_fill += k;
+        done += k;
+        if (m_fill == m_headLen) {
+            headBlock();
+            m_fill = 0;
+        }
+    }
+}
+
+void ConvolutionReverb::headBlock() {
+    const SimdKernels &k = simdKernels();
+    uint64_t start = m_samples;
+    m_samples += m_headLen;
+
+    if (m_hasTail) {
+        size_t offset = (start / m_tailLen % SLOTS) * m_tailLen + start % m_tailLen;
+        for (int ch = 0; ch < m_channels; ch++)
+            memcpy(m_tailIn.get() + ch * SLOTS * m_tailLen + offset,
+                   m_headIn.get() + ch * m_headLen, m_headLen * sizeof(float));
+        if (m_samples % m_tailLen == 0)
+            m_available.store(m_samples / m_tailLen, std::memory_order_release);
+    }
+
+    for (int ch = 0; ch < m_channels; ch++)
+        m_head.filter(ch, ch % m_irChannels, m_headIn.get() + ch * m_headLen, m_headOut.get() + ch * m_headLen);
+    m_head.advance();
+
+    // Tail block j holds the output from m_tailStart + j * m_tailLen on. Its
+    // input ended m_tailStart - m_tailLen samples before start.
+    if (m_hasTail && start >= m_tailStart) {
+        uint64_t j = (start - m_tailStart) / m_tailLen;
+        size_t offset = (j % SLOTS) * m_tailLen + (start - m_tailStart) % m_tailLen;
+        waitTail(j);
+        for (int ch = 0; ch < m_channels; ch++) {
+            float *out = m_headOut.get() + ch * m_headLen;
+            k.mix2(out, out, m_tailOut.get() + ch * SLOTS * m_tailLen + offset, 1.0f, 1.0f, 1.0f, m_headLen);
+        }
+    }
+
+    for (int ch = 0; ch < m_channels; ch++) {
+        float *out = m_headOut.get() + ch * m_headLen;
+        k.mix2(out, m_headIn.get() + ch * m_headLen, out, m_dry, m_wet, 1.0f, m_headLen);
+    }
+}
+
+void ConvolutionReverb::tailBlock(uint64_t j) {
+    size_t offset = (j % SLOTS) * m_tailLen;
+    for (int ch = 0; ch < m_channels; ch++)
+        m_tail.filter(ch, ch % m_irChannels, m_tailIn.get() + ch * SLOTS * m_tailLen + offset,
+                      m_tailOut.get() + ch * SLOTS * m_tailLen + offset);
+    m_tail.advance();
+}
+
+void ConvolutionReverb::waitTail(uint64_t j) {
+    // Blocks before j are done, so j is claimed by the background thread
+    // already or free to compute here.
+    while (m_done.load(std::memory_order_acquire) <= j) {
+        uint64_t expected = j;
+        if (m_claimed.compare_exchange_strong(expected, j + 1)) {
+            tailBlock(j);
+            m_done.store(j + 1, std::memory_order_release);
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+void ConvolutionReverb::tailLoop() {
+    while (m_running.load(std::memory_order_acquire)) {
+        uint64_t done = m_done.load(std::memory_order_acquire);
+        uint64_t expected = done;
+        if (done < m_available.load(std::memory_order_acquire) &&
+            m_claimed.compare_exchange_strong(expected, done + 1)) {
+            tailBlock(done);
+            m_done.store(done + 1, std::memory_order_release);
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(m_pollUs));
+        }
+    }
+}
+
+void ConvolutionReverb::stop() {
+    if (m_worker.joinable()) {
+        m_running = false;
+        m_worker.join();
+    }
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "fft.h"
+
+// ImpulseResponse
+//
+// Impulse response of a room for ConvolutionReverb, one or more channels.
+// The samples are scaled so that the channel with the most energy has an
+// energy of 1, which makes the reverb about as loud as the dry signal.
+// Immutable once made, so the processors of a stream can share it.
+class ImpulseResponse {
+    public:
+        // Load a WAV file (16 bit PCM or 32 bit float, any number of channels).
+        // Returns NULL and prints the reason on failure.
+        static std::shared_ptr<const ImpulseResponse> load(const char *path);
+
+        // Synthetic room: independent decaying noise on each channel, 60 dB
+        // down after seconds.
+        static std::shared_ptr<const ImpulseResponse> synthetic(double seconds, int sampleRate,
+                                                                int channels = 2);
+
+        // Number of channels.
+        int channels() const { return m_channels; }
+
+        // Number of samples per channel.
+        size_t length() const { return m_length; }
+
+        // Sample rate in Hz.
+        int sampleRate() const { return m_sampleRate; }
+
+        // Samples of channel ch.
+        const float* samples(int ch) const { return m_samples.data() + ch * m_length; }
+
+    private:
+        ImpulseResponse(int channels, size_t length, int sampleRate);
+
+        // Scale the samples to an energy of 1 (see above).
+        void normalize();
+
+        int m_channels;
+        size_t m_length;
+        int m_sampleRate;
+
+        // Samples of each channel, one after the other.
+        std::vector<float> m_samples;
+};
+
+// ConvolutionReverb
+//
+// Convolution of every channel of a stream with an ImpulseResponse (channel
+// ch with channel ch % channels() of the response), mixed with the dry signal.
+//
+// Non-uniformly partitioned overlap-save FFT convolution in two stages:
+// - The head, the first 2 * tail partition samples of the response, in short
+//   partitions of headLength() samples, runs on the audio thread every
+//   headLength() input samples. The output lags the input by headLength()
+//   samples, the latency of the reverb.
+// - The tail, the rest of the response, in long partitions, runs on a
+//   background thread, which has a whole tail partition of time to finish
+//   a block before the audio thread needs it. If it falls behind, the audio
+//   thread computes the block itself (or waits for the one in progress), so
+//   the output is always the same.
+// The cost on the audio thread is one head block per headLength() samples,
+// whatever the length of the response.
+class ConvolutionReverb {
+    public:
+        ConvolutionReverb();
+
+        // Destructor stops the background thread.
+        ~ConvolutionReverb();
+
+        // Returns the head partition length (and latency) in samples used for
+        // blocks of blockSize frames: the next power of two, 64 to 4096.
+        static size_t headLength(size_t blockSize);
+
+        // Set up the partitions of ir for the stream and start the background
+        // thread. ir is resampled if its sample rate differs.
+        // Allocates and computes the spectra of ir, so call it before streaming.
+        // blockSize: frames per block the stream delivers (see headLength()).
+        void initialize(const ImpulseResponse &ir, int sampleRate, int channels, size_t blockSize);
+
+        // Set the share of the reverb in the output (0 dry only, 1 reverb only).
+        void setMix(float mix);
+
+        // Latency in samples.
+        size_t latency() const { return m_headLen; }
+
+        // Length of the impulse response in samples at the stream rate.
+        size_t length() const { return m_length; }
+
+        // Process n samples of each channel.
+        // x: input samples of each channel
+        // y: output samples of each channel, latency() samples late (can be the same buffers as x)
+        void process(const float* const* x, float* const* y, size_t n);
+
+    private:
+        // Tail blocks of input and output buffered between the threads.
+        enum { SLOTS = 4 };
+
+        // Uniformly partitioned overlap-save convolution with one segment of
+        // the response, for every channel.
+        struct Stage {
+            // Partition length and number of partitions.
+            size_t len;
+            size_t count;
+
+            // Transforms of 2 * len samples.
+            Fft fft;
+
+            // Spectra of the partitions of each channel of the response
+            // (count * fft.bins() each, real and imaginary parts).
+            std::unique_ptr<float[]> irRe, irIm;
+
+            // Spectra of the last count input windows of each channel, a ring
+            // whose newest slot is next - 1.
+            std::unique_ptr<float[]> inRe, inIm;
+            size_t next;
+
+            // Last 2 * len input samples of each channel.
+            std::unique_ptr<float[]> window;
+
+            // Sum of the products of the spectra, and its inverse transform.
+            std::unique_ptr<float[]> accRe, accIm;
+            std::unique_ptr<float[]> time;
+
+            // Set up the partitions of samples [begin, end) of the response.
+            void initialize(const std::vector<float> &ir, int irChannels, size_t irLength,
+                            size_t begin, size_t end, size_t partitionLen, int channels);
+
+            // Filter len input samples of channel ch with channel irCh of the
+            // response into len output samples.
+            void filter(int ch, int irCh, const float *in, float *out);
+
+            // Move on to the next block, once every channel is filtered.
+            void advance() { next = (next + 1) % count; }
+        };
+
+        // Filter the full block of head input of every channel.
+        void headBlock();
+
+        // Filter tail block j of every channel.
+        void tailBlock(uint64_t j);
+
+        // Audio thread: make sure tail block j is done.
+        void waitTail(uint64_t j);
+
+        // Background thread: filter tail blocks as their input arrives.
+        void tailLoop();
+
+        // Stop the background thread.
+        void stop();
+
+        int m_channels;
+        int m_irChannels;
+
+        // Length of the response, head and tail partition lengths, and where
+        // the tail starts in the response.
+        size_t m_length;
+        size_t m_headLen;
+        size_t m_tailLen;
+        size_t m_tailStart;
+        bool m_hasTail;
+
+        Stage m_head;
+        Stage m_tail;
+
+        // Gains of the dry signal and of the reverb.
+        float m_dry;
+        float m_wet;
+
+        // Head block of input being filled and of output being played, of each
+        // channel (m_headLen samples each), and the position in them.
+        std::unique_ptr<float[]> m_headIn;
+        std::unique_ptr<float[]> m_headOut;
+        size_t m_fill;
+
+        // Input samples of each channel taken in by whole head blocks.
+        uint64_t m_samples;
+
+        // Rings of SLOTS tail blocks of input and output of each channel.
+        std::unique_ptr<float[]> m_tailIn;
+        std::unique_ptr<float[]> m_tailOut;
+
+        // Tail blocks whose input is complete, claimed by a thread and done.
+        // A block is only claimed once the one before is done.
+        std::atomic<uint64_t> m_available;
+        std::atomic<uint64_t> m_claimed;
+        std::atomic<uint64_t> m_done;
+
+        // Background thread, and how long it sleeps when there is nothing to do.
+        std::thread m_worker;
+        std::atomic<bool> m_running;
+        unsigned m_pollUs;
+};
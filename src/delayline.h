@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <string.h>
+
+// DelayLine
+//
+// Ring buffer holding the most recent samples of a signal, in storage owned by
+// the caller (see attach()). The ring length is a power of two, so positions
+// wrap with a mask instead of a division. The first SPAN samples of the ring
+// are mirrored right after its end, so the SPAN samples starting at any
+// position are one contiguous span of memory and can be read with plain
+// vector loads.
+//
+// Samples are copied in at the write position with write() and then
+// committed with advance(), or added one at a time with push(). An
+// unattached delay line holds no history and ignores writes.
+// T: sample type.
+// SPAN: maximum number of samples written or read in one go.
+template <typename T, size_t SPAN>
+class DelayLine {
+    public:
+        DelayLine() : m_buf(NULL), m_length(0), m_pos(0) {}
+
+        // Number of elements of storage needed to keep history samples of
+        // history (0 if history is 0).
+        static size_t storageSize(size_t history) {
+            if (history == 0)
+                return 0;
+            size_t length = 2 * SPAN;
+            while (length < history + SPAN)
+                length *= 2;
+            return length + SPAN;
+        }
+
+        // Use storage of storageSize(history) elements to keep history samples
+        // of history. The storage is zeroed and the write position reset.
+        void attach(T *storage, size_t history) {
+            size_t size = storageSize(history);
+            m_buf = size > 0 ? storage : NULL;
+            m_length = size > 0 ? size - SPAN : 0;
+            clear();
+        }
+
+        // Zero the history and reset the write position.
+        void clear() {
+            m_pos = 0;
+            if (m_buf != NULL)
+                memset(m_buf, 0, sizeof(T) * (m_length + SPAN));
+        }
+
+        // Copy n (<= SPAN) samples to the write position, without advancing it.
+        void write(const T *x, size_t n) {
+            if (m_buf == NULL)
+                return;
+            memcpy(&m_buf[m_pos], x, sizeof(T) * n);
+            if (m_pos + n > m_length) {
+                // Wrapped past the end: copy the mirror back to the ring start.
+                memcpy(&m_buf[0], &m_buf[m_length], sizeof(T) * (m_pos + n - m_length));
+            }
+            if (m_pos < SPAN) {
+                // Written at the ring start: copy it to the mirror.
+                size_t end = m_pos + n < SPAN ? m_pos + n : SPAN;
+                memcpy(&m_buf[m_length + m_pos], &m_buf[m_pos], sizeof(T) * (end - m_pos));
+            }
+        }
+
+        // Pointer to SPAN contiguous samples starting d samples before the write
+        // position (d <= the history passed to attach()).
+        const T* span(size_t d) const { return &m_buf[(m_pos - d) & (m_length - 1)]; }
+
+        // Sample d samples before the write position (d <= the history passed to attach()).
+        T tap(size_t d) const { return m_buf[(m_pos - d) & (m_length - 1)]; }
+
+        // Append one sample and move the write position past it.
+        // The delay line must be attached.
+        void push(T x) {
+            m_buf[m_pos] = x;
+            if (m_pos < SPAN)
+                m_buf[m_length + m_pos] = x;
+            m_pos = (m_pos + 1) & (m_length - 1);
+        }
+
+        // Move the write position past n (<= SPAN) samples.
+        void advance(size_t n) {
+            if (m_buf != NULL)
+                m_pos = (m_pos + n) & (m_length - 1);
+        }
+
+    private:
+        // Ring followed by the mirror of its first SPAN samples, NULL if unattached.
+        T *m_buf;
+
+        // Ring length (power of two >= 2 * SPAN), 0 if unattached.
+        size_t m_length;
+
+        // Write position.
+        size_t m_pos;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+// Denormal (subnormal) floats.
+//
+// The feedback effects (IIR Echo, Natural Echo, Reverb and the biquads of
+// Filter Out and Equalizer) decay toward zero once their input goes quiet,
+// and their tails end up in subnormal floats, which most CPUs process an
+// order of magnitude slower (on x86 every operation on one takes a microcode
+// assist). Two ways around it:
+// - ScopedFlushDenormals sets the floating point unit of the calling thread
+//   to flush subnormal results and inputs to zero, where the CPU can
+//   (SSE math on x86, AArch64);
+// - elsewhere the effects add kAntiDenormal to their feedback paths (see
+//   SoundProcessor::setAntiDenormal()), which keeps the tails far above the
+//   subnormal range.
+
+#include <cstdint>
+
+#if defined(__SSE_MATH__)
+#include <xmmintrin.h>
+#define HAVE_FLUSH_DENORMALS 1
+#elif defined(__aarch64__)
+#define HAVE_FLUSH_DENORMALS 1
+#endif
+
+// Bias added to the feedback of the effects: a constant offset some 400 dB
+// below full scale (of either 16 bit or float samples), well above the
+// smallest normal float (1.2e-38) after any decay.
+const float kAntiDenormal = 1e-20f;
+
+// Returns true if ScopedFlushDenormals can flush subnormals on this CPU.
+inline bool canFlushDenormals() {
+#ifdef HAVE_FLUSH_DENORMALS
+    return true;
+#else
+    return false;
+#endif
+}
+
+// ScopedFlushDenormals
+//
+// Sets flush-to-zero and denormals-are-zero on the calling thread for its
+// lifetime, and restores the previous mode when it goes out of scope. Cheap
+// enough for every block of an audio callback. Does nothing where
+// canFlushDenormals() is false.
+class ScopedFlushDenormals {
+    public:
+        // enable: false leaves the mode alone, e.g. when the option is off.
+        explicit ScopedFlushDenormals(bool enable = true) : m_enabled(enable), m_saved(0) {
+            if (!m_enabled)
+                return;
+#if defined(__SSE_MATH__)
+            // FTZ (bit 15) and DAZ (bit 6) of MXCSR.
+            m_saved = _mm_getcsr();
+            _mm_setcsr((unsigned int)m_saved | 0x8040);
+#elif defined(__aarch64__)
+            // FZ (bit 24) of FPCR, which flushes inputs and results.
+            __asm__ __volatile__("mrs %0, fpcr" : "=r"(m_saved));
+            __asm__ __volatile__("msr fpcr, %0" : : "r"(m_saved | (1 << 24)));
+#endif
+        }
+
+        ~ScopedFlushDenormals() {
+            if (!m_enabled)
+                return;
+#if defined(__SSE_MATH__)
+            _mm_setcsr((unsigned int)m_saved);
+#elif defined(__aarch64__)
+            __asm__ __volatile__("msr fpcr, %0" : : "r"(m_saved));
+#endif
+        }
+
+    private:
+        bool m_enabled;
+
+        // Mode of the thread before, to restore.
+        uint64_t m_saved;
+};
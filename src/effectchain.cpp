@@ -0,0 +1,29 @@
+#include "effectchain.h"
+
+#include <string.h>
+
+void RuntimeEffectChain::initialize(int sampleRate) {
+    m_sampleRate = sampleRate;
+    for (auto &stage : m_stages)
+        stage->initialize(sampleRate);
+}
+
+void RuntimeEffectChain::add(int idxF, const EffectParams &params) {
+    std::unique_ptr<SoundProcessor> stage(new SoundProcessor());
+    stage->initialize(m_sampleRate);
+    stage->setParams(params);
+    stage->setFunction(idxF);
+    m_stages.push_back(std::move(stage));
+}
+
+void RuntimeEffectChain::processBlock(const float* in, float* out, size_t n) {
+    if (m_stages.empty()) {
+        if (out != in)
+            memcpy(out, in, sizeof(float) * n);
+        return;
+    }
+    // The first stage reads the input, the rest work in place on the output.
+    m_stages[0]->processBlock(in, out, n);
+    for (size_t i = 1; i < m_stages.size(); i++)
+        m_stages[i]->processBlock(out, out, n);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <string.h>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "effects.h"
+#include "soundprocessor.h"
+
+// EffectChain
+//
+// Chain of effects fixed at compile time, e.g. EffectChain<BiQuad, Fuzz, Flanger, Reverb>.
+// All the stages (see effects.h) are inlined into one loop per block, so each
+// sample goes through the whole chain in registers without any dispatch or
+// intermediate buffers.
+template <typename... Stages>
+class EffectChain {
+    public:
+        // Initialize every stage for the sample rate (allocates their history).
+        void initialize(int sampleRate) {
+            initializeStages(sampleRate, std::index_sequence_for<Stages...>());
+        }
+
+        // Process a block of audio samples through all the stages.
+        // in: input audio samples
+        // out: processed audio samples (can be the same buffer as in)
+        // n: number of samples in the block
+        void processBlock(const float* in, float* out, size_t n) {
+            // Samples go through a local buffer: the caller's buffers could
+            // alias the stages' state, which would force it out of registers
+            // on every sample, while this one provably does not.
+            float buf[BUF_LEN];
+            for (size_t pos = 0; pos < n; pos += BUF_LEN) {
+                size_t len = n - pos < BUF_LEN ? n - pos : (size_t)BUF_LEN;
+                memcpy(buf, in + pos, sizeof(float) * len);
+                for (size_t i = 0; i < len; i++)
+                    buf[i] = tick(buf[i], std::index_sequence_for<Stages...>());
+                memcpy(out + pos, buf, sizeof(float) * len);
+            }
+        }
+
+        // Access stage I of the chain.
+        template <size_t I>
+        typename std::tuple_element<I, std::tuple<Stages...>>::type& stage() {
+            return std::get<I>(m_stages);
+        }
+
+    private:
+        // Samples processed per pass through the local buffer.
+        enum { BUF_LEN = 256 };
+
+        template <size_t... I>
+        void initializeStages(int sampleRate, std::index_sequence<I...>) {
+            (std::get<I>(m_stages).initialize(sampleRate), ...);
+        }
+
+        template <size_t... I>
+        float tick(float x, std::index_sequence<I...>) {
+            ((x = std::get<I>(m_stages).tick(x)), ...);
+            return x;
+        }
+
+        std::tuple<Stages...> m_stages;
+};
+
+// RuntimeEffectChain
+//
+// Chain of effects chosen at run time. Each stage is a SoundProcessor and the
+// whole block goes through one stage after the other.
+class RuntimeEffectChain {
+    public:
+        // Initialize or set sample rate of all the stages (default is 44.1kHz).
+        void initialize(int sampleRate);
+
+        // Append a stage.
+        // idxF: Index to the sound effect (see kCoreProcesses).
+        // params: parameters of the stage.
+        void add(int idxF, const EffectParams &params = EffectParams());
+
+        // Remove all the stages.
+        void clear() { m_stages.clear(); }
+
+        // Number of stages.
+        size_t size() const { return m_stages.size(); }
+
+        // Process a block of audio samples through all the stages.
+        // in: input audio samples
+        // out: processed audio samples (can be the same buffer as in)
+        // n: number of samples in the block
+        void processBlock(const float* in, float* out, size_t n);
+
+    private:
+        // Sample rate in Hz.
+        int m_sampleRate = 44100;
+
+        std::vector<std::unique_ptr<SoundProcessor>> m_stages;
+};
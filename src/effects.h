@@ -0,0 +1,261 @@
+#pragma once
+
+// Per-sample forms of the sound effects of SoundProcessor.
+//
+// Each effect is a small class with initialize(sampleRate) and an inline
+// tick(x) that turns one input sample into one output sample. They implement
+// the same models as SoundProcessor (see soundprocessor.cpp for the math) and
+// are meant to be fused into a single loop by EffectChain (effectchain.h).
+// Their parameters are fixed at the defaults of the models and EffectParams
+// does not apply to them: Fuzz hard clips without oversampling, for example,
+// so it matches SoundProcessor with fuzzOversampling set to 1.
+
+#include <math.h>
+#include <cstddef>
+#include <memory>
+
+#include "biquad.h"
+#include "delayline.h"
+#include "lfo.h"
+
+// Effect delays in seconds.
+#define ECHO_DELAY 0.3      // Echo, IirEcho and NaturalEcho
+#define REVERB_DELAY 0.02   // Reverb
+#define FLANGER_DELAY 0.002 // minimum delay of Flanger
+#define FLANGER_DEPTH 2     // maximum delay factor of Flanger
+
+#define EFFECTS_PI 3.14159265359
+
+// Coefficients of Filter Out, a pole and a zero pair:
+// y[n] = norm (x[n] + b_1x[n-1] + b_2x[n-2] - a_1y[n-1] - a_2y[n-2])
+inline BiquadCoeffs filterOutCoeffs() {
+    // Pole (magnitude and phase).
+    const float pm = 0.98f;
+    const float pp = (float)(0.1 * EFFECTS_PI);
+    // Zero (magnitude and phase).
+    const float zm = 0.9f;
+    const float zp = (float)(0.06 * EFFECTS_PI);
+    const float norm = 0.5f;
+
+    BiquadCoeffs k;
+    k.b0 = norm;
+    k.b1 = norm * (-2*zm*cosf(zp));
+    k.b2 = norm * (zm*zm);
+    k.a1 = norm * (-2*pm*cosf(pp));
+    k.a2 = norm * (pm*pm);
+    return k;
+}
+
+// History of one signal for the per-sample effects.
+class SampleHistory {
+    public:
+        // Allocate and zero history samples of history.
+        void initialize(size_t history) {
+            m_storage.reset(new float[Line::storageSize(history)]);
+            m_line.attach(m_storage.get(), history);
+        }
+
+        // Sample d samples ago (1 <= d <= history).
+        float tap(size_t d) const { return m_line.tap(d); }
+
+        // Append the current sample.
+        void push(float x) { m_line.push(x); }
+
+    private:
+        typedef DelayLine<float, 1> Line;
+        std::unique_ptr<float[]> m_storage;
+        Line m_line;
+};
+
+// Oscillator read one value per sample, rendered a block at a time.
+class Modulation {
+    public:
+        // Restart the oscillator at phase 0.
+        void initialize(double rate, int sampleRate) {
+            m_lfo.setRate(rate, sampleRate);
+            m_lfo.reset();
+            m_pos = LEN;
+        }
+
+        // Next value of the oscillator, in [0, 1].
+        float next() {
+            if (m_pos == LEN) {
+                m_lfo.render(m_values, LEN);
+                m_pos = 0;
+            }
+            return m_values[m_pos++];
+        }
+
+    private:
+        enum { LEN = 64 };
+        Lfo m_lfo;
+        float m_values[LEN];
+        size_t m_pos;
+};
+
+// No effect.
+class Pass {
+    public:
+        void initialize(int) {}
+        float tick(float x) { return x; }
+};
+
+// Echo (ideal).
+class Echo {
+    public:
+        void initialize(int sampleRate) {
+            N = (int)(ECHO_DELAY * sampleRate);
+            m_x.initialize(2 * N);
+        }
+        float tick(float x) {
+            float y = norm * (a * x + b * m_x.tap(N) + c * m_x.tap(2*N));
+            m_x.push(x);
+            return y;
+        }
+    private:
+        const float a = 1;
+        const float b = 0.7f;
+        const float c = 0.5f;
+        const float norm = 1.0f / (a+b+c);
+        int N;
+        SampleHistory m_x;
+};
+
+// Echo (ideal with feedback).
+class IirEcho {
+    public:
+        void initialize(int sampleRate) {
+            N = (int)(ECHO_DELAY * sampleRate);
+            m_y.initialize(N);
+        }
+        float tick(float x) {
+            float y = norm * (x + a * m_y.tap(N));
+            m_y.push(y);
+            return y;
+        }
+    private:
+        const float a = 0.7f;
+        const float norm = (1 - a * a);
+        int N;
+        SampleHistory m_y;
+};
+
+// Echo (natural, something closer to what happens in real life).
+class NaturalEcho {
+    public:
+        void initialize(int sampleRate) {
+            N = (int)(ECHO_DELAY * sampleRate);
+            m_y.initialize(N);
+            m_x1 = 0;
+        }
+        float tick(float x) {
+            float y = norm * (
+                        x
+              -     a * m_x1
+              +     a * m_y.tap(1)
+              + (1-a) * m_y.tap(N));
+            m_x1 = x;
+            m_y.push(y);
+            return y;
+        }
+    private:
+        const float a = 0.7f;
+        const float norm = 1.0f / (1+a);
+        int N;
+        float m_x1;
+        SampleHistory m_y;
+};
+
+// Reverberation.
+class Reverb {
+    public:
+        void initialize(int sampleRate) {
+            N = (int)(REVERB_DELAY * sampleRate);
+            m_x.initialize(N);
+            m_y.initialize(N);
+        }
+        float tick(float x) {
+            float y = norm * (
+              - a * x
+              +     m_x.tap(N)
+              + a * m_y.tap(N));
+            m_x.push(x);
+            m_y.push(y);
+            return y;
+        }
+    private:
+        const float a = 0.8f;
+        const float norm = 1.0f;
+        int N;
+        SampleHistory m_x;
+        SampleHistory m_y;
+};
+
+// Filter the input to discard high frequencies.
+// Transposed direct form II, as BiquadCascade.
+class BiQuad {
+    public:
+        void initialize(int) {
+            k = filterOutCoeffs();
+            m_s1 = m_s2 = 0;
+        }
+        float tick(float x) {
+            float y = k.b0 * x + m_s1;
+            m_s1 = (k.b1 * x + m_s2) - k.a1 * y;
+            m_s2 = k.b2 * x - k.a2 * y;
+            return y;
+        }
+    private:
+        BiquadCoeffs k;
+        float m_s1, m_s2;
+};
+
+// Fuzz effect.
+class Fuzz {
+    public:
+        void initialize(int) {}
+        float tick(float x) {
+            if (x > limit)
+                x = limit;
+            if (x < -limit)
+                x = -limit;
+            return G * x;
+        }
+    private:
+        const float T = 0.005f;
+        const float G = 5;
+        const float limit = 32767 * T;
+};
+
+// Flanger effect.
+class Flanger {
+    public:
+        void initialize(int sampleRate) {
+            N = (int)(FLANGER_DELAY * sampleRate);
+            m_depth.initialize(1, sampleRate);  // 1Hz oscillator
+            m_x.initialize(N * FLANGER_DEPTH + 1);
+        }
+        float tick(float x) {
+            int d = (int)(N * FLANGER_DEPTH * m_depth.next());
+            // The delay can be 0, so the current sample goes in first.
+            m_x.push(x);
+            return 0.5f + (x + m_x.tap(d + 1));
+        }
+    private:
+        int N;
+        Modulation m_depth;
+        SampleHistory m_x;
+};
+
+// Tremolo effect.
+class Tremolo {
+    public:
+        void initialize(int sampleRate) {
+            m_gain.initialize(5, sampleRate);  // 5Hz oscillator
+        }
+        float tick(float x) {
+            return m_gain.next() * x;
+        }
+    private:
+        Modulation m_gain;
+};
@@ -0,0 +1,130 @@
+#include "fft.h"
+
+#include <math.h>
+
+#include "simdkernels.h"
+
+#define FFT_TWO_PI 6.28318530717958647692
+
+Fft::Fft()
+        : m_size(0),
+          m_half(0) {
+}
+
+void Fft::setSize(size_t size) {
+    if (size == m_size)
+        return;
+    m_size = size;
+    m_half = size / 2;
+
+    int bits = 0;
+    while (((size_t)1 << bits) < m_half)
+        bits++;
+    m_reverse.reset(new uint32_t[m_half]);
+    for (size_t i = 0; i < m_half; i++) {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; b++)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        m_reverse[i] = r;
+    }
+
+    // Stages with half sizes 1, 2, 4, ... m_half / 2 take m_half - 1 twiddles.
+    m_twiddleRe.reset(new float[m_half]);
+    m_twiddleIm.reset(new float[m_half]);
+    for (size_t h = 1; h < m_half; h *= 2) {
+        for (size_t j = 0; j < h; j++) {
+            m_twiddleRe[h - 1 + j] = (float)cos(FFT_TWO_PI * j / (2 * h));
+            m_twiddleIm[h - 1 + j] = (float)-sin(FFT_TWO_PI * j / (2 * h));
+        }
+    }
+
+    m_splitRe.reset(new float[m_half]);
+    m_splitIm.reset(new float[m_half]);
+    for (size_t k = 0; k < m_half; k++) {
+        m_splitRe[k] = (float)cos(FFT_TWO_PI * k / m_size);
+        m_splitIm[k] = (float)-sin(FFT_TWO_PI * k / m_size);
+    }
+
+    m_re.reset(new float[m_half]);
+    m_im.reset(new float[m_half]);
+}
+
+void Fft::transform(float *re, float *im) {
+    // The first two stages only multiply by 1 and -i: one radix 4 pass.
+    size_t h = 1;
+    if (m_half >= 4) {
+        for (size_t g = 0; g < m_half; g += 4) {
+            float s0r = re[g] + re[g + 1], s0i = im[g] + im[g + 1];
+            float s1r = re[g] - re[g + 1], s1i = im[g] - im[g + 1];
+            float s2r = re[g + 2] + re[g + 3], s2i = im[g + 2] + im[g + 3];
+            float s3r = re[g + 2] - re[g + 3], s3i = im[g + 2] - im[g + 3];
+            re[g] = s0r + s2r;
+            im[g] = s0i + s2i;
+            re[g + 2] = s0r - s2r;
+            im[g + 2] = s0i - s2i;
+            re[g + 1] = s1r + s3i;
+            im[g + 1] = s1i - s3r;
+            re[g + 3] = s1r - s3i;
+            im[g + 3] = s1i + s3r;
+        }
+        h = 4;
+    }
+
+    // The butterflies of a group share nothing, so they run in vector lanes.
+    const SimdKernels &k = simdKernels();
+    for (; h < m_half; h *= 2)
+        k.fftStage(re, im, m_twiddleRe.get() + h - 1, m_twiddleIm.get() + h - 1, h, m_half);
+}
+
+void Fft::forward(const float *x, float *re, float *im) {
+    float *zr = m_re.get(), *zi = m_im.get();
+    const uint32_t *reverse = m_reverse.get();
+    for (size_t n = 0; n < m_half; n++) {
+        zr[reverse[n]] = x[2 * n];
+        zi[reverse[n]] = x[2 * n + 1];
+    }
+    transform(zr, zi);
+
+    // X[k] = E[k] + W^k O[k], with the spectra of the even and odd samples
+    // E[k] = (Z[k] + conj(Z[M-k])) / 2 and O[k] = (Z[k] - conj(Z[M-k])) / 2i.
+    re[0] = zr[0] + zi[0];
+    im[0] = 0;
+    re[m_half] = zr[0] - zi[0];
+    im[m_half] = 0;
+    for (size_t k = 1; k < m_half; k++) {
+        size_t m = m_half - k;
+        float ere = 0.5f * (zr[k] + zr[m]);
+        float eim = 0.5f * (zi[k] - zi[m]);
+        float ore = 0.5f * (zi[k] + zi[m]);
+        float oim = 0.5f * (zr[m] - zr[k]);
+        re[k] = ere + m_splitRe[k] * ore - m_splitIm[k] * oim;
+        im[k] = eim + m_splitRe[k] * oim + m_splitIm[k] * ore;
+    }
+}
+
+void Fft::inverse(const float *re, const float *im, float *x) {
+    float *zr = m_re.get(), *zi = m_im.get();
+    const uint32_t *reverse = m_reverse.get();
+
+    // E[k] = (X[k] + conj(X[M-k])) / 2, O[k] = W^-k (X[k] - conj(X[M-k])) / 2
+    // and Z[k] = E[k] + i O[k]. The imaginary parts are negated on the way,
+    // so the forward transform inverts (conjugated in, conjugated out).
+    for (size_t k = 0; k < m_half; k++) {
+        size_t m = m_half - k;
+        float ere = 0.5f * (re[k] + re[m]);
+        float eim = 0.5f * (im[k] - im[m]);
+        float dre = 0.5f * (re[k] - re[m]);
+        float dim = 0.5f * (im[k] + im[m]);
+        float ore = m_splitRe[k] * dre + m_splitIm[k] * dim;
+        float oim = m_splitRe[k] * dim - m_splitIm[k] * dre;
+        zr[reverse[k]] = ere - oim;
+        zi[reverse[k]] = -(eim + ore);
+    }
+    transform(zr, zi);
+
+    float scale = 1.0f / m_half;
+    for (size_t n = 0; n < m_half; n++) {
+        x[2 * n] = scale * zr[n];
+        x[2 * n + 1] = -scale * zi[n];
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Fft
+//
+// Fast Fourier transform of real signals whose size is a power of two, for
+// the convolution reverb. A real signal of size N is transformed as a complex
+// signal of N/2 points (even samples as real parts, odd samples as imaginary
+// parts) followed by a split into the N/2 + 1 bins of the real spectrum.
+// Spectra are kept as separate arrays of real and imaginary parts, so that
+// multiplying them vectorizes (see SimdKernels::complexMac).
+// Twiddle factors are computed once, in double precision, by setSize().
+class Fft {
+    public:
+        Fft();
+
+        // Set the size of the transforms (power of two, at least 4).
+        // Allocates, so call it before streaming.
+        void setSize(size_t size);
+
+        // Size of the transforms.
+        size_t size() const { return m_size; }
+
+        // Number of bins of a spectrum (size / 2 + 1).
+        size_t bins() const { return m_half + 1; }
+
+        // Spectrum re, im (bins() each) of the size() samples of x.
+        void forward(const float *x, float *re, float *im);
+
+        // Samples x (size() of them) of the spectrum re, im, scaled by
+        // 1 / size() so that inverse(forward(x)) is x again.
+        // re and im are left unchanged.
+        void inverse(const float *re, const float *im, float *x);
+
+    private:
+        // In place complex transform of m_half points given in bit reversed
+        // order (decimation in time: one radix 4 pass, then radix 2 stages
+        // run by SimdKernels::fftStage).
+        void transform(float *re, float *im);
+
+        // Size of the real transforms and of the complex ones.
+        size_t m_size;
+        size_t m_half;
+
+        // Bit reversed index of each of the m_half points, where forward() and
+        // inverse() put them for transform().
+        std::unique_ptr<uint32_t[]> m_reverse;
+
+        // Twiddle factors of each stage of transform(), stage with half size h
+        // at offset h - 1 (cosines, then minus sines).
+        std::unique_ptr<float[]> m_twiddleRe;
+        std::unique_ptr<float[]> m_twiddleIm;
+
+        // exp(-2 pi i k / size) for k < m_half, to split and merge the spectra.
+        std::unique_ptr<float[]> m_splitRe;
+        std::unique_ptr<float[]> m_splitIm;
+
+        // Complex points being transformed.
+        std::unique_ptr<float[]> m_re;
+        std::unique_ptr<float[]> m_im;
+};
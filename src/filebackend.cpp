@@ -0,0 +1,109 @@
+#include "filebackend.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+// Stream sample format of the samples of a WAV file.
+static SampleFormat streamFormat(WavFormat format) {
+    return format == WAV_FLOAT32 ? SAMPLE_FLOAT32 : SAMPLE_INT16;
+}
+
+FileBackend::FileBackend(const char *inPath, const char *outPath)
+        : NullBackend(0),
+          m_inPath(inPath),
+          m_outPath(outPath != NULL ? outPath : ""),
+          m_inFrame(0),
+          m_outFrame(0),
+          m_opened(false) {
+}
+
+FileBackend::~FileBackend() {
+    // The thread of a callback stream calls generate() and consume().
+    close();
+}
+
+bool FileBackend::load() {
+    return m_input.openRead(m_inPath.c_str());
+}
+
+void FileBackend::listDevices() {
+    printf("Devices:\n");
+    printf("0: () %s -> %s --default--\n", m_inPath.c_str(),
+           m_outPath.empty() ? "(discarded)" : m_outPath.c_str());
+}
+
+void FileBackend::printDeviceInfo(unsigned int index) {
+    if (index != 0) {
+        printf("invalid index\n");
+        return;
+    }
+    printf("\nDevice: (0)\n");
+    printf("%s\n", m_inPath.c_str());
+    printf("Input channels: %i\n", m_input.channels());
+    printf("Default sampling rate (Hz): %i\n", m_input.sampleRate());
+    printf("Length (s): %.2f\n", (double)m_input.frames() / std::max(1, m_input.sampleRate()));
+}
+
+bool FileBackend::open(const AudioStreamSettings &settings, AudioCallback callback, void *userData) {
+    if (m_input.data() == NULL) {
+        fprintf(stderr, "%s is not loaded\n", m_inPath.c_str());
+        return false;
+    }
+    if ((int)settings.sampleRate != m_input.sampleRate()) {
+        fprintf(stderr, "%s is %d Hz, the stream runs at %u Hz\n", m_inPath.c_str(),
+                m_input.sampleRate(), settings.sampleRate);
+        return false;
+    }
+    if (!NullBackend::open(settings, callback, userData))
+        return false;
+    m_block.resize((size_t)settings.framesPerBuffer * std::max((int)settings.channels, m_input.channels()));
+
+    // A stream reopened with another block size carries on where it was.
+    if (m_opened)
+        return true;
+    if (!m_outPath.empty() &&
+        !m_output.create(m_outPath.c_str(), m_input.format(), settings.channels, m_input.sampleRate(),
+                         m_input.frames()))
+        return false;
+    m_opened = true;
+    m_inFrame = 0;
+    m_outFrame = 0;
+    return true;
+}
+
+void FileBackend::generate(float *x, unsigned long frames) {
+    unsigned int channels = settings().channels;
+    int fileChannels = m_input.channels();
+    size_t n = std::min((size_t)frames, m_input.frames() - std::min(m_inFrame, m_input.frames()));
+    const uint8_t *data = (const uint8_t*)m_input.data() +
+                          m_inFrame * fileChannels * m_input.bytesPerSample();
+
+    // Spread the channels of the file over the channels of the stream.
+    float *y = m_block.data();
+    samplesToUnit(streamFormat(m_input.format()), y, data, n * fileChannels);
+    for (size_t i = 0; i < n; i++) {
+        for (unsigned int ch = 0; ch < channels; ch++)
+            x[i * channels + ch] = y[i * fileChannels + ch % fileChannels];
+    }
+    memset(x + n * channels, 0, sizeof(float) * (frames - n) * channels);
+    m_inFrame += n;
+}
+
+void FileBackend::consume(const float *x, unsigned long frames) {
+    if (m_output.data() == NULL)
+        return;
+    unsigned int channels = settings().channels;
+    size_t n = std::min((size_t)frames, m_output.frames() - std::min(m_outFrame, m_output.frames()));
+    uint8_t *data = (uint8_t*)m_output.data() + m_outFrame * channels * m_output.bytesPerSample();
+
+    // unitToSamples() scales in place, x belongs to the caller.
+    float *y = m_block.data();
+    memcpy(y, x, sizeof(float) * n * channels);
+    unitToSamples(streamFormat(m_output.format()), data, y, n * channels);
+    m_outFrame += n;
+}
+
+bool FileBackend::finished() {
+    return m_inFrame >= m_input.frames();
+}
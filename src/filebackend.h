@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "nullbackend.h"
+#include "wavfile.h"
+
+// FileBackend
+//
+// Synthetic sound card that plays a WAV file as its input and records its
+// output to another one, in real time on the clock of NullBackend (use
+// OfflineRenderer to render files as fast as possible). Stream channel ch
+// reads file channel ch modulo the channels of the file, so a mono file
+// feeds every channel. The native rate is the rate of the input file, and
+// the stream ends when the input does; the recording has the length of the
+// input, in the format of the input file. Reopening the stream (e.g. with
+// another block size) carries on from the same position in both files.
+class FileBackend : public NullBackend {
+    public:
+        // inPath: WAV file played as input.
+        // outPath: WAV file the output is recorded to, NULL to discard it.
+        FileBackend(const char *inPath, const char *outPath);
+
+        ~FileBackend();
+
+        // Open the input file. Returns false, after printing why, if it
+        // cannot be read. Call before anything else.
+        bool load();
+
+        const char* name() const { return "file"; }
+        void listDevices();
+        void printDeviceInfo(unsigned int index);
+        unsigned int nativeRate() { return m_input.sampleRate(); }
+        bool open(const AudioStreamSettings &settings, AudioCallback callback, void *userData);
+
+    protected:
+        void generate(float *x, unsigned long frames);
+        void consume(const float *x, unsigned long frames);
+        bool finished();
+
+    private:
+        std::string m_inPath;
+        std::string m_outPath;
+
+        // Input and output files, and the next frame of each.
+        WavFile m_input;
+        WavFile m_output;
+        size_t m_inFrame;
+        size_t m_outFrame;
+
+        // Set once the first stream has opened the files.
+        bool m_opened;
+
+        // One block of samples at full scale 1, with the channels of the
+        // file or of the stream, whichever are more.
+        std::vector<float> m_block;
+};
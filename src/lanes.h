@@ -0,0 +1,19 @@
+#pragma once
+
+// The effects that recurse sample by sample cannot be vectorized along time,
+// so W channels are run side by side in the lanes of a vector instead. The
+// chunk of the W channels is interleaved into frames of W samples first, so
+// each step of the recursion loads and stores one vector. Only the first w
+// (<= W) lanes hold channels, the rest run on zeros into a scratch buffer.
+
+// Pointers to the W lanes of channels c[0..w), the unused lanes point to filler.
+template <int W, typename T>
+inline void lanePointers(T* const* c, int w, T* filler, T** lanes) {
+    for (int l = 0; l < W; l++)
+        lanes[l] = l < w ? c[l] : filler;
+}
+
+// Number of lanes used for w channels (1, 2, 4 or 8).
+inline int laneWidth(int w) {
+    return w <= 2 ? w : (w <= 4 ? 4 : 8);
+}
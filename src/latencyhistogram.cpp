@@ -0,0 +1,53 @@
+#include "latencyhistogram.h"
+
+#include <math.h>
+
+LatencyHistogram::LatencyHistogram()
+        : m_max(0) {
+    for (size_t i = 0; i < BUCKETS; i++)
+        m_counts[i].store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::read(Snapshot &snapshot) const {
+    snapshot.total = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        snapshot.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+        snapshot.total += snapshot.counts[i];
+    }
+}
+
+uint64_t LatencyHistogram::bucketStart(size_t index) {
+    if (index < SUB_BUCKETS)
+        return index;
+    size_t shift = index / SUB_BUCKETS - 1;
+    return (uint64_t)(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+}
+
+uint64_t LatencyHistogram::bucketWidth(size_t index) {
+    if (index < SUB_BUCKETS)
+        return 1;
+    return (uint64_t)1 << (index / SUB_BUCKETS - 1);
+}
+
+double LatencyHistogram::Snapshot::percentile(double q) const {
+    if (total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)ceil(q * total);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank)
+            return bucketStart(i) + (bucketWidth(i) - 1) / 2.0;
+    }
+    return bucketStart(BUCKETS - 1);
+}
+
+void LatencyHistogram::Snapshot::subtract(const Snapshot &earlier) {
+    total = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        counts[i] -= earlier.counts[i];
+        total += counts[i];
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// LatencyHistogram
+//
+// Histogram of durations in nanoseconds, recorded by one real-time thread and
+// read by a reporter thread. record() is wait-free and allocation-free: the
+// buckets are a fixed array of relaxed atomic counters, only ever written by
+// the recording thread. Buckets are exact below SUB_BUCKETS ns, then split
+// every power of two into SUB_BUCKETS steps, so any duration from 1 ns to
+// minutes is kept with an error of at most 1/SUB_BUCKETS (about 3%).
+class LatencyHistogram {
+    public:
+        enum {
+            SUB_BITS = 5,
+            SUB_BUCKETS = 1 << SUB_BITS,
+            // Up to 2^40 ns (about 18 minutes), longer durations share the last bucket.
+            MAX_BITS = 40,
+            BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS
+        };
+
+        // Counts read from a histogram at one point in time.
+        struct Snapshot {
+            uint64_t counts[BUCKETS];
+            uint64_t total;
+
+            // Duration below which a fraction q (0 to 1) of the counts fall
+            // (middle of the bucket), 0 if there are no counts.
+            double percentile(double q) const;
+
+            // Counts recorded between earlier and this snapshot.
+            void subtract(const Snapshot &earlier);
+        };
+
+        LatencyHistogram();
+
+        // Record one duration. Call from a single thread.
+        void record(uint64_t ns) {
+            std::atomic<uint64_t> &count = m_counts[bucket(ns)];
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (ns > m_max.load(std::memory_order_relaxed))
+                m_max.store(ns, std::memory_order_relaxed);
+        }
+
+        // Copy the counts recorded so far. Can be called from any thread while
+        // recording, the copy is then off by at most the samples being recorded.
+        void read(Snapshot &snapshot) const;
+
+        // Longest duration recorded since the last call. A duration recorded
+        // while this runs may be missed.
+        uint64_t takeMax() { return m_max.exchange(0, std::memory_order_relaxed); }
+
+    private:
+        // Bucket of a duration.
+        static size_t bucket(uint64_t ns) {
+            if (ns < SUB_BUCKETS)
+                return (size_t)ns;
+            int top = 63 - __builtin_clzll(ns);
+            if (top >= MAX_BITS)
+                return BUCKETS - 1;
+            int shift = top - SUB_BITS;
+            return (size_t)(shift + 1) * SUB_BUCKETS + (size_t)((ns >> shift) & (SUB_BUCKETS - 1));
+        }
+
+        // Smallest duration of a bucket, and the number of durations in it.
+        static uint64_t bucketStart(size_t index);
+        static uint64_t bucketWidth(size_t index);
+
+        std::atomic<uint64_t> m_counts[BUCKETS];
+        std::atomic<uint64_t> m_max;
+};
@@ -0,0 +1,125 @@
+#include "lfo.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "simdkernels.h"
+
+#define LFO_TWO_PI 6.28318530717958647692
+
+Lfo::Lfo()
+        : m_shape(LFO_SINE),
+          m_phase(0),
+          m_increment(-1),
+          m_pos(0) {
+    setRate(1, 44100);
+}
+
+void Lfo::setRate(double rate, int sampleRate) {
+    double increment = rate / sampleRate;
+    if (increment == m_increment)
+        return;
+
+    // Carry the phase over with the old rate.
+    m_phase += m_pos * std::max(m_increment, 0.0);
+    m_pos = 0;
+
+    m_increment = increment;
+    m_stepCos = (float)cos(LFO_TWO_PI * LANES * m_increment);
+    m_stepSin = (float)sin(LFO_TWO_PI * LANES * m_increment);
+    for (int k = 0; k < LANES; k++) {
+        m_laneCos[k] = cos(LFO_TWO_PI * k * m_increment);
+        m_laneSin[k] = sin(LFO_TWO_PI * k * m_increment);
+    }
+    restart();
+}
+
+void Lfo::setShape(LfoShape shape) {
+    // Only the sine lanes carry state, they are not kept up by other shapes.
+    if (shape != m_shape) {
+        m_shape = shape;
+        restart();
+    }
+}
+
+void Lfo::reset(double phase) {
+    m_phase = phase;
+    m_pos = 0;
+    restart();
+}
+
+void Lfo::restart() {
+    m_phase += m_pos * m_increment;
+    m_phase -= floor(m_phase);
+    m_pos = 0;
+
+    // Lane k starts k samples ahead and every lane steps LANES samples.
+    double c0 = cos(LFO_TWO_PI * m_phase);
+    double s0 = sin(LFO_TWO_PI * m_phase);
+    for (int k = 0; k < LANES; k++) {
+        m_cos[k] = (float)(c0 * m_laneCos[k] - s0 * m_laneSin[k]);
+        m_sin[k] = (float)(c0 * m_laneSin[k] + s0 * m_laneCos[k]);
+    }
+}
+
+void Lfo::render(float *y, size_t n) {
+    while (n > 0) {
+        if (m_pos == BLOCK_LEN)
+            restart();
+        size_t len = std::min(n, BLOCK_LEN - m_pos);
+        renderSpan(y, len);
+        m_pos += len;
+        y += len;
+        n -= len;
+    }
+}
+
+void Lfo::skip(size_t n) {
+    // Whole restart periods only move the phase.
+    size_t total = m_pos + n;
+    if (total >= BLOCK_LEN) {
+        m_pos = total - total % BLOCK_LEN;
+        restart();
+        n = total % BLOCK_LEN;
+    }
+    float aside[BLOCK_LEN];
+    render(aside, n);
+}
+
+void Lfo::renderSpan(float *y, size_t n) {
+    if (m_shape == LFO_SINE) {
+        // The last call may have stopped within a group of lanes: render the
+        // whole group aside (rotating the lanes if it completes) and keep the rest.
+        size_t offset = m_pos % LANES;
+        size_t done = 0;
+        if (offset != 0) {
+            float group[LANES];
+            done = std::min(n, LANES - offset);
+            simdKernels().oscillate(group, m_cos, m_sin, m_stepCos, m_stepSin, offset + done);
+            memcpy(y, group + offset, sizeof(float) * done);
+        }
+        // Clamped, as rounding can take the oscillators a hair past +-1.
+        simdKernels().oscillate(y + done, m_cos, m_sin, m_stepCos, m_stepSin, n - done);
+        return;
+    }
+
+    // The phase within a restart period is small enough for float, and
+    // positive, so truncation wraps it (and vectorizes, unlike floorf).
+    float phase = (float)m_phase;
+    float increment = (float)m_increment;
+    float start = (float)m_pos;
+    if (m_shape == LFO_TRIANGLE) {
+        for (size_t i = 0; i < n; i++) {
+            float t = phase + (start + i) * increment;
+            t -= (float)(int)t;
+            y[i] = fabsf(1 - 2 * t);
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            float t = phase + (start + i) * increment;
+            t -= (float)(int)t;
+            y[i] = t < 0.5f ? 1.0f : 0.0f;
+        }
+    }
+}
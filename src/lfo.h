@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+
+// Waveforms of Lfo.
+enum LfoShape {
+    LFO_SINE,
+    LFO_TRIANGLE,
+    LFO_SQUARE
+};
+
+// Lfo
+//
+// Low frequency oscillator for modulation (tremolo gain, flanger delay).
+// Renders a block of values at a time, all in [0, 1] and starting at 1 at
+// phase 0: (1 + cos)/2 for the sine, a triangle, or 1 then 0 for the square.
+// The phase is a fraction of a cycle kept in double precision and wrapped
+// every BLOCK_LEN samples, so it stays exact however long the stream runs.
+// The sine needs no cos() per sample: eight quadrature oscillators
+// (SimdKernels::oscillate) rotate side by side, restarted from the exact phase
+// every BLOCK_LEN samples so rounding errors never pile up. Restarts happen at
+// fixed sample positions, so the values do not depend on how the output is
+// split into blocks.
+class Lfo {
+    public:
+        Lfo();
+
+        // Set the frequency. The phase carries on from where it is.
+        // rate: frequency in Hz.
+        // sampleRate: sample rate in Hz.
+        void setRate(double rate, int sampleRate);
+
+        // Set the waveform (see LfoShape).
+        void setShape(LfoShape shape);
+
+        // Restart at the given phase, in cycles (0 to 1).
+        void reset(double phase = 0);
+
+        // Render the next n values of the oscillator into y.
+        void render(float *y, size_t n);
+
+        // Move on by n values without rendering them (at most the rest of a
+        // restart period is rendered aside), e.g. while the effect is idle.
+        void skip(size_t n);
+
+    private:
+        // Lanes of the quadrature oscillators and samples between restarts.
+        enum { LANES = 8, BLOCK_LEN = 256 };
+
+        // Move the phase to the current sample and start the lanes from it.
+        void restart();
+
+        // Render n values, without crossing a restart.
+        void renderSpan(float *y, size_t n);
+
+        LfoShape m_shape;
+
+        // Phase in cycles at the last restart, in [0, 1), and its increment per sample.
+        double m_phase;
+        double m_increment;
+
+        // Samples rendered since the last restart.
+        size_t m_pos;
+
+        // Cosine and sine of the rotation of each lane per LANES samples.
+        float m_stepCos;
+        float m_stepSin;
+
+        // Cosine and sine of the start of each lane, relative to lane 0.
+        double m_laneCos[LANES];
+        double m_laneSin[LANES];
+
+        // Current cosine and sine of each lane.
+        float m_cos[LANES];
+        float m_sin[LANES];
+};
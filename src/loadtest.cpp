@@ -0,0 +1,105 @@
+#include "loadtest.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "nullbackend.h"
+
+LoadTest::LoadTest()
+        : m_idxF(0),
+          m_mode(STREAM_BLOCKING),
+          m_format(SAMPLE_INT16),
+          m_channels(0),
+          m_framesPerBuffer(0),
+          m_sampleRate(0),
+          m_deviceRate(0),
+          m_denormalSafe(false),
+          m_seconds(5) {
+}
+
+int LoadTest::runOnce(int streams, unsigned long &misses) {
+    // Set every pipe up before any stream starts, so that setting up the
+    // effects does not count against the streams already running.
+    std::vector<std::unique_ptr<PAudioPipe>> pipes;
+    for (int i = 0; i < streams; i++) {
+        PAudioPipe *pipe = new PAudioPipe(std::unique_ptr<AudioBackend>(new NullBackend(m_seconds)));
+        pipes.emplace_back(pipe);
+        pipe->setInteractive(false);
+        pipe->setStreamMode(m_mode);
+        pipe->setSampleFormat(m_format);
+        pipe->setImpulseResponse(m_impulseResponse);
+        if (m_framesPerBuffer > 0)
+            pipe->setFramesPerBuffer(m_framesPerBuffer);
+        if (m_channels > 0)
+            pipe->setNumChannels(m_channels);
+        if (m_sampleRate > 0)
+            pipe->setSampleRate(m_sampleRate);
+        if (m_deviceRate > 0)
+            pipe->setDeviceRate(m_deviceRate);
+        pipe->setDenormalSafe(m_denormalSafe);
+        pipe->setParams(m_params);
+        pipe->setEffect(m_idxF);
+    }
+
+    std::vector<std::thread> threads;
+    for (auto &pipe : pipes)
+        threads.emplace_back(&PAudioPipe::start, pipe.get());
+    for (std::thread &thread : threads)
+        thread.join();
+
+    int missed = 0;
+    misses = 0;
+    for (auto &pipe : pipes) {
+        unsigned long late = pipe->deadlineMisses();
+        misses += late;
+        if (late > 0)
+            missed++;
+    }
+    return missed;
+}
+
+bool LoadTest::run(int streams) {
+    unsigned long misses;
+    int missed = runOnce(streams, misses);
+    printf("%d streams of %s for %g s: %d missed deadlines (%lu late blocks)\n",
+           streams, kCoreProcesses[m_idxF].c_str(), m_seconds, missed, misses);
+    return missed == 0;
+}
+
+int LoadTest::findMax(int limit) {
+    printf("%-8s %10s %12s\n", "streams", "missed", "late blocks");
+    auto meets = [this](int streams) {
+        unsigned long misses;
+        int missed = runOnce(streams, misses);
+        printf("%-8d %10d %12lu\n", streams, missed, misses);
+        fflush(stdout);
+        return missed == 0;
+    };
+
+    // Double until a run misses, then bisect between good and bad.
+    int good = 0;
+    int bad = 0;
+    for (int streams = 1; ; streams *= 2) {
+        streams = std::min(streams, limit);
+        if (!meets(streams)) {
+            bad = streams;
+            break;
+        }
+        good = streams;
+        if (streams == limit)
+            break;
+    }
+    while (bad > good + 1) {
+        int streams = good + (bad - good) / 2;
+        if (meets(streams))
+            good = streams;
+        else
+            bad = streams;
+    }
+
+    printf("Most streams of %s meeting every deadline: %d%s\n", kCoreProcesses[m_idxF].c_str(), good,
+           good == limit ? " (limit reached)" : "");
+    return good;
+}
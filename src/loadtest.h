@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+
+// Include the audio stream, run on null devices.
+#include "paudiopipe.h"
+
+// LoadTest
+//
+// Finds how many audio streams the host can run at once without missing a
+// deadline, with no sound card: every stream is a PAudioPipe on its own
+// NullBackend, so each one has its own clock and audio thread like a real
+// device, and a stream that falls behind loses input or has output gaps.
+// All the streams run the same effect with the same settings.
+class LoadTest {
+    public:
+        LoadTest();
+
+        // Select the audio/sound effect function.
+        // idxF: Index to the sound effect or dsp function (see kCoreProcesses).
+        void setFunction(int idxF) { m_idxF = idxF; }
+
+        // Set the effect parameters (see EffectParams).
+        void setParams(const EffectParams &params) { m_params = params; }
+
+        // Set the impulse response of Convolution Reverb (NULL for the synthetic room).
+        void setImpulseResponse(std::shared_ptr<const ImpulseResponse> ir) { m_impulseResponse = ir; }
+
+        // Stream settings, see PAudioPipe (0 keeps the default of PAudioPipe).
+        void setStreamMode(StreamMode mode) { m_mode = mode; }
+        void setSampleFormat(SampleFormat format) { m_format = format; }
+        void setNumChannels(unsigned int channels) { m_channels = channels; }
+        void setFramesPerBuffer(unsigned int frames) { m_framesPerBuffer = frames; }
+        void setSampleRate(unsigned int rate) { m_sampleRate = rate; }
+        void setDeviceRate(unsigned int rate) { m_deviceRate = rate; }
+        void setDenormalSafe(bool enable) { m_denormalSafe = enable; }
+
+        // Set how long every run streams, in seconds (default 5).
+        void setSeconds(double seconds) { m_seconds = seconds; }
+
+        // Run the given number of streams at once and print how many of them
+        // missed deadlines.
+        // Returns true if every stream met all of its deadlines.
+        bool run(int streams);
+
+        // Run 1, 2, 4, ... streams until a run misses deadlines (or reaches
+        // limit streams), then bisect between the last run that met them and
+        // the first that did not. Prints every run and the result.
+        // Returns the most streams that met all of their deadlines, 0 if a
+        // single stream does not.
+        int findMax(int limit);
+
+    private:
+        // Run streams streams at once. Returns the number of streams that
+        // missed a deadline, with the missed blocks of all of them in misses.
+        int runOnce(int streams, unsigned long &misses);
+
+        int m_idxF;
+        EffectParams m_params;
+        std::shared_ptr<const ImpulseResponse> m_impulseResponse;
+        StreamMode m_mode;
+        SampleFormat m_format;
+        unsigned int m_channels;
+        unsigned int m_framesPerBuffer;
+        unsigned int m_sampleRate;
+        unsigned int m_deviceRate;
+        bool m_denormalSafe;
+        double m_seconds;
+};
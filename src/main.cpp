@@ -1,20 +1,366 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#include "batchrenderer.h"
+#include "filebackend.h"
+#include "loadtest.h"
+#include "nullbackend.h"
+#include "offlinerenderer.h"
 #include "paudiopipe.h"
+#include "portaudiobackend.h"
+
+// Print command line usage.
+static void printUsage(const char *program) {
+    printf("Usage:\n");
+    printf("  %s [--mode MODE] [--frames N] [--adaptive] [--channels N] [--format FORMAT] [--dither]\n", program);
+    printf("  %*s [--denormal-safe] [--silence-bypass DB] [--stats FILE] [--ir FILE]\n", (int)strlen(program), "");
+    printf("  %*s [--rate N] [--device-rate N] [--backend BACKEND] [--seconds S]\n", (int)strlen(program), "");
+    printf("  %*s [--analysis FILE] [--effect NAME] [--param NAME=VALUE]...\n", (int)strlen(program), "");
+    printf("                                         live audio from the default devices\n");
+    printf("                                         MODE: blocking (default), callback or dsp-thread\n");
+    printf("                                         --frames: frames per buffer, --channels: channels\n");
+    printf("                                         --adaptive: tune the frames per buffer and device\n");
+    printf("                                         latency while streaming, starting at --frames\n");
+    printf("                                         FORMAT: int16 (default), int24, int32 or float32\n");
+    printf("                                         --dither: TPDF dither on integer output\n");
+    printf("                                         --denormal-safe: flush subnormal floats to zero\n");
+    printf("                                         while processing (or bias the feedback effects)\n");
+    printf("                                         --silence-bypass: skip the effect on blocks below\n");
+    printf("                                         DB dBFS (e.g. -60) once its tail has died out\n");
+    printf("                                         --stats: timing and xrun statistics as JSON lines\n");
+    printf("                                         every 5 s to FILE (- for standard output)\n");
+    printf("                                         --analysis: peak, RMS and octave band levels of the\n");
+    printf("                                         effect input and output as JSON lines every 100 ms\n");
+    printf("                                         to FILE (- for standard output)\n");
+    printf("                                         --ir: impulse response WAV of Convolution Reverb\n");
+    printf("                                         (default: a synthetic 2 s room)\n");
+    printf("                                         --rate: sample rate of the effects (default 44100)\n");
+    printf("                                         --device-rate: sample rate of the device (default:\n");
+    printf("                                         its native rate), resampled to and from --rate\n");
+    printf("                                         BACKEND: portaudio (default), null (clock-driven\n");
+    printf("                                         device, 440 Hz tone in, output discarded) or file\n");
+    printf("                                         (--play IN.wav in real time, --record OUT.wav)\n");
+    printf("                                         --seconds: stop a null device after S seconds\n");
+    printf("                                         --effect: skip the effect prompt\n");
+    printf("  %s --streams N|max [--seconds S] [--effect NAME] [live options]\n", program);
+    printf("                                         run N streams at once on null devices (max: find\n");
+    printf("                                         the most that meet every deadline), S s per run\n");
+    printf("  %s --in IN.wav --out OUT.wav --effect NAME [--ir FILE] [--param NAME=VALUE]...\n", program);
+    printf("                                         render a WAV file offline (no audio device)\n");
+    printf("                                         parameters: %s\n", kEffectParamNames);
+    printf("  %s --batch MANIFEST --effect NAME [--threads N] [--scaling] [--ir FILE] [--param NAME=VALUE]...\n",
+           program);
+    printf("                                         render the \"IN.wav OUT.wav\" lines of MANIFEST on N threads\n");
+    printf("                                         (default: all cores), --scaling: compare 1, 2, 4... N threads\n");
+    printf("Effects:");
+    for (int i = 0; i < kNumCoreProcesses; i++)
+        printf(" \"%s\"", kCoreProcesses[i].c_str());
+    printf(" (or their indices)\n");
+}
+
+// Lower-case letters and digits of name, so "iir-echo" matches "IIR Echo".
+static std::string normalizeName(const std::string &name) {
+    std::string key;
+    for (char c : name) {
+        if (isalnum((unsigned char)c))
+            key += (char)tolower((unsigned char)c);
+    }
+    return key;
+}
+
+// Find sound effect by name or index (see kCoreProcesses).
+// Returns -1 if there is no such effect.
+static int findEffect(const char *name) {
+    char *end;
+    long idx = strtol(name, &end, 10);
+    if (*name != '\0' && *end == '\0')
+        return (idx >= 0 && idx < kNumCoreProcesses) ? (int)idx : -1;
+
+    for (int i = 0; i < kNumCoreProcesses; i++) {
+        if (normalizeName(kCoreProcesses[i]) == normalizeName(name))
+            return i;
+    }
+    return -1;
+}
+
+// Set an effect parameter given as NAME=VALUE (e.g. echo-delay=0.5).
+// Returns false if there is no such parameter or the value is invalid.
+static bool parseParam(const char *arg, EffectParams &params) {
+    const char *eq = strchr(arg, '=');
+    if (eq == NULL)
+        return false;
+    char *end;
+    double value = strtod(eq + 1, &end);
+    if (end == eq + 1 || *end != '\0')
+        return false;
+    return setEffectParam(params, std::string(arg, eq - arg), value);
+}
+
+// Find device sample format by name. Returns false if there is no such format.
+static bool findSampleFormat(const char *name, SampleFormat &format) {
+    if (strcmp(name, "int16") == 0)
+        format = SAMPLE_INT16;
+    else if (strcmp(name, "int24") == 0)
+        format = SAMPLE_INT24;
+    else if (strcmp(name, "int32") == 0)
+        format = SAMPLE_INT32;
+    else if (strcmp(name, "float32") == 0)
+        format = SAMPLE_FLOAT32;
+    else
+        return false;
+    return true;
+}
+
+// Returns true if name is an audio backend (see --backend).
+static bool isBackend(const char *name) {
+    return strcmp(name, "portaudio") == 0 || strcmp(name, "null") == 0 || strcmp(name, "file") == 0;
+}
+
+// Returns true if arg is a number of streams (see --streams): a count or "max".
+static bool isStreamCount(const char *arg) {
+    return strcmp(arg, "max") == 0 || atoi(arg) > 0;
+}
 
-int main() {
-    PAudioPipe a;
+// Find stream mode by name. Returns false if there is no such mode.
+static bool findStreamMode(const char *name, StreamMode &mode) {
+    if (strcmp(name, "blocking") == 0)
+        mode = STREAM_BLOCKING;
+    else if (strcmp(name, "callback") == 0)
+        mode = STREAM_CALLBACK;
+    else if (strcmp(name, "dsp-thread") == 0)
+        mode = STREAM_DSP_THREAD;
+    else
+        return false;
+    return true;
+}
+
+// Returns true if arg is a supported sample rate in Hz (8 kHz to 384 kHz).
+static bool isSampleRate(const char *arg) {
+    int rate = atoi(arg);
+    return rate >= 8000 && rate <= 384000;
+}
+
+int main(int argc, char *argv[]) {
+    const char *inPath = NULL;
+    const char *outPath = NULL;
+    const char *manifestPath = NULL;
+    const char *effect = "Pass";
+    bool effectGiven = false;
+    EffectParams params;
+    StreamMode mode = STREAM_BLOCKING;
+    SampleFormat format = SAMPLE_INT16;
+    bool dither = false;
+    bool adaptive = false;
+    bool denormalSafe = false;
+    double silenceDb = 0;
+    const char *statsPath = NULL;
+    const char *analysisPath = NULL;
+    const char *irPath = NULL;
+    int framesPerBuffer = 0;
+    int channels = 0;
+    int rate = 0;
+    int deviceRate = 0;
+    int threads = 0;
+    bool scaling = false;
+    const char *backendName = "portaudio";
+    const char *playPath = NULL;
+    const char *recordPath = NULL;
+    double seconds = 0;
+    const char *streams = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--in") == 0 && hasValue) {
+            inPath = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && hasValue) {
+            outPath = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0 && hasValue) {
+            manifestPath = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && hasValue && atoi(argv[i + 1]) > 0) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--scaling") == 0) {
+            scaling = true;
+        } else if (strcmp(argv[i], "--effect") == 0 && hasValue) {
+            effect = argv[++i];
+            effectGiven = true;
+        } else if (strcmp(argv[i], "--backend") == 0 && hasValue && isBackend(argv[i + 1])) {
+            backendName = argv[++i];
+        } else if (strcmp(argv[i], "--play") == 0 && hasValue) {
+            playPath = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && hasValue) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--seconds") == 0 && hasValue && atof(argv[i + 1]) > 0) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--streams") == 0 && hasValue && isStreamCount(argv[i + 1])) {
+            streams = argv[++i];
+        } else if (strcmp(argv[i], "--param") == 0 && hasValue && parseParam(argv[i + 1], params)) {
+            i++;
+        } else if (strcmp(argv[i], "--mode") == 0 && hasValue && findStreamMode(argv[i + 1], mode)) {
+            i++;
+        } else if (strcmp(argv[i], "--format") == 0 && hasValue && findSampleFormat(argv[i + 1], format)) {
+            i++;
+        } else if (strcmp(argv[i], "--stats") == 0 && hasValue) {
+            statsPath = argv[++i];
+        } else if (strcmp(argv[i], "--analysis") == 0 && hasValue) {
+            analysisPath = argv[++i];
+        } else if (strcmp(argv[i], "--ir") == 0 && hasValue) {
+            irPath = argv[++i];
+        } else if (strcmp(argv[i], "--dither") == 0) {
+            dither = true;
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            adaptive = true;
+        } else if (strcmp(argv[i], "--denormal-safe") == 0) {
+            denormalSafe = true;
+        } else if (strcmp(argv[i], "--silence-bypass") == 0 && hasValue && atof(argv[i + 1]) < 0) {
+            silenceDb = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--frames") == 0 && hasValue && atoi(argv[i + 1]) > 0) {
+            framesPerBuffer = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0 && hasValue && isSampleRate(argv[i + 1])) {
+            rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--device-rate") == 0 && hasValue && isSampleRate(argv[i + 1])) {
+            deviceRate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--channels") == 0 && hasValue &&
+                   atoi(argv[i + 1]) > 0 && atoi(argv[i + 1]) <= MAX_CHANNELS) {
+            channels = atoi(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    // Impulse response of Convolution Reverb, NULL for the synthetic room.
+    std::shared_ptr<const ImpulseResponse> ir;
+    if (irPath != NULL) {
+        ir = ImpulseResponse::load(irPath);
+        if (!ir)
+            return 1;
+    }
+
+    // Batch mode, every file of the manifest is rendered offline on all the cores.
+    if (manifestPath != NULL) {
+        int idxF = findEffect(effect);
+        if (inPath != NULL || outPath != NULL || idxF < 0) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (threads == 0)
+            threads = std::max(1, (int)std::thread::hardware_concurrency());
+        BatchRenderer renderer;
+        renderer.setFunction(idxF);
+        renderer.setParams(params);
+        renderer.setImpulseResponse(ir);
+        if (!renderer.loadManifest(manifestPath))
+            return 1;
+        bool ok = scaling ? renderer.renderScaling(threads) : renderer.render(threads);
+        return ok ? 0 : 1;
+    }
+
+    // Offline (headless) mode, no audio device is touched.
+    if (inPath != NULL || outPath != NULL) {
+        int idxF = findEffect(effect);
+        if (inPath == NULL || outPath == NULL || idxF < 0) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        OfflineRenderer renderer;
+        renderer.setFunction(idxF);
+        renderer.setParams(params);
+        renderer.setImpulseResponse(ir);
+        return renderer.render(inPath, outPath) ? 0 : 1;
+    }
+
+    // Load test, many streams on null devices at once.
+    if (streams != NULL) {
+        int idxF = findEffect(effect);
+        if (idxF < 0) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        LoadTest test;
+        test.setFunction(idxF);
+        test.setParams(params);
+        test.setImpulseResponse(ir);
+        test.setStreamMode(mode);
+        test.setSampleFormat(format);
+        test.setNumChannels(channels);
+        test.setFramesPerBuffer(framesPerBuffer);
+        test.setSampleRate(rate);
+        test.setDeviceRate(deviceRate);
+        test.setDenormalSafe(denormalSafe);
+        if (seconds > 0)
+            test.setSeconds(seconds);
+        if (strcmp(streams, "max") == 0)
+            return test.findMax(1024) > 0 ? 0 : 1;
+        return test.run(atoi(streams)) ? 0 : 1;
+    }
+
+    // Audio device of the live stream.
+    std::unique_ptr<AudioBackend> backend;
+    if (strcmp(backendName, "null") == 0) {
+        backend.reset(new NullBackend(seconds));
+    } else if (strcmp(backendName, "file") == 0) {
+        if (playPath == NULL) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        FileBackend *file = new FileBackend(playPath, recordPath);
+        backend.reset(file);
+        if (!file->load())
+            return 1;
+    } else {
+        backend.reset(new PortAudioBackend());
+    }
+
+    PAudioPipe a(std::move(backend));
+    a.setStreamMode(mode);
+    a.setSampleFormat(format);
+    a.setDither(dither);
+    a.setAdaptive(adaptive);
+    a.setDenormalSafe(denormalSafe);
+    if (silenceDb < 0)
+        a.setSilenceBypass(true, silenceDb);
+    a.setImpulseResponse(ir);
+    if (statsPath != NULL && !a.setStatsFile(statsPath))
+        return 1;
+    if (analysisPath != NULL && !a.setAnalysisFile(analysisPath))
+        return 1;
+    if (framesPerBuffer > 0)
+        a.setFramesPerBuffer(framesPerBuffer);
+    if (channels > 0)
+        a.setNumChannels(channels);
+    if (rate > 0)
+        a.setSampleRate(rate);
+    if (deviceRate > 0)
+        a.setDeviceRate(deviceRate);
+    a.setParams(params);
+    if (effectGiven) {
+        int idxF = findEffect(effect);
+        if (idxF < 0) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        a.setEffect(idxF);
+    }
 
     // Set to true to list audio devices and see their info.
     bool dispDevices = true;
     if (dispDevices) {
         a.listDevices();
 
-        // Default input device.
-        unsigned int inputDeviceIdx = 0;
-        a.getDeviceInfo(inputDeviceIdx);
+        // Input device, the default one.
+        int inputDeviceIdx = a.inputDevice();
+        if (inputDeviceIdx >= 0)
+            a.getDeviceInfo(inputDeviceIdx);
 
-        // Default output device.
-        unsigned int outputDeviceIdx = 1;
-        a.getDeviceInfo(outputDeviceIdx);
+        // Output device, the default one, unless it is the same device.
+        int outputDeviceIdx = a.outputDevice();
+        if (outputDeviceIdx >= 0 && outputDeviceIdx != inputDeviceIdx)
+            a.getDeviceInfo(outputDeviceIdx);
     }
     a.start();
     return 0;
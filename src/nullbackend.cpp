@@ -0,0 +1,230 @@
+#include "nullbackend.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NULLBACKEND_PI 3.14159265358979323846
+
+// Input tone: 440 Hz at half of full scale.
+static const double kToneHz = 440;
+static const float kToneLevel = 0.5f;
+
+NullBackend::NullBackend(double seconds)
+        : m_seconds(seconds),
+          m_settings(),
+          m_period(0),
+          m_bufferPeriods(1),
+          m_open(false),
+          m_callback(NULL),
+          m_userData(NULL),
+          m_readBlock(0),
+          m_writeBlock(0),
+          m_phase(0),
+          m_started(false),
+          m_running(false),
+          m_active(false) {
+}
+
+NullBackend::~NullBackend() {
+    close();
+}
+
+void NullBackend::listDevices() {
+    printf("Devices:\n");
+    printf("0: () Null device (clock-driven, any rate) --default--\n");
+}
+
+void NullBackend::printDeviceInfo(unsigned int index) {
+    if (index != 0) {
+        printf("invalid index\n");
+        return;
+    }
+    printf("\nDevice: (0)\n");
+    printf("Null device\n");
+    printf("Input: %.0f Hz tone, output: discarded\n", kToneHz);
+    if (m_seconds > 0)
+        printf("Streams end after %g s\n", m_seconds);
+}
+
+bool NullBackend::setInputDevice(unsigned int index) {
+    if (index != 0) {
+        printf("\nInvalid index\n");
+        return false;
+    }
+    return true;
+}
+
+bool NullBackend::setOutputDevice(unsigned int index) {
+    return setInputDevice(index);
+}
+
+bool NullBackend::open(const AudioStreamSettings &settings, AudioCallback callback, void *userData) {
+    close();
+    if (settings.channels == 0 || settings.sampleRate == 0 || settings.framesPerBuffer == 0) {
+        fprintf(stderr, "Null device: invalid stream settings\n");
+        return false;
+    }
+    m_settings = settings;
+    m_period = (double)settings.framesPerBuffer / settings.sampleRate;
+    m_bufferPeriods = settings.lowLatency ? 1 : BUFFER_PERIODS;
+    m_callback = callback;
+    m_userData = userData;
+
+    size_t samples = (size_t)settings.framesPerBuffer * settings.channels;
+    m_unit.reset(new float[samples]);
+    if (callback != NULL) {
+        m_input.reset(new uint8_t[samples * sampleSize(settings.format)]);
+        m_output.reset(new uint8_t[samples * sampleSize(settings.format)]);
+    }
+    m_open = true;
+    return true;
+}
+
+bool NullBackend::start() {
+    if (!m_open || m_active)
+        return false;
+    m_start = Clock::now();
+    if (!m_started)
+        m_firstStart = m_start;
+    m_started = true;
+    m_readBlock = 0;
+    m_writeBlock = 0;
+    m_active = true;
+    if (m_callback != NULL) {
+        m_running = true;
+        m_thread = std::thread(&NullBackend::callbackLoop, this);
+    }
+    return true;
+}
+
+void NullBackend::stop() {
+    m_running = false;
+    if (m_thread.joinable())
+        m_thread.join();
+    m_active = false;
+}
+
+void NullBackend::close() {
+    stop();
+    m_open = false;
+}
+
+double NullBackend::latency() {
+    return m_open ? (1 + m_bufferPeriods) * m_period : 0;
+}
+
+NullBackend::Clock::time_point NullBackend::deadline(uint64_t block) const {
+    return m_start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(block * m_period));
+}
+
+uint64_t NullBackend::currentBlock() const {
+    return (uint64_t)(std::chrono::duration<double>(Clock::now() - m_start).count() / m_period);
+}
+
+AudioStatus NullBackend::read(void *buffer, unsigned long frames) {
+    if (frames > m_settings.framesPerBuffer) {
+        fprintf(stderr, "Null device: blocks are at most %u frames\n", m_settings.framesPerBuffer);
+        return AUDIO_ERROR;
+    }
+    if (!m_active || finished()) {
+        m_active = false;
+        return AUDIO_END;
+    }
+    // Input that waited longer than the device buffers is lost, the next
+    // block is the one captured last.
+    AudioStatus status = AUDIO_OK;
+    if (Clock::now() > deadline(m_readBlock + 1 + m_bufferPeriods)) {
+        m_readBlock = currentBlock() - 1;
+        status = AUDIO_INPUT_OVERFLOW;
+    }
+    std::this_thread::sleep_until(deadline(m_readBlock + 1));
+    fillInput(buffer, frames);
+    m_readBlock++;
+    return status;
+}
+
+AudioStatus NullBackend::write(const void *buffer, unsigned long frames) {
+    if (frames > m_settings.framesPerBuffer) {
+        fprintf(stderr, "Null device: blocks are at most %u frames\n", m_settings.framesPerBuffer);
+        return AUDIO_ERROR;
+    }
+    if (!m_active)
+        return AUDIO_END;
+    // Block j plays m_bufferPeriods periods after block j has been captured,
+    // and there is room for it from its capture on.
+    AudioStatus status = AUDIO_OK;
+    if (Clock::now() > deadline(m_writeBlock + 1 + m_bufferPeriods)) {
+        m_writeBlock = currentBlock() - 1;
+        status = AUDIO_OUTPUT_UNDERFLOW;
+    }
+    std::this_thread::sleep_until(deadline(m_writeBlock + 1));
+    takeOutput(buffer, frames);
+    m_writeBlock++;
+    return status;
+}
+
+void NullBackend::callbackLoop() {
+    uint64_t block = 0;
+    unsigned int flags = 0;
+    unsigned long frames = m_settings.framesPerBuffer;
+    while (m_running && !finished()) {
+        std::this_thread::sleep_until(deadline(block + 1));
+        fillInput(m_input.get(), frames);
+        AudioTime time = {block * m_period,
+                          std::chrono::duration<double>(Clock::now() - m_start).count(),
+                          (block + 1 + m_bufferPeriods) * m_period};
+        m_callback(m_input.get(), m_output.get(), frames, time, flags, m_userData);
+        takeOutput(m_output.get(), frames);
+
+        // Output that is not ready by the time it plays is a gap; if the
+        // callback is later still, the blocks captured meanwhile are lost.
+        flags = 0;
+        if (Clock::now() > deadline(block + 1 + m_bufferPeriods)) {
+            flags |= AUDIO_FLAG_OUTPUT_UNDERFLOW;
+            uint64_t current = currentBlock();
+            if (current > block + 1 + m_bufferPeriods) {
+                flags |= AUDIO_FLAG_INPUT_OVERFLOW;
+                block = current - 1;
+                continue;
+            }
+        }
+        block++;
+    }
+    m_active = false;
+}
+
+void NullBackend::fillInput(void *buffer, unsigned long frames) {
+    float *x = m_unit.get();
+    generate(x, frames);
+    unitToSamples(m_settings.format, buffer, x, frames * m_settings.channels);
+}
+
+void NullBackend::takeOutput(const void *buffer, unsigned long frames) {
+    float *x = m_unit.get();
+    samplesToUnit(m_settings.format, x, buffer, frames * m_settings.channels);
+    consume(x, frames);
+}
+
+void NullBackend::generate(float *x, unsigned long frames) {
+    unsigned int channels = m_settings.channels;
+    double step = 2 * NULLBACKEND_PI * kToneHz / m_settings.sampleRate;
+    for (unsigned long i = 0; i < frames; i++) {
+        float v = kToneLevel * (float)sin(m_phase);
+        for (unsigned int ch = 0; ch < channels; ch++)
+            x[i * channels + ch] = v;
+        m_phase += step;
+        if (m_phase > 2 * NULLBACKEND_PI)
+            m_phase -= 2 * NULLBACKEND_PI;
+    }
+}
+
+void NullBackend::consume(const float *x, unsigned long frames) {
+    (void)x;
+    (void)frames;
+}
+
+bool NullBackend::finished() {
+    return m_seconds > 0 && std::chrono::duration<double>(Clock::now() - m_firstStart).count() >= m_seconds;
+}
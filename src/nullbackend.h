@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "audiobackend.h"
+
+// NullBackend
+//
+// Synthetic sound card driven by a clock, for machines without one (e.g. load
+// tests on build servers). Like a real device it captures one block of input
+// and plays one block of output every period (framesPerBuffer / sampleRate
+// seconds), on absolute deadlines of a steady clock so that it never drifts:
+// callback streams are called from a thread of the backend at every deadline,
+// blocking reads wait for the deadline of their block.
+// The device buffers BUFFER_PERIODS periods of output (one at low latency):
+// output that is not there by the time it should play is a gap (output
+// underflow), input that waits longer than that is lost (input overflow), and
+// the clock skips ahead to the current block, as a sound card would.
+// Input is a sine tone, output is discarded; derived classes read and write
+// other audio (see FileBackend).
+class NullBackend : public AudioBackend {
+    public:
+        // Periods of output buffered by a stream that is not low latency.
+        enum { BUFFER_PERIODS = 4 };
+
+        // seconds: time after which streams end, from the start of the first
+        // one (so that reopening does not extend it), 0 to run until stopped.
+        explicit NullBackend(double seconds = 0);
+
+        // Stops and closes the stream. Derived classes must close() in their
+        // own destructor, the thread of a callback stream calls them.
+        ~NullBackend();
+
+        const char* name() const { return "null"; }
+        void listDevices();
+        void printDeviceInfo(unsigned int index);
+        bool setInputDevice(unsigned int index);
+        bool setOutputDevice(unsigned int index);
+        int inputDevice() { return 0; }
+        int outputDevice() { return 0; }
+        unsigned int nativeRate() { return 0; }
+        bool open(const AudioStreamSettings &settings, AudioCallback callback, void *userData);
+        bool start();
+        void stop();
+        void close();
+        bool isActive() { return m_active; }
+        AudioStatus read(void *buffer, unsigned long frames);
+        AudioStatus write(const void *buffer, unsigned long frames);
+        double latency();
+
+    protected:
+        // Produce frames frames of input, full scale 1 (sine tone).
+        virtual void generate(float *x, unsigned long frames);
+
+        // Take frames frames of output, full scale 1 (discarded).
+        virtual void consume(const float *x, unsigned long frames);
+
+        // Returns true once the stream has run its course: when the time is
+        // up, or when the input runs out. Called before every block.
+        virtual bool finished();
+
+        // Settings of the open stream.
+        const AudioStreamSettings& settings() const { return m_settings; }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        // Time at which block has been captured and can be read.
+        Clock::time_point deadline(uint64_t block) const;
+
+        // Block whose capture time passed last.
+        uint64_t currentBlock() const;
+
+        // Generate frames frames of input into buffer, in the stream format.
+        void fillInput(void *buffer, unsigned long frames);
+
+        // Consume frames frames of output from buffer, in the stream format.
+        void takeOutput(const void *buffer, unsigned long frames);
+
+        // Thread of a callback stream: call the callback every period until
+        // the stream is stopped or finished.
+        void callbackLoop();
+
+        // Time streams end after in seconds, 0 for no limit.
+        double m_seconds;
+
+        // Settings of the open stream, its period in seconds and the periods
+        // of output it buffers.
+        AudioStreamSettings m_settings;
+        double m_period;
+        unsigned int m_bufferPeriods;
+        bool m_open;
+
+        // Callback (NULL for a blocking stream) and its user data.
+        AudioCallback m_callback;
+        void *m_userData;
+
+        // Start of the stream, and the next blocks to read and write.
+        Clock::time_point m_start;
+        uint64_t m_readBlock;
+        uint64_t m_writeBlock;
+
+        // Device buffers of the callback, and one block of samples at full
+        // scale 1 for conversion.
+        std::unique_ptr<uint8_t[]> m_input;
+        std::unique_ptr<uint8_t[]> m_output;
+        std::unique_ptr<float[]> m_unit;
+
+        // Phase of the input tone in radians.
+        double m_phase;
+
+        // Start of the first stream, once there has been one.
+        Clock::time_point m_firstStart;
+        bool m_started;
+
+        // Thread of a callback stream, cleared to stop it, and set while the
+        // stream runs.
+        std::thread m_thread;
+        std::atomic<bool> m_running;
+        std::atomic<bool> m_active;
+};
@@ -0,0 +1,85 @@
+#include "offlinerenderer.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include "sampleformat.h"
+#include "wavfile.h"
+
+// Sound effects work on samples in 16 bit integer range.
+#define FLOAT_SCALE 32768.0f
+
+
+OfflineRenderer::OfflineRenderer()
+        : m_idxF(0) {
+}
+
+bool OfflineRenderer::render(const char *inPath, const char *outPath) {
+    WavFile in;
+    if (!in.openRead(inPath))
+        return false;
+    if (in.channels() < 1 || in.channels() > MAX_CHANNELS) {
+        fprintf(stderr, "%s: unsupported number of channels (%d)\n", inPath, in.channels());
+        return false;
+    }
+
+    WavFile out;
+    if (!out.create(outPath, in.format(), in.channels(), in.sampleRate(), in.frames()))
+        return false;
+
+    // Latency does not matter offline, long partitions are cheaper.
+    m_soundProcessor.setBlockSize(BLOCK_LEN / in.channels());
+    m_soundProcessor.initialize(in.sampleRate(), in.channels());
+    m_soundProcessor.setParams(m_params);
+    m_soundProcessor.setFunction(m_idxF);
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    renderFrames(m_soundProcessor, in, out, 0, 0, in.frames(), m_block);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    double seconds = std::max(elapsed.count(), 1e-9);
+    size_t total = in.frames() * in.channels();
+    double audioSeconds = (double)in.frames() / in.sampleRate();
+    printf("Rendered %zu samples (%.2f s of audio) with %s in %.3f s\n",
+           total, audioSeconds, kCoreProcesses[m_idxF].c_str(), elapsed.count());
+    printf("Throughput: %.0f samples/s (%.1fx real time)\n",
+           total / seconds, audioSeconds / seconds);
+    if (m_soundProcessor.latency() > 0)
+        printf("Latency: %zu frames (the output lags the input)\n", m_soundProcessor.latency());
+    return true;
+}
+
+void OfflineRenderer::renderFrames(SoundProcessor &processor, const WavFile &in, WavFile &out,
+                                   size_t begin, size_t writeBegin, size_t end, float *block) {
+    // Samples are interleaved, blocks hold whole frames.
+    int channels = in.channels();
+    size_t blockFrames = BLOCK_LEN / channels;
+    for (size_t frame = begin; frame < end; frame += blockFrames) {
+        size_t frames = std::min(blockFrames, end - frame);
+        size_t pos = frame * channels;
+        size_t n = frames * channels;
+
+        if (in.format() == WAV_FLOAT32) {
+            const float *src = (const float*)in.data() + pos;
+            for (size_t i = 0; i < n; i++)
+                block[i] = src[i] * FLOAT_SCALE;
+        } else {
+            SampleTraits<int16_t>::toFloat(block, (const int16_t*)in.data() + pos, n);
+        }
+
+        processor.processBlock(block, block, frames);
+
+        // Warm-up frames are processed but not written.
+        size_t skip = frame < writeBegin ? std::min(writeBegin - frame, frames) * channels : 0;
+        if (out.format() == WAV_FLOAT32) {
+            float *dst = (float*)out.data() + pos;
+            for (size_t i = skip; i < n; i++)
+                dst[i] = block[i] * (1.0f / FLOAT_SCALE);
+        } else {
+            SampleTraits<int16_t>::fromFloat((int16_t*)out.data() + pos + skip, block + skip, n - skip);
+        }
+    }
+}
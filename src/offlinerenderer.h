@@ -0,0 +1,60 @@
+#pragma once
+
+// Include audio or sound effects producing class.
+#include "soundprocessor.h"
+
+class WavFile;
+
+// OfflineRenderer
+//
+// Renders a WAV file through a sound effect without any audio device.
+// The input file is memory-mapped and streamed through SoundProcessor in large
+// blocks, and the output is written into a preallocated memory-mapped file, so
+// nothing is allocated per block and rendering runs as fast as the CPU allows.
+class OfflineRenderer {
+    public:
+        OfflineRenderer();
+
+        // Select the audio/sound effect function.
+        // idxF: Index to the sound effect or dsp function (see kCoreProcesses).
+        void setFunction(int idxF) { m_idxF = idxF; }
+
+        // Set the effect parameters (see EffectParams).
+        void setParams(const EffectParams &params) { m_params = params; }
+
+        // Set the impulse response of Convolution Reverb (NULL for the synthetic room).
+        void setImpulseResponse(std::shared_ptr<const ImpulseResponse> ir) {
+            m_soundProcessor.setImpulseResponse(ir);
+        }
+
+        // Render a WAV file through the selected effect.
+        // The output has the same sample format, channels and sample rate as the input.
+        // inPath: path of the input WAV file (up to MAX_CHANNELS channels, 16 bit PCM or 32 bit float).
+        // outPath: path of the output WAV file.
+        // Returns true on success. Prints the throughput at the end.
+        bool render(const char *inPath, const char *outPath);
+
+        // Number of samples processed per SoundProcessor::processBlock call.
+        enum { BLOCK_LEN = 16384 };
+
+        // Stream frames [begin, end) of in through processor into the same
+        // frames of out. Only frames from writeBegin on are written, the ones
+        // before it just warm up the effect history.
+        // processor: initialized for the sample rate and channels of the files.
+        // block: scratch of BLOCK_LEN samples.
+        static void renderFrames(SoundProcessor &processor, const WavFile &in, WavFile &out,
+                                 size_t begin, size_t writeBegin, size_t end, float *block);
+
+    private:
+        // Index for sound effect or dsp function (see kCoreProcesses).
+        int m_idxF;
+
+        // Effect parameters.
+        EffectParams m_params;
+
+        // Block of samples being converted and processed.
+        float m_block[BLOCK_LEN];
+
+        // Audio or sound effect producer (object).
+        SoundProcessor m_soundProcessor;
+};
@@ -0,0 +1,181 @@
+#include "oversampler.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "simdkernels.h"
+
+#define OVERSAMPLER_PI 3.14159265358979323846
+
+// Half size K (the filter has 4K - 1 taps) and Kaiser window beta of the
+// filter of each doubling. The first one keeps about 19 kHz of a 44.1 kHz
+// signal with some 80 dB of image and alias rejection, the later ones have
+// several times more room and the same rejection with far fewer taps.
+static const int kStageHalf[] = {16, 6, 6};
+static const double kStageBeta[] = {7.0, 7.0, 7.0};
+
+// Modified Bessel function of the first kind, order 0 (series).
+static double besselI0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Taps h[0], h[2], ... h[4K - 2] of a Kaiser windowed half-band filter of
+// 4K - 1 taps (the others are 0 apart from the centre one, 1/2), scaled so
+// that they sum to 1/2, which makes the gain at DC exactly 1.
+static std::vector<double> halfBandTaps(int K, double beta) {
+    int centre = 2 * K - 1;
+    std::vector<double> taps(2 * K);
+    double sum = 0;
+    for (int j = 0; j < 2 * K; j++) {
+        double t = (2 * j - centre) / 2.0;
+        double r = (2.0 * j - centre) / centre;
+        double window = besselI0(beta * sqrt(std::max(0.0, 1 - r * r))) / besselI0(beta);
+        taps[j] = 0.5 * sin(OVERSAMPLER_PI * t) / (OVERSAMPLER_PI * t) * window;
+        sum += taps[j];
+    }
+    for (double &t : taps)
+        t *= 0.5 / sum;
+    return taps;
+}
+
+Oversampler::Oversampler()
+        : m_factor(1),
+          m_channels(0),
+          m_numStages(0) {
+}
+
+void Oversampler::initialize(int factor, int channels) {
+    m_factor = 1;
+    m_numStages = 0;
+    while (m_factor < factor && m_numStages < MAX_STAGES) {
+        m_factor *= 2;
+        m_numStages++;
+    }
+    m_channels = channels;
+
+    int maxTaps = 0;
+    for (int s = 0; s < m_numStages; s++) {
+        Stage &stage = m_stages[s];
+        int K = kStageHalf[s];
+        std::vector<double> taps = halfBandTaps(K, kStageBeta[s]);
+        stage.taps = 2 * K;
+        stage.upTaps.resize(2 * K);
+        stage.downTaps.resize(2 * K);
+        for (int j = 0; j < 2 * K; j++) {
+            stage.upTaps[j] = (float)(2 * taps[j]);
+            stage.downTaps[j] = (float)taps[j];
+        }
+        stage.upHistory.assign(channels * (2 * K - 1), 0.0f);
+        stage.evenHistory.assign(channels * (2 * K - 1), 0.0f);
+        stage.oddHistory.assign(channels * K, 0.0f);
+        maxTaps = std::max(maxTaps, 2 * K);
+    }
+
+    size_t len = BLOCK_LEN * (size_t)m_factor;
+    m_block.reset(new float[len]);
+    m_between.reset(new float[len]);
+    m_work.reset(new float[maxTaps + len / 2]);
+    m_odd.reset(new float[maxTaps + len / 2]);
+    m_phase.reset(new float[len / 2 + 1]);
+}
+
+void Oversampler::reset() {
+    for (int s = 0; s < m_numStages; s++) {
+        Stage &stage = m_stages[s];
+        std::fill(stage.upHistory.begin(), stage.upHistory.end(), 0.0f);
+        std::fill(stage.evenHistory.begin(), stage.evenHistory.end(), 0.0f);
+        std::fill(stage.oddHistory.begin(), stage.oddHistory.end(), 0.0f);
+    }
+}
+
+double Oversampler::latency() const {
+    // Doubling s delays by the centre tap, 2K - 1 samples at twice its
+    // input rate, on the way up and again on the way down.
+    double latency = 0;
+    for (int s = 0; s < m_numStages; s++)
+        latency += (2 * kStageHalf[s] - 1) / (double)(1 << s);
+    return latency;
+}
+
+size_t Oversampler::memory() const {
+    // Each filter spans 4K - 1 samples at twice the input rate of its
+    // doubling, once up and once down.
+    size_t memory = 0;
+    for (int s = 0; s < m_numStages; s++)
+        memory += ((4 * kStageHalf[s] - 1) >> s) + 1;
+    return memory;
+}
+
+float* Oversampler::up(int ch, const float *x, size_t n) {
+    if (m_numStages == 0) {
+        memcpy(m_block.get(), x, n * sizeof(float));
+        return m_block.get();
+    }
+
+    // Every stage but the last writes between blocks, so that the last one
+    // ends in m_block.
+    const float *in = x;
+    for (int s = 0; s < m_numStages; s++) {
+        float *out = (m_numStages - s) % 2 == 1 ? m_block.get() : m_between.get();
+        upStage(m_stages[s], ch, in, out, n << s);
+        in = out;
+    }
+    return m_block.get();
+}
+
+void Oversampler::down(int ch, const float *v, float *y, size_t n) {
+    if (m_numStages == 0) {
+        memcpy(y, v, n * sizeof(float));
+        return;
+    }
+
+    const float *in = v;
+    for (int s = m_numStages - 1; s >= 0; s--) {
+        float *out = s == 0 ? y : (in == m_between.get() ? m_block.get() : m_between.get());
+        downStage(m_stages[s], ch, in, out, n << s);
+        in = out;
+    }
+}
+
+void Oversampler::upStage(Stage &stage, int ch, const float *in, float *out, size_t m) {
+    // out[2i] = sum of upTaps[j] * in[i - j], out[2i + 1] = in[i - K + 1].
+    const SimdKernels &k = simdKernels();
+    int history = stage.taps - 1;
+    float *hist = stage.upHistory.data() + ch * history;
+    float *work = m_work.get();
+    memcpy(work, hist, history * sizeof(float));
+    memcpy(work + history, in, m * sizeof(float));
+
+    k.fir(m_phase.get(), work + history, stage.upTaps.data(), stage.taps, m);
+    const float *phases[2] = {m_phase.get(), work + history - (stage.taps / 2 - 1)};
+    k.interleave(out, phases, 2, m);
+
+    memcpy(hist, work + m, history * sizeof(float));
+}
+
+void Oversampler::downStage(Stage &stage, int ch, const float *in, float *out, size_t m) {
+    // out[i] = sum of downTaps[j] * in[2(i - j)] + in[2(i - K) + 1] / 2.
+    const SimdKernels &k = simdKernels();
+    int half = stage.taps / 2;
+    int history = stage.taps - 1;
+    float *evenHist = stage.evenHistory.data() + ch * history;
+    float *oddHist = stage.oddHistory.data() + ch * half;
+    float *even = m_work.get();
+    float *odd = m_odd.get();
+    memcpy(even, evenHist, history * sizeof(float));
+    memcpy(odd, oddHist, half * sizeof(float));
+    float *phases[2] = {even + history, odd + half};
+    k.deinterleave(phases, in, 2, m);
+
+    k.fir(out, even + history, stage.downTaps.data(), stage.taps, m);
+    k.mix2(out, out, odd, 1.0f, 0.5f, 1.0f, m);
+
+    memcpy(evenHist, even + m, history * sizeof(float));
+    memcpy(oddHist, odd + m, half * sizeof(float));
+}
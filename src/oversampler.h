@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Oversampler
+//
+// Runs a nonlinear effect (e.g. Fuzz) at 2, 4 or 8 times the sample rate, so
+// that the harmonics it creates above Nyquist are filtered out instead of
+// aliasing back into the audible band.
+// Each doubling is a half-band FIR filter in polyphase form: every other tap
+// of a half-band filter is zero except the centre one (1/2), so upsampling
+// filters only the even outputs (the odd ones are the input delayed) and
+// downsampling filters only the even inputs (the odd ones are just added
+// delayed). The first doubling has a sharp filter, the later ones only have
+// to remove images far above the audible band and are much shorter.
+// Filters run a whole block at a time on the SIMD kernels.
+//
+// Usage per channel and block: v = up(ch, x, n), process the n * factor()
+// samples of v in place, down(ch, v, y, n).
+class Oversampler {
+    public:
+        // Most input samples per up() or down() call.
+        enum { BLOCK_LEN = 1024 };
+
+        Oversampler();
+
+        // Set the oversampling factor (1, 2, 4 or 8) and number of channels.
+        // Allocates and clears the filter history.
+        void initialize(int factor, int channels);
+
+        // Returns the oversampling factor.
+        int factor() const { return m_factor; }
+
+        // Clear the filter history of every channel.
+        void reset();
+
+        // Returns the delay of down(up(x)) in input samples (can be fractional).
+        double latency() const;
+
+        // Returns the number of past input samples the output depends on.
+        size_t memory() const;
+
+        // Upsample n (<= BLOCK_LEN) samples x of channel ch.
+        // Returns n * factor() samples, valid until the next call to up().
+        float* up(int ch, const float *x, size_t n);
+
+        // Downsample n * factor() samples v of channel ch into n samples y
+        // (y can be the input of the up() call that returned v).
+        void down(int ch, const float *v, float *y, size_t n);
+
+    private:
+        // Most doublings (8x).
+        enum { MAX_STAGES = 3 };
+
+        // One doubling.
+        struct Stage {
+            // Number of nonzero taps of the filtered phase (2K for a
+            // half-band filter of 4K - 1 taps), and the taps of each way:
+            // up has twice the gain, to make up for the zeros in between.
+            int taps;
+            std::vector<float> upTaps;
+            std::vector<float> downTaps;
+
+            // History of each channel: input of up, even and odd input of down.
+            std::vector<float> upHistory;
+            std::vector<float> evenHistory;
+            std::vector<float> oddHistory;
+        };
+
+        // Double the rate of m samples in to 2m samples out.
+        void upStage(Stage &stage, int ch, const float *in, float *out, size_t m);
+
+        // Halve the rate of 2m samples in to m samples out.
+        void downStage(Stage &stage, int ch, const float *in, float *out, size_t m);
+
+        int m_factor;
+        int m_channels;
+
+        // Doublings, from the input rate up.
+        Stage m_stages[MAX_STAGES];
+        int m_numStages;
+
+        // Oversampled block of up() and the blocks between stages.
+        std::unique_ptr<float[]> m_block;
+        std::unique_ptr<float[]> m_between;
+
+        // Filter input with its history in front, and the filtered phase.
+        std::unique_ptr<float[]> m_work;
+        std::unique_ptr<float[]> m_odd;
+        std::unique_ptr<float[]> m_phase;
+};
@@ -1,279 +1,748 @@
+#include <chrono>
 #include <iostream>
 #include <sstream>
 
 #include "paudiopipe.h"
+#include "denormals.h"
+#include "portaudiobackend.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+// Adaptive mode grows the block size below this p99 headroom (of the phase
+// that has to meet the deadline), and may shrink it above the other.
+static const double kAdaptGrowHeadroom = 0.3;
+static const double kAdaptShrinkHeadroom = 0.6;
+
+// Monotonic time in nanoseconds, cheap enough to call on the audio thread.
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 PAudioPipe::PAudioPipe()
-        : sampleFormat(paInt16),
-          sampleSizeInBytes(2),
+        : PAudioPipe(std::unique_ptr<AudioBackend>(new PortAudioBackend())) {
+}
+
+PAudioPipe::PAudioPipe(std::unique_ptr<AudioBackend> backend)
+        : backend(std::move(backend)),
+          sampleFormat(SAMPLE_INT16),
           numChannels(1),
           framesPerBuffer(4),
           sampleRate(44100),
-          inputDevice(-1),
-          outputDevice(-1) {
+          deviceRate(0),
+          lowLatency(false),
+          selectedEffect(-1),
+          interactive(true),
+          denormalSafe(false),
+          silenceBypass(false),
+          resamplingDelay(0),
+          streamMode(STREAM_BLOCKING),
+          dither(false),
+          dspRunning(false),
+          roundTripLatency(0),
+          ringUnderflows(0),
+          ringOverflows(0),
+          inputOverflows(0),
+          outputUnderflows(0),
+          adaptive(false),
+          adaptFrames(0),
+          adaptFloor(0),
+          adaptGoodWindows(0),
+          adaptSettled(false),
+          adaptWindowEnd(0),
+          adaptMisses(0),
+          adaptWarmUp(false),
+          analysis(false),
+          analysisFile(NULL),
+          statsFile(NULL),
+          statsPeriodMs(5000),
+          statsRunning(false) {
     initialize();
 }
 
 PAudioPipe::~PAudioPipe() {
-    Pa_Terminate();
+    stopStats();
+    if (statsFile != NULL && statsFile != stdout)
+        fclose(statsFile);
+    analysisTap.reset();
+    if (analysisFile != NULL && analysisFile != stdout)
+        fclose(analysisFile);
+    backend->close();
 }
 
 void PAudioPipe::start() {
-    m_soundProcessor.setFunction(printOptionsAndSelect());
-    std::cout << m_soundProcessor.option() << std::endl;
-    startStream();
-}
+    // Adaptive mode starts aggressive and backs off.
+    lowLatency = adaptive || streamMode != STREAM_BLOCKING;
+    if (adaptive) {
+        setFramesPerBuffer(std::min(std::max(framesPerBuffer, (unsigned int)ADAPT_MIN_FRAMES),
+                                    (unsigned int)ADAPT_MAX_FRAMES));
+        adaptLast.reset(new LatencyHistogram::Snapshot());
+        adaptNow.reset(new LatencyHistogram::Snapshot());
+        adaptWindow.reset(new LatencyHistogram::Snapshot());
+    }
 
-void PAudioPipe::stop() {
+    // The block size of the effects depends on the device rate.
+    setupResampling();
+    m_soundProcessor.setAntiDenormal(denormalSafe && !canFlushDenormals());
+    m_soundProcessor.setFunction(selectedEffect >= 0 ? selectedEffect : printOptionsAndSelect());
+    if (interactive) {
+        std::cout << m_soundProcessor.option() << std::endl;
+        printEffectLatency();
+    }
+
+    // Levels (e.g. the fuzz threshold) are relative to full scale, which is 1
+    // for float samples and the 16 bit range for integer samples.
+    EffectParams params = m_soundProcessor.params();
+    params.fullScale = sampleFormat == SAMPLE_FLOAT32 ? SampleTraits<float>::kFullScale
+                                                 : SampleTraits<int16_t>::kFullScale;
+    m_soundProcessor.setParams(params);
+
+    // The meters run at the effect rate, whatever the device rate.
+    if (analysis) {
+        analysisTap.reset(new AnalysisTap(sampleRate, numChannels, params.fullScale));
+        analysisTap->setOutput(analysisFile);
+        analysisTap->start();
+        shownMeters.reset(new AnalysisMeters());
+        shownMeters->time = 0;
+    }
 
-    PaError err = 0;
+    // Effects can be changed while streaming. The control thread blocks on
+    // standard input, so it is left running until the program exits.
+    if (interactive)
+        std::thread(&PAudioPipe::controlLoop, this).detach();
 
-    if(!Pa_IsStreamStopped(stream))
-        err = Pa_StopStream( stream );
+    startStream();
+    if (analysisTap)
+        analysisTap->stop();
+}
 
-    if( err !=  paNoError)
-        reportStreamError(err);
+void PAudioPipe::stop() {
+    backend->stop();
 }
 
 void PAudioPipe::terminate() {
-    Pa_Terminate();
+    backend->close();
 }
 
-void PAudioPipe::setSampleFormat(PaSampleFormat format) {
+void PAudioPipe::setSampleFormat(SampleFormat format) {
     sampleFormat = format;
 }
 
-void PAudioPipe::setInputDevice(unsigned int &index) {
-    int numdevices = 0;
-    numdevices = Pa_GetDeviceCount();
-    if(numdevices == 0){
-        printf("\nNo devices found\n");
-        return;
+bool PAudioPipe::setStatsFile(const char *path) {
+    FILE *file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
     }
-    if(index >= numdevices){
-        printf("\nInvalid index\n");
-        return;
+    if (statsFile != NULL && statsFile != stdout)
+        fclose(statsFile);
+    statsFile = file;
+    return true;
+}
+
+bool PAudioPipe::setAnalysisFile(const char *path) {
+    FILE *file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
     }
-    const PaDeviceInfo* info = Pa_GetDeviceInfo(index);
-    if(info == NULL){
-         printf("\nNInvalid index\n");
-        return;
+    if (analysisFile != NULL && analysisFile != stdout)
+        fclose(analysisFile);
+    analysisFile = file;
+    analysis = true;
+    return true;
+}
+
+void PAudioPipe::setNumChannels(unsigned int channels) {
+    numChannels = std::min(std::max(channels, 1u), (unsigned int)MAX_CHANNELS);
+    // Every channel keeps its own effect state.
+    m_soundProcessor.initialize(sampleRate, numChannels);
+}
+
+void PAudioPipe::setSampleRate(unsigned int rate) {
+    sampleRate = rate;
+    m_soundProcessor.initialize(sampleRate, numChannels);
+}
+
+void PAudioPipe::setInputDevice(unsigned int index) {
+    backend->setInputDevice(index);
+}
+
+void PAudioPipe::setOutputDevice(unsigned int index) {
+    backend->setOutputDevice(index);
+}
+
+void PAudioPipe::listDevices() {
+    backend->listDevices();
+}
+
+void PAudioPipe::getDeviceInfo(unsigned int index) {
+    backend->printDeviceInfo(index);
+}
+
+void PAudioPipe::startStream() {
+    if (sampleFormat == SAMPLE_INT24)
+        runStream<Int24>();
+    else if (sampleFormat == SAMPLE_INT32)
+        runStream<int32_t>();
+    else if (sampleFormat == SAMPLE_FLOAT32)
+        runStream<float>();
+    else
+        runStream<int16_t>();
+}
+
+void PAudioPipe::setupResampling() {
+    if (deviceRate == 0) {
+        unsigned int native = backend->nativeRate();
+        deviceRate = native > 0 ? native : sampleRate;
     }
-    if(info->maxInputChannels == 0){
-         printf("\nInvalid index\n");
+    if (deviceRate == sampleRate) {
+        inResampler.reset();
+        outResampler.reset();
         return;
     }
-    inputDevice = index;
-    printf("\nInput device set to: %u: %s\n", index, info->name);
+
+    inResampler.reset(new Resampler());
+    inResampler->initialize(deviceRate, sampleRate, numChannels);
+    outResampler.reset(new Resampler());
+    outResampler->initialize(sampleRate, deviceRate, numChannels);
+    size_t effectFrames = inResampler->maxOutput(framesPerBuffer);
+    effectRateBlock.reset(new float[effectFrames * numChannels]);
+    deviceRateBlock.reset(new float[outResampler->maxOutput(effectFrames) * numChannels]);
+    m_soundProcessor.setBlockSize(effectFrames);
+
+    // Each resampler holds back its latency, the output one at the effect
+    // rate; a couple more frames cover the rounding of the frame counts.
+    resamplingDelay = inResampler->latency() +
+                      (unsigned int)ceil((double)outResampler->latency() * deviceRate / sampleRate) + 2;
+    resampledRing.reset(new SpscRing<float>((resamplingDelay + 2 * framesPerBuffer + 8) * numChannels));
+    std::vector<float> silence(resamplingDelay * numChannels, 0.0f);
+    resampledRing->write(silence.data(), silence.size());
+
+    if (interactive)
+        printf("Device at %u Hz, effects at %u Hz (resampling adds %.1f ms)\n",
+               deviceRate, sampleRate, 1e3 * resamplingDelay / deviceRate);
 }
 
-void PAudioPipe::setOutputDevice(unsigned int &index) {
-    int numdevices = 0;
-    numdevices = Pa_GetDeviceCount();
-    if(numdevices == 0){
-        printf("\nNo devices found\n");
-        return;
-    }
-    if(index >= numdevices){
-        printf("\nInvalid index\n");
+void PAudioPipe::processDeviceBlock(const float *input, float *output, unsigned long n) {
+    AnalysisTap *tap = analysisTap.get();
+    if (!inResampler) {
+        if (tap)
+            tap->pushInput(input, n);
+        m_soundProcessor.processBlock(input, output, n);
+        if (tap)
+            tap->pushOutput(output, n);
         return;
     }
-    const PaDeviceInfo* info = Pa_GetDeviceInfo(index);
-    if(info == NULL){
-         printf("\nNInvalid index\n");
-        return;
+    size_t frames = inResampler->process(input, n, effectRateBlock.get());
+    if (tap)
+        tap->pushInput(effectRateBlock.get(), frames);
+    m_soundProcessor.processBlock(effectRateBlock.get(), effectRateBlock.get(), frames);
+    if (tap)
+        tap->pushOutput(effectRateBlock.get(), frames);
+    frames = outResampler->process(effectRateBlock.get(), frames, deviceRateBlock.get());
+    resampledRing->write(deviceRateBlock.get(), frames * numChannels);
+    size_t got = resampledRing->read(output, n * numChannels);
+    if (got < n * numChannels)
+        memset(output + got, 0, sizeof(float) * (n * numChannels - got));
+}
+
+template <typename Sample>
+void PAudioPipe::runStream() {
+    while (true) {
+        adaptFrames = 0;
+        if (streamMode == STREAM_BLOCKING)
+            runBlockingStream<Sample>();
+        else
+            runCallbackStream<Sample>();
+        if (adaptFrames == 0)
+            break;
+
+        // Buffers and resamplers are sized for the block, and are set up again.
+        setFramesPerBuffer(adaptFrames);
+        setupResampling();
     }
-    if(info->maxOutputChannels == 0){
-         printf("\nInvalid index\n");
+}
+
+void PAudioPipe::startAdapting() {
+    if (!adaptive)
         return;
-    }
-    outputDevice = index;
-    printf("\nOutput device set to: %u: %s\n", index, info->name);
+    adaptWarmUp = true;
+    adaptWindowEnd = nowNs() + (uint64_t)ADAPT_WINDOW_MS * 1000000;
 }
 
-void PAudioPipe::listDevices() {
-    const PaDeviceInfo *info;
-    int numdevices = 0;
-    numdevices = Pa_GetDeviceCount();
-    int defaultin = -1, defaultout = -1;
-
-    if(numdevices <= 0){
-      printf("no devices found\n");
-      return;
+bool PAudioPipe::adaptBlockSize() {
+    // The effects run in this phase, it has to finish within one buffer.
+    LatencyHistogram &timing = streamMode == STREAM_CALLBACK ? callbackTime : processTime;
+    adaptWindowEnd = nowNs() + (uint64_t)ADAPT_WINDOW_MS * 1000000;
+    timing.read(*adaptNow);
+    *adaptWindow = *adaptNow;
+    adaptWindow->subtract(*adaptLast);
+    std::swap(adaptLast, adaptNow);
+    unsigned long misses = deadlineMisses();
+    unsigned long xruns = misses - adaptMisses;
+    adaptMisses = misses;
+
+    // The first window of a stream includes opening it, it only sets the
+    // counts the next one starts from.
+    if (adaptWarmUp) {
+        adaptWarmUp = false;
+        return false;
     }
-    defaultin = Pa_GetDefaultInputDevice();
-    defaultout = Pa_GetDefaultOutputDevice();
-    if(defaultin == paNoDevice){ defaultin = -1;}
-    if(defaultout == paNoDevice){ defaultout = -1;}
-    printf("Devices:\n");
-    for (int i = 0; i < numdevices; i++) {
-        info = Pa_GetDeviceInfo(i);
-        const char* inout = "";
-        if (info->maxInputChannels > 0 && info->maxOutputChannels == 0) {
-            inout = "input";
-        } else if (info->maxInputChannels == 0 && info->maxOutputChannels > 0) {
-            inout = "output";
+
+    double deadlineUs = 1e6 * framesPerBuffer / deviceRate;
+    double headroom = adaptWindow->total > 0 ? 1 - adaptWindow->percentile(0.99) * 1e-3 / deadlineUs : 1;
+    char window[128];
+    snprintf(window, sizeof(window), "Adaptive: %u frames (%.1f ms), p99 headroom %.2f, %lu xruns",
+             framesPerBuffer, 1e-3 * deadlineUs, headroom, xruns);
+
+    if (xruns > 0 || headroom < kAdaptGrowHeadroom) {
+        // Sizes up to this one are not safe any more.
+        adaptGoodWindows = 0;
+        adaptFloor = std::max(adaptFloor, framesPerBuffer);
+        if (framesPerBuffer < ADAPT_MAX_FRAMES) {
+            adaptFrames = framesPerBuffer * 2;
+            printf("%s: growing to %u frames\n", window, adaptFrames);
+        } else if (lowLatency) {
+            lowLatency = false;
+            adaptFrames = framesPerBuffer;
+            printf("%s: largest block, reopening with the safe device latency\n", window);
+        } else {
+            printf("%s: largest block and latency, keeping them\n", window);
         }
+        adaptSettled = false;
+        fflush(stdout);
+        return adaptFrames != 0;
+    }
 
-        if (i == defaultin || i == defaultout){
-            printf("%i: (%s) %s (%s) --default--\n", i, inout, info->name, apiName(info->hostApi));
+    // Only shrink after a few good windows in a row, and never back to a
+    // size that glitched.
+    unsigned int smaller = framesPerBuffer / 2;
+    if (headroom >= kAdaptShrinkHeadroom && smaller >= ADAPT_MIN_FRAMES && smaller > adaptFloor) {
+        if (++adaptGoodWindows >= ADAPT_SETTLE_WINDOWS) {
+            adaptGoodWindows = 0;
+            adaptFrames = smaller;
+            printf("%s: shrinking to %u frames\n", window, adaptFrames);
         } else {
-            printf("%i: (%s) %s (%s)\n", i, inout, info->name, apiName(info->hostApi));
+            printf("%s: good (%u of %d)\n", window, adaptGoodWindows, (int)ADAPT_SETTLE_WINDOWS);
         }
+        fflush(stdout);
+        return adaptFrames != 0;
     }
+
+    // Settled: only the first window that settles is logged.
+    adaptGoodWindows = 0;
+    if (!adaptSettled)
+        printf("%s: settled\n", window);
+    adaptSettled = true;
+    fflush(stdout);
+    return false;
 }
 
-void PAudioPipe::getDeviceInfo(unsigned int &index) {
-    const PaDeviceInfo *info;
-    int numdevices = 0;
-    numdevices = Pa_GetDeviceCount();
-    int defaultin = -1, defaultout = -1;
+bool PAudioPipe::openStream(AudioCallback callback) {
+    AudioStreamSettings settings;
+    settings.channels = numChannels;
+    settings.sampleRate = deviceRate;
+    settings.framesPerBuffer = framesPerBuffer;
+    settings.format = sampleFormat;
+    settings.lowLatency = lowLatency;
+    return backend->open(settings, callback, callback != NULL ? this : NULL);
+}
 
-    if(numdevices <= 0){
-        printf("no devices found\n");
+template <typename Sample>
+void PAudioPipe::runBlockingStream() {
+    AudioStatus status;
+
+    if (!openStream(NULL))
         return;
-    }
-    if(index >= numdevices ){
-        printf("invalid index\n");
+
+    unsigned int numSamples = framesPerBuffer * numChannels;
+    std::unique_ptr<Sample[]> sampleBlock (new Sample[numSamples]);
+
+    // Integer samples are converted to float and processed one block at a
+    // time, float samples are processed in place in the device buffer.
+    std::unique_ptr<float[]> floatBlock;
+    if (!SampleTraits<Sample>::kNative)
+        floatBlock.reset(new float[numSamples]);
+
+    if (!backend->start())
         return;
-    }
 
-    info = Pa_GetDeviceInfo(index);
-    printf("\nDevice: (%u)\n", index);
-    printf("%s\n", info->name);
-    printf("API: %s\n", apiName(info->hostApi));
-    printf("Input channels: %i\n", info->maxInputChannels);
-    printf("Output channels: %i\n", info->maxOutputChannels);
-    printf("Default sampling rate (Hz): %f\n", info->defaultSampleRate);
-    printf("Default low input latency (s): %f\n", info->defaultLowInputLatency);
-    printf("Default low input latency (s): %f\n", info->defaultLowOutputLatency);
-    printf("Default high input latency (s): %f\n", info->defaultHighInputLatency);
-    printf("Default high output latency (s): %f\n", info->defaultHighOutputLatency);
-}
+    ScopedFlushDenormals flushDenormals(denormalSafe);
+    startStats();
+    startAdapting();
+     while (true) {
 
-void PAudioPipe::startStream() {
-    PaError err;
-    PaStreamParameters outputParameters;
-    PaStreamParameters inputParameters;
-
-    // -set parameters
-    if(outChannels > 0) {
-        if( outputDevice < 0) {
-            outputParameters.device = Pa_GetDefaultOutputDevice(); /* default output device */
+        uint64_t readStart = nowNs();
+        status = backend->read(sampleBlock.get(), framesPerBuffer);
+        uint64_t processStart = nowNs();
+        // Overflows and underflows lose samples but the stream goes on,
+        // its end and errors end the loop.
+        if (status == AUDIO_INPUT_OVERFLOW)
+            inputOverflows++;
+        else if (status != AUDIO_OK)
+            break;
+
+        // Read samples (interleaved frames) from the buffer and put them back
+        // after processing.
+        if constexpr (SampleTraits<Sample>::kNative) {
+            processDeviceBlock(sampleBlock.get(), sampleBlock.get(), framesPerBuffer);
         } else {
-            outputParameters.device = outputDevice;
+            float *samples = floatBlock.get();
+            SampleTraits<Sample>::toFloat(samples, sampleBlock.get(), numSamples);
+            processDeviceBlock(samples, samples, framesPerBuffer);
+            fromFloat(sampleBlock.get(), samples, numSamples);
         }
-        if (outputParameters.device == paNoDevice) {
-         fprintf(stderr,"\nError: No default output device.\n");
-         exit(1);
+        uint64_t writeStart = nowNs();
+        status = backend->write(sampleBlock.get(), framesPerBuffer);
+        uint64_t writeEnd = nowNs();
+        if (status == AUDIO_OUTPUT_UNDERFLOW)
+            outputUnderflows++;
+        else if (status != AUDIO_OK)
+            break;
+
+        readTime.record(processStart - readStart);
+        processTime.record(writeStart - processStart);
+        writeTime.record(writeEnd - writeStart);
+
+        if (adaptive && writeEnd >= adaptWindowEnd && adaptBlockSize())
+            break;
+    }
+    stopStats();
+    backend->close();
+}
+
+template <typename Sample>
+void PAudioPipe::runCallbackStream() {
+    unsigned int blockLen = framesPerBuffer * numChannels;
+
+    // Everything the audio thread touches is allocated before the stream starts.
+    // Float samples need no conversion buffer.
+    if (!SampleTraits<Sample>::kNative)
+        callbackBlock.reset(new float[blockLen]);
+    if (streamMode == STREAM_DSP_THREAD) {
+        // Room for several callbacks worth of samples in each direction, and
+        // two blocks of silence queued as output so that the callback does
+        // not starve while the DSP thread processes the first block.
+        unsigned int ringLen = std::max(16 * blockLen, 4096u);
+        inRing.reset(new SpscRing<float>(ringLen));
+        outRing.reset(new SpscRing<float>(ringLen));
+        dspBlock.reset(new float[blockLen]);
+        memset(dspBlock.get(), 0, sizeof(float) * blockLen);
+        for (int i = 0; i < 2; i++)
+            outRing->write(dspBlock.get(), blockLen);
+
+        dspRunning = true;
+        dspThread = std::thread(&PAudioPipe::dspLoop, this);
+    }
+
+    startStats();
+    if (openStream(&PAudioPipe::streamCallback<Sample>) && backend->start()) {
+        // The audio thread does all the work, report latency every few
+        // seconds. Short sleeps, so that the end of the stream is noticed soon.
+        int reportPeriodMs = 5000;
+        int pollMs = 50;
+        int sinceReportMs = 0;
+        startAdapting();
+        while (backend->isActive()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(pollMs));
+            sinceReportMs += pollMs;
+            if (sinceReportMs >= reportPeriodMs) {
+                sinceReportMs = 0;
+                if (interactive)
+                    reportLatency();
+            }
+            if (adaptive && nowNs() >= adaptWindowEnd && adaptBlockSize())
+                break;
         }
-        outputParameters.channelCount = outChannels;
-        outputParameters.sampleFormat = sampleFormat;
-        outputParameters.suggestedLatency = Pa_GetDeviceInfo( outputParameters.device )->defaultHighOutputLatency;
-        outputParameters.hostApiSpecificStreamInfo = NULL;
     }
+    backend->close();
+
+    if (streamMode == STREAM_DSP_THREAD) {
+        dspRunning = false;
+        dspThread.join();
+    }
+    stopStats();
+}
+
+template <typename Sample>
+void PAudioPipe::streamCallback(const void *input, void *output, unsigned long frameCount,
+                                const AudioTime &time, unsigned int flags, void *userData) {
+    PAudioPipe *pipe = (PAudioPipe*)userData;
+    uint64_t start = nowNs();
+    // The thread belongs to the backend, so the mode is only set for the
+    // callback.
+    ScopedFlushDenormals flushDenormals(pipe->denormalSafe);
+    if (flags & AUDIO_FLAG_INPUT_OVERFLOW)
+        pipe->inputOverflows++;
+    if (flags & AUDIO_FLAG_OUTPUT_UNDERFLOW)
+        pipe->outputUnderflows++;
+    pipe->processCallback((const Sample*)input, (Sample*)output, frameCount, time);
+    pipe->callbackTime.record(nowNs() - start);
+}
 
-    if(inChannels > 0) {
-        if( inputDevice < 0) {
-            inputParameters.device = Pa_GetDefaultInputDevice(); /* default input device */
+template <typename Sample>
+void PAudioPipe::processCallback(const Sample *input, Sample *output, unsigned long frameCount,
+                                 const AudioTime &time) {
+    unsigned long blockLen = framesPerBuffer * numChannels;
+    unsigned long total = frameCount * numChannels;
+    double queued = 0;
+
+    // Backends pass framesPerBuffer frames, but never rely on it.
+    for (unsigned long pos = 0; pos < total; pos += blockLen) {
+        unsigned long n = std::min(blockLen, total - pos);
+
+        if constexpr (SampleTraits<Sample>::kNative) {
+            // Float samples go straight from and to the device buffers.
+            if (input == NULL)
+                memset(output + pos, 0, sizeof(float) * n);
+            exchangeBlock(input != NULL ? input + pos : output + pos, output + pos, n);
         } else {
-            inputParameters.device = inputDevice;
+            float *samples = callbackBlock.get();
+            if (input != NULL)
+                SampleTraits<Sample>::toFloat(samples, input + pos, n);
+            else
+                memset(samples, 0, sizeof(float) * n);
+            exchangeBlock(samples, samples, n);
+            fromFloat(output + pos, samples, n);
         }
-        if (inputParameters.device == paNoDevice) {
-          fprintf(stderr,"\nError: No default input device.\n");
-          exit(1);
-        }
-        inputParameters.channelCount = inChannels;
-        inputParameters.sampleFormat = sampleFormat;
-        inputParameters.suggestedLatency = Pa_GetDeviceInfo( inputParameters.device )->defaultHighInputLatency;
-        inputParameters.hostApiSpecificStreamInfo = NULL;
     }
 
-    err = Pa_OpenStream (
-                &stream,
-                &inputParameters,
-                &outputParameters,
-                sampleRate,
-                framesPerBuffer,
-                paClipOff,
-                NULL,
-                NULL );
-
-    if( err != paNoError )
-        reportStreamError(err);
-
-    int numBytes = framesPerBuffer * numChannels * sampleSizeInBytes;
-    std::shared_ptr<char> sampleBlock (new char[numBytes]);
-    if (sampleBlock == NULL) {
-        printf("Could not allocate record array.\n");
-        exit(1);
-    }
+    if (streamMode == STREAM_DSP_THREAD)
+        queued = (double)(inRing->readAvailable() + outRing->readAvailable()) / (numChannels * deviceRate);
+    // Some host APIs do not report buffer times.
+    if (time.inputAdc > 0 && time.outputDac > 0)
+        roundTripLatency = time.outputDac - time.inputAdc + queued;
+}
 
-    err = Pa_StartStream( stream );
-    if( err != paNoError )
-        reportStreamError(err);
+void PAudioPipe::exchangeBlock(const float *input, float *output, unsigned long n) {
+    if (streamMode == STREAM_CALLBACK) {
+        processDeviceBlock(input, output, n / numChannels);
+        return;
+    }
+    if (inRing->write(input, n) < n)
+        ringOverflows++;
+    size_t got = outRing->read(output, n);
+    if (got < n) {
+        ringUnderflows++;
+        memset(output + got, 0, sizeof(float) * (n - got));
+    }
+}
 
-     while (true) {
+template <typename Sample>
+void PAudioPipe::fromFloat(Sample *output, float *samples, unsigned long n) {
+    if (dither)
+        ditherNoise.apply(samples, n, SampleTraits<Sample>::kLsb);
+    SampleTraits<Sample>::fromFloat(output, samples, n);
+}
 
-        err = Pa_ReadStream(stream, sampleBlock.get(), framesPerBuffer);
-        if (err)
-            reportStreamError(err);
+void PAudioPipe::controlLoop() {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::istringstream command(line);
+        std::string name;
+        double value;
+        if (!(command >> name))
+            continue;
+
+        if (name == "meters") {
+            printMeters();
+            continue;
+        }
 
-        char *currentBlock = sampleBlock.get();
+        if (!(command >> value)) {
+            // A lone number selects another effect.
+            char *end;
+            long idxF = strtol(name.c_str(), &end, 10);
+            if (*end != '\0' || idxF < 0 || idxF >= kNumCoreProcesses) {
+                printf("Unknown effect: %s\n", name.c_str());
+                continue;
+            }
+            m_soundProcessor.setFunction((int)idxF);
+            printf("Effect: %s\n", kCoreProcesses[idxF].c_str());
+            printEffectLatency();
+            continue;
+        }
 
-        // Read samples from the buffer and put them back after processing.
-        for (int i = 0; i < framesPerBuffer; i++) {
-            int16_t tmp = *((int16_t*)(currentBlock));
-            *((int16_t*)(currentBlock)) = (int16_t) m_soundProcessor.process( (float)tmp );
-            currentBlock += sampleSizeInBytes;
+        EffectParams params = m_soundProcessor.params();
+        if (!setEffectParam(params, name, value)) {
+            printf("Unknown parameter or value out of range: %s %g\n", name.c_str(), value);
+            continue;
         }
-        err = Pa_WriteStream(stream, sampleBlock.get(), framesPerBuffer);
-        if (err)
-            reportStreamError(err);
+        m_soundProcessor.setParams(params);
+        printf("%s: %g\n", name.c_str(), value);
     }
 }
 
-void PAudioPipe::initialize(){
-    inChannels = numChannels;
-    outChannels = numChannels;
+void PAudioPipe::printEffectLatency() {
+    size_t latency = m_soundProcessor.latency();
+    if (latency > 0)
+        printf("Latency: %zu frames (%.1f ms)\n", latency, 1e3 * latency / sampleRate);
+}
 
-     PaError err;
-     err = Pa_Initialize();
-     if( err != paNoError ) {
-      reportStreamError(err);
-     }
+void PAudioPipe::printMeters() {
+    if (!analysisTap) {
+        printf("Analysis is off (see --analysis)\n");
+        return;
+    }
+    // Keep the meters last fetched until newer ones are published.
+    AnalysisMeters &meters = *shownMeters;
+    analysisTap->meters(meters);
+    if (meters.time == 0) {
+        printf("No meters yet\n");
+        return;
+    }
+    printf("Input: peak %.1f dBFS, RMS %.1f dBFS; output: peak %.1f dBFS, RMS %.1f dBFS "
+           "(%.1f s, %llu blocks dropped)\n",
+           meters.input.peakDb, meters.input.rmsDb, meters.output.peakDb, meters.output.rmsDb,
+           meters.time, (unsigned long long)meters.droppedBlocks);
+}
 
-     m_soundProcessor.initialize(sampleRate);
+void PAudioPipe::dspLoop() {
+    float *samples = dspBlock.get();
+    size_t blockLen = framesPerBuffer * numChannels;
+    ScopedFlushDenormals flushDenormals(denormalSafe);
+
+    while (dspRunning) {
+        // Wait for a full block without blocking the audio thread; sleep a
+        // fraction of a block period between polls.
+        if (inRing->readAvailable() < blockLen || outRing->writeAvailable() < blockLen) {
+            std::this_thread::sleep_for(std::chrono::microseconds(
+                std::max(50u, 250000u * framesPerBuffer / deviceRate)));
+            continue;
+        }
+        inRing->read(samples, blockLen);
+        uint64_t start = nowNs();
+        processDeviceBlock(samples, samples, framesPerBuffer);
+        processTime.record(nowNs() - start);
+        outRing->write(samples, blockLen);
+    }
 }
 
-void PAudioPipe::reportStreamError(PaError err) {
-     fprintf( stderr, "\nAn error occured while using the portaudio stream\n" );
-     fprintf( stderr, "Error number: %d\n", err );
-     fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
-     fflush(stdout);
-     Pa_Terminate();
+void PAudioPipe::reportLatency() {
+    double device = backend->latency();
+    double measured = roundTripLatency;
+
+    printf("%s mode: round trip latency %.2f ms (device reports %.2f ms)",
+           streamMode == STREAM_CALLBACK ? "Callback" : "DSP thread",
+           1000 * (measured > 0 ? measured : device), 1000 * device);
+    if (streamMode == STREAM_DSP_THREAD)
+        printf(", ring underflows %lu, overflows %lu", ringUnderflows.load(), ringOverflows.load());
+    printf("\n");
+    fflush(stdout);
 }
 
-const char* PAudioPipe::apiName(unsigned int index) {
-    const PaHostApiInfo* info;
-    int hostindex = -1;
-    int apicount = 0;
-    int defaultapi = -1;
+void PAudioPipe::startStats() {
+    if (statsFile == NULL || statsRunning)
+        return;
+    statsRunning = true;
+    statsThread = std::thread(&PAudioPipe::statsLoop, this);
+}
 
-    apicount =  Pa_GetHostApiCount();
-    hostindex = Pa_GetDefaultHostApi();
-    defaultapi = Pa_GetDefaultHostApi();
+void PAudioPipe::stopStats() {
+    if (!statsRunning)
+        return;
+    statsRunning = false;
+    statsThread.join();
+}
 
-    if(apicount <= 0){
-        return "";
+void PAudioPipe::statsLoop() {
+    // Phases timed in this mode, with the counts at the last report so that
+    // every report covers one period.
+    struct Phase {
+        const char *name;
+        LatencyHistogram *histogram;
+        std::unique_ptr<LatencyHistogram::Snapshot> last;
+        std::unique_ptr<LatencyHistogram::Snapshot> now;
+        std::unique_ptr<LatencyHistogram::Snapshot> period;
+    };
+    std::vector<Phase> phases;
+    if (streamMode == STREAM_BLOCKING) {
+        phases.push_back({"read", &readTime, nullptr, nullptr, nullptr});
+        phases.push_back({"process", &processTime, nullptr, nullptr, nullptr});
+        phases.push_back({"write", &writeTime, nullptr, nullptr, nullptr});
+    } else {
+        phases.push_back({"callback", &callbackTime, nullptr, nullptr, nullptr});
+        if (streamMode == STREAM_DSP_THREAD)
+            phases.push_back({"process", &processTime, nullptr, nullptr, nullptr});
     }
-    if(index > apicount-1){
-        return "";
+    for (Phase &phase : phases) {
+        phase.last.reset(new LatencyHistogram::Snapshot());
+        phase.now.reset(new LatencyHistogram::Snapshot());
+        phase.period.reset(new LatencyHistogram::Snapshot());
+        phase.histogram->read(*phase.last);
+        phase.histogram->takeMax();
     }
+    // The effects run in this phase, it has to finish within one buffer.
+    const char *deadlinePhase = streamMode == STREAM_CALLBACK ? "callback" : "process";
+    double deadlineUs = 1e6 * framesPerBuffer / deviceRate;
+
+    const char *mode = streamMode == STREAM_BLOCKING ? "blocking"
+                     : streamMode == STREAM_CALLBACK ? "callback" : "dsp-thread";
+    const char *format = sampleFormatName(sampleFormat);
+
+    // Blocks processed and bypassed at the last report.
+    uint64_t lastBlocks = m_soundProcessor.blocks();
+    uint64_t lastBypassed = m_soundProcessor.bypassedBlocks();
+
+    uint64_t start = nowNs();
+    uint64_t nextReport = start;
+    while (statsRunning) {
+        // Short sleeps, so that stopping does not wait for a whole period.
+        nextReport += (uint64_t)statsPeriodMs * 1000000;
+        while (statsRunning && nowNs() < nextReport)
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        fprintf(statsFile, "{\"time_s\":%.3f,\"mode\":\"%s\",\"format\":\"%s\","
+                "\"sample_rate\":%u,\"device_rate\":%u,\"channels\":%u,\"frames_per_buffer\":%u,"
+                "\"deadline_us\":%.1f",
+                (nowNs() - start) * 1e-9, mode, format, sampleRate, deviceRate, numChannels, framesPerBuffer,
+                deadlineUs);
+
+        double headroom = 1;
+        for (Phase &phase : phases) {
+            LatencyHistogram::Snapshot &period = *phase.period;
+            phase.histogram->read(*phase.now);
+            period = *phase.now;
+            period.subtract(*phase.last);
+            std::swap(phase.last, phase.now);
+            double p99 = period.percentile(0.99) * 1e-3;
+            fprintf(statsFile, ",\"%s\":{\"blocks\":%llu,\"p50_us\":%.2f,\"p99_us\":%.2f,"
+                    "\"p999_us\":%.2f,\"max_us\":%.2f}",
+                    phase.name, (unsigned long long)period.total, period.percentile(0.5) * 1e-3, p99,
+                    period.percentile(0.999) * 1e-3, phase.histogram->takeMax() * 1e-3);
+            if (strcmp(phase.name, deadlinePhase) == 0)
+                headroom = 1 - p99 / deadlineUs;
+        }
 
-    info =  Pa_GetHostApiInfo(index);
+        fprintf(statsFile, ",\"headroom_p99\":%.3f,\"input_overflows\":%lu,\"output_underflows\":%lu",
+                headroom, inputOverflows.load(), outputUnderflows.load());
+        if (streamMode == STREAM_DSP_THREAD)
+            fprintf(statsFile, ",\"ring_underflows\":%lu,\"ring_overflows\":%lu",
+                    ringUnderflows.load(), ringOverflows.load());
+        if (streamMode != STREAM_BLOCKING)
+            fprintf(statsFile, ",\"round_trip_ms\":%.2f", 1000 * roundTripLatency.load());
+        if (silenceBypass) {
+            uint64_t blocks = m_soundProcessor.blocks();
+            uint64_t bypassed = m_soundProcessor.bypassedBlocks();
+            fprintf(statsFile, ",\"bypassed_blocks\":%llu,\"bypassed_share\":%.3f",
+                    (unsigned long long)bypassed,
+                    blocks > lastBlocks ? (double)(bypassed - lastBypassed) / (blocks - lastBlocks) : 0.0);
+            lastBlocks = blocks;
+            lastBypassed = bypassed;
+        }
+        fprintf(statsFile, "}\n");
+        fflush(statsFile);
+    }
+}
 
-    return info->name;
+void PAudioPipe::initialize(){
+     m_soundProcessor.setBlockSize(framesPerBuffer);
+     m_soundProcessor.initialize(sampleRate);
 }
 
 int PAudioPipe::printOptionsAndSelect() {
@@ -281,13 +750,17 @@ int PAudioPipe::printOptionsAndSelect() {
     fprintf(stdout, "Simple Audio Effects:\n");
     fprintf(stdout, "-----------------------------\n");
     std::stringstream option_msg;
-    int numOptions = sizeof(kCoreProcesses) / sizeof(kCoreProcesses[0]);
+    int numOptions = kNumCoreProcesses;
     int i;
     for (i = 0; i < numOptions - 1; ++i) {
         option_msg << i << ":" << kCoreProcesses[i] << ", ";
     }
     option_msg << i << ":" << kCoreProcesses[i] << "\n";
-    option_msg<< "Press Ctrl-C to quit\nQuit and restart to try another effect\n";
+    option_msg<< "Press Ctrl-C to quit\n";
+    option_msg<< "While running, type another effect number to switch effects, or\n"
+              << "a parameter and a value (e.g. echo-delay 0.5) to change it.\n"
+              << "With --analysis, type meters to print the levels.\n"
+              << "Parameters: " << kEffectParamNames << "\n";
     fprintf(stdout, "%s", option_msg.str().c_str());
 
     int defaultSelection = 0;
@@ -1,96 +1,419 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <stdio.h>
+#include <thread>
 
-// Include portaudio library - low level audio apis.
-#include "portaudio.h"
+// Include the audio device interface (portaudio, null or file device).
+#include "audiobackend.h"
 
-// Include audio or sound effects producing class.
-#include "soundprocessor.h"
+// Include audio or sound effects producing class, switchable while streaming.
+#include "switchingprocessor.h"
+
+// Include lock-free ring used between the audio callback and the DSP thread.
+#include "spscring.h"
+
+// Include conversion between device samples and processed float samples.
+#include "sampleformat.h"
+
+// Include lock-free histogram for block timing.
+#include "latencyhistogram.h"
+
+// Include sample rate conversion between the device and the effects.
+#include "resampler.h"
+
+// Include level and spectrum meters fed from the audio thread.
+#include "analysistap.h"
+
+// How the audio stream is driven.
+enum StreamMode {
+    // Blocking read/write loop (default).
+    STREAM_BLOCKING,
+    // Stream callback, effects are processed inside the callback.
+    // Lowest latency, for effects that are cheap enough.
+    STREAM_CALLBACK,
+    // Stream callback that only copies samples to and from lock-free
+    // rings, effects are processed on a dedicated DSP thread.
+    STREAM_DSP_THREAD
+};
 
 // PAudioPipe
 //
-// Wrapper class around low level audio APIs provided by portaudio library.
-// Only the APIs needed for this project are used (portaudio is million times more
-// extensive than what has been used here).
+// Streams audio from the input of an audio device through the effects to its
+// output. The device is reached through an AudioBackend: portaudio by
+// default, or a synthetic one (see NullBackend) where there is no sound card.
 class PAudioPipe {
     public:
+        // Stream through portaudio.
         PAudioPipe();
+
+        // Stream through backend.
+        explicit PAudioPipe(std::unique_ptr<AudioBackend> backend);
+
         ~PAudioPipe();
 
-        // Start the audio pipe.
+        // Start the audio pipe. Returns when the stream ends (never, for a
+        // sound card), or right away if it cannot be opened.
         void start();
 
         // Stop the audio pipe.
         void stop();
 
-        // Explicity stop/terminate portaudio stream.
+        // Explicity stop/close the audio stream.
         void terminate();
 
-        // Set the audio sample format (e.g. signed 16 bit int, signed 32 bit float, etc).
-        void setSampleFormat(PaSampleFormat format);
+        // Set the audio sample format (default SAMPLE_INT16).
+        // Float samples are processed in place without any conversion.
+        // Call before start().
+        void setSampleFormat(SampleFormat format);
+
+        // Select the effect up front instead of asking for it (see
+        // kCoreProcesses). Call before start().
+        void setEffect(int idxF) { selectedEffect = idxF; }
+
+        // With interactive off, start() prints nothing and does not read
+        // commands from standard input, e.g. for many pipes at once.
+        // Call before start().
+        void setInteractive(bool enable) { interactive = enable; }
+
+        // Returns the number of blocks that missed their deadline so far:
+        // input lost and output gaps of the device, and DSP thread blocks
+        // that were not ready in time.
+        unsigned long deadlineMisses() const {
+            return inputOverflows + outputUnderflows + ringUnderflows + ringOverflows;
+        }
+
+        // Add TPDF dither when converting processed samples back to an integer format.
+        void setDither(bool enable) { dither = enable; }
+
+        // Write stream statistics (block timing percentiles, deadline headroom
+        // and xrun counts) every few seconds, one JSON object per line.
+        // path: output file, "-" for standard output.
+        // Returns false if the file could not be opened. Call before start().
+        bool setStatsFile(const char *path);
+
+        // Set how the audio stream is driven (see StreamMode). Call before start().
+        void setStreamMode(StreamMode mode) { streamMode = mode; }
+
+        // Set number of input/output channels (1 to MAX_CHANNELS). Call before start().
+        void setNumChannels(unsigned int channels);
+
+        // Set the sample rate the effects run at (default 44100 Hz). Call before start().
+        void setSampleRate(unsigned int rate);
+
+        // Set the sample rate the device stream opens at, 0 (the default) for
+        // the native rate of the input device. Audio is resampled between
+        // the device rate and the effect rate when they differ. Call before start().
+        void setDeviceRate(unsigned int rate) { deviceRate = rate; }
+
+        // Set number of frames passed per low level api call. Call before start().
+        // This also sets the latency of Convolution Reverb.
+        void setFramesPerBuffer(unsigned int frames) {
+            framesPerBuffer = frames;
+            m_soundProcessor.setBlockSize(frames);
+        }
+
+        // Set the effect parameters (see EffectParams). The level ones are
+        // relative to full scale. Call before start().
+        void setParams(const EffectParams &params) { m_soundProcessor.setParams(params); }
+
+        // Adaptive block size: start at an aggressive block size with the
+        // low latency device settings, and every ADAPT_WINDOW_MS check the
+        // processing headroom and xruns of the stream. Glitches or little
+        // headroom double the block size (and at ADAPT_MAX_FRAMES fall back
+        // to the safe device latency); ample headroom for ADAPT_SETTLE_WINDOWS
+        // windows in a row halves it, but never back to a size that glitched.
+        // The stream is reopened after every change, and every decision is
+        // printed. Starts at the frames per buffer, at least ADAPT_MIN_FRAMES.
+        // Call before start().
+        void setAdaptive(bool enable) { adaptive = enable; }
+
+        // Denormal-safe processing: the threads that process (the blocking
+        // loop, the audio callback and the DSP thread) flush subnormal floats
+        // to zero, so that the cost of the feedback effects does not jump
+        // while their tails decay in silence. Where the CPU cannot (see
+        // canFlushDenormals()) the effects bias their feedback instead.
+        // Call before start().
+        void setDenormalSafe(bool enable) { denormalSafe = enable; }
+
+        // Silence bypass: skip the effect on blocks below thresholdDb (dB
+        // relative to full scale) once its tail has passed, and output
+        // silence (see SoundProcessor::setSilenceBypass()). The statistics
+        // report the share of blocks bypassed. Call before start().
+        void setSilenceBypass(bool enable, double thresholdDb = SILENCE_THRESHOLD_DB) {
+            silenceBypass = enable;
+            m_soundProcessor.setSilenceBypass(enable, thresholdDb);
+        }
+
+        // Meter the input and output of the effects (peak, RMS and spectrum)
+        // on a thread of low priority, fed by the thread that processes
+        // through lock-free rings that drop blocks rather than wait (see
+        // AnalysisTap). Read the meters with meters(). Call before start().
+        void setAnalysis(bool enable) { analysis = enable; }
+
+        // Enable analysis and write the meters of every period to a file,
+        // one JSON object per line. path: output file, "-" for standard
+        // output. Returns false if the file could not be opened. Call before start().
+        bool setAnalysisFile(const char *path);
+
+        // Copy the latest meters to meters. Returns false if there are no
+        // new ones, or analysis is off. Call from one thread only, and not
+        // in interactive mode, where the control thread reads them.
+        bool meters(AnalysisMeters &meters) { return analysisTap && analysisTap->meters(meters); }
+
+        // Set the impulse response of Convolution Reverb (NULL for the
+        // synthetic room). Call before start().
+        void setImpulseResponse(std::shared_ptr<const ImpulseResponse> ir) {
+            m_soundProcessor.setImpulseResponse(ir);
+        }
 
         // List available audio devices.
         void listDevices();
 
         // Get the information of the audio device with given index.
         // index: index of audio device.
-        void getDeviceInfo(unsigned int &index);
+        void getDeviceInfo(unsigned int index);
+
+        // Index of the input and output devices of the stream (the
+        // defaults unless set), -1 if there is none.
+        int inputDevice() { return backend->inputDevice(); }
+        int outputDevice() { return backend->outputDevice(); }
 
         // Set input device.
         // index: index of the audio device which would be set as input device.
-        void setInputDevice(unsigned int &index);
+        void setInputDevice(unsigned int index);
 
         // Set output device.
         // index: index of the audio device which would be set as output device.
-        void setOutputDevice(unsigned int &index);
+        void setOutputDevice(unsigned int index);
 
         // Print available audio effects and also select one of them from user.
         int printOptionsAndSelect();
 
     private:
-        // Pointer to audio stream.
-        PaStream *stream;
+        // Range of block sizes, length of a window and good windows before
+        // shrinking, in adaptive mode.
+        enum {
+            ADAPT_MIN_FRAMES = 16,
+            ADAPT_MAX_FRAMES = 4096,
+            ADAPT_WINDOW_MS = 1000,
+            ADAPT_SETTLE_WINDOWS = 3
+        };
 
-        // Audio stream or data format (type).
-        PaSampleFormat sampleFormat = paInt16;
+        // Audio device the stream goes through.
+        std::unique_ptr<AudioBackend> backend;
 
-        // Size of one audio sample in bytes.
-        unsigned int sampleSizeInBytes;
+        // Audio stream or data format (type).
+        SampleFormat sampleFormat;
 
         // Nuber of input/output channels to use.
         // Restricted to use same number of output channels as input channels.
         unsigned int numChannels;
-        unsigned int inChannels ;
-        unsigned int outChannels;
 
-        // Number of audio samples passed per low level api calls (by portaudio).
+        // Number of audio samples passed per low level api calls (by the backend).
         unsigned int framesPerBuffer;
 
-        // Sample rate (frequency) in Hz.
+        // Sample rate (frequency) the effects run at in Hz.
         unsigned int sampleRate;
 
-        // Input and output devices.
-        int inputDevice;
-        int outputDevice;
+        // Sample rate of the device stream in Hz (0 until start() picks the
+        // native rate of the input device).
+        unsigned int deviceRate;
+
+        // Open the device with its low latency settings rather than its safe
+        // defaults (callback modes, and adaptive mode until it gives up on them).
+        bool lowLatency;
+
+        // Effect selected up front, -1 to ask for it.
+        int selectedEffect;
+
+        // Print and read commands while streaming (see setInteractive()).
+        bool interactive;
+
+        // Keep subnormals out of processing (see setDenormalSafe()).
+        bool denormalSafe;
+
+        // Skip silent blocks (see setSilenceBypass()).
+        bool silenceBypass;
 
         // Initialize the audio pipe.
         void initialize();
 
-        // Start portaudio stream.
+        // Start the audio stream.
         void startStream();
 
-        // Get the API name of the device.
-        // index: index of the device.
-        // Returns pointer to string with API info.
-        const char* apiName(unsigned int index);
+        // Pick the device rate and, if it differs from the effect rate, set
+        // up the resamplers between them.
+        void setupResampling();
+
+        // Process n device frames from input to output: through the effects,
+        // or resampled to the effect rate, through the effects and back.
+        // Runs on the thread that processes (never blocks or allocates).
+        void processDeviceBlock(const float *input, float *output, unsigned long n);
+
+        // Run the stream with device samples of type Sample (see SampleTraits),
+        // reopening it whenever adaptive mode changes the block size.
+        template <typename Sample>
+        void runStream();
+
+        // Adaptive mode: start a window when the stream (re)starts.
+        void startAdapting();
+
+        // Adaptive mode: judge the window that just ended, on the thread that
+        // waits for the stream, and start the next one. Returns true if the
+        // stream should be reopened with adaptFrames frames per buffer.
+        bool adaptBlockSize();
+
+        // Open the audio stream with the current settings.
+        // callback: stream callback, NULL for a blocking stream.
+        // Returns false if the backend could not open it.
+        bool openStream(AudioCallback callback);
+
+        // Run the blocking read/process/write loop (STREAM_BLOCKING).
+        template <typename Sample>
+        void runBlockingStream();
+
+        // Run the stream through the callback (STREAM_CALLBACK and STREAM_DSP_THREAD),
+        // reporting latency periodically.
+        template <typename Sample>
+        void runCallbackStream();
+
+        // Stream callback, forwards to processCallback().
+        template <typename Sample>
+        static void streamCallback(const void *input, void *output, unsigned long frameCount,
+                                   const AudioTime &time, unsigned int flags, void *userData);
+
+        // Handle one callback: process in place, or exchange samples with the DSP thread.
+        // Runs on the audio thread, so it never blocks, locks or allocates.
+        template <typename Sample>
+        void processCallback(const Sample *input, Sample *output, unsigned long frameCount,
+                             const AudioTime &time);
+
+        // Process n float samples from input to output on the audio thread (STREAM_CALLBACK),
+        // or send input to and take output from the DSP thread (STREAM_DSP_THREAD).
+        void exchangeBlock(const float *input, float *output, unsigned long n);
+
+        // Convert processed samples back to device samples, with dither if enabled.
+        // samples: processed samples, dither is added to them in place.
+        template <typename Sample>
+        void fromFloat(Sample *output, float *samples, unsigned long n);
+
+        // Control thread: read effect switches and parameter changes from
+        // standard input while the stream runs.
+        void controlLoop();
+
+        // Print the latency of the selected effect, if it has any.
+        void printEffectLatency();
+
+        // Print the latest meters, if analysis is on.
+        void printMeters();
+
+        // DSP thread: process samples from inRing into outRing until dspRunning is cleared.
+        void dspLoop();
+
+        // Print the round trip latency of the running stream.
+        void reportLatency();
 
-        // Handle error.
-        // This prints the error and exits execution.
-        void reportStreamError(PaError err);
+        // Reporter thread: write statistics to statsFile every statsPeriodMs
+        // until statsRunning is cleared.
+        void statsLoop();
+
+        // Start and stop the reporter thread (nothing if there is no statsFile).
+        void startStats();
+        void stopStats();
 
         // Audio or sound effect producer (object).
-        SoundProcessor m_soundProcessor;
+        SwitchingProcessor m_soundProcessor;
+
+        // Resamplers from the device rate to the effect rate and back, NULL
+        // when the rates are the same, with the frames at the effect rate
+        // and back at the device rate of one block.
+        std::unique_ptr<Resampler> inResampler;
+        std::unique_ptr<Resampler> outResampler;
+        std::unique_ptr<float[]> effectRateBlock;
+        std::unique_ptr<float[]> deviceRateBlock;
+
+        // Resampled output queued until a whole block is ready, primed with
+        // resamplingDelay frames of silence so that it never runs dry (only
+        // the processing thread touches it).
+        std::unique_ptr<SpscRing<float>> resampledRing;
+        unsigned int resamplingDelay;
+
+        // How the audio stream is driven.
+        StreamMode streamMode;
+
+        // Dither integer output (see TpdfDither), and its generator. Only one
+        // thread at a time converts output (the blocking loop or the callback).
+        bool dither;
+        TpdfDither ditherNoise;
+
+        // Samples converted to float for processing, one buffer for the audio
+        // callback and one for the DSP thread (framesPerBuffer * numChannels).
+        std::unique_ptr<float[]> callbackBlock;
+        std::unique_ptr<float[]> dspBlock;
+
+        // Rings between the audio callback and the DSP thread (STREAM_DSP_THREAD).
+        std::unique_ptr<SpscRing<float>> inRing;
+        std::unique_ptr<SpscRing<float>> outRing;
+
+        // DSP thread (STREAM_DSP_THREAD).
+        std::thread dspThread;
+        std::atomic<bool> dspRunning;
+
+        // Latest round trip latency seen by the callback, in seconds
+        // (input to output of the device plus time spent in the rings).
+        std::atomic<double> roundTripLatency;
+
+        // Number of callbacks in which the DSP thread had not produced enough
+        // output, or the input ring was full.
+        std::atomic<unsigned long> ringUnderflows;
+        std::atomic<unsigned long> ringOverflows;
+
+        // Input samples dropped and output gaps reported by the backend
+        // (AUDIO_INPUT_OVERFLOW and AUDIO_OUTPUT_UNDERFLOW).
+        std::atomic<unsigned long> inputOverflows;
+        std::atomic<unsigned long> outputUnderflows;
+
+        // Time per block spent in each phase, recorded by the thread running it:
+        // reading, processing and writing (blocking stream), the whole callback
+        // (callback modes) and processing on the DSP thread.
+        LatencyHistogram readTime;
+        LatencyHistogram processTime;
+        LatencyHistogram writeTime;
+        LatencyHistogram callbackTime;
+
+        // Adaptive block size (see setAdaptive()): enabled, block size to
+        // reopen with, largest block size that glitched (0 if none), good
+        // windows in a row, and whether it has settled.
+        bool adaptive;
+        unsigned int adaptFrames;
+        unsigned int adaptFloor;
+        unsigned int adaptGoodWindows;
+        bool adaptSettled;
+
+        // End of the current window, deadline misses at its start, whether it
+        // is the warm-up window of a new stream, and the timings of the phase
+        // that has to meet the deadline at its start and end, and over it.
+        uint64_t adaptWindowEnd;
+        unsigned long adaptMisses;
+        bool adaptWarmUp;
+        std::unique_ptr<LatencyHistogram::Snapshot> adaptLast;
+        std::unique_ptr<LatencyHistogram::Snapshot> adaptNow;
+        std::unique_ptr<LatencyHistogram::Snapshot> adaptWindow;
+
+        // Meter the effects (see setAnalysis()), output of the meters (NULL
+        // if none), the tap from start() on, and the meters last printed by
+        // the control thread.
+        bool analysis;
+        FILE *analysisFile;
+        std::unique_ptr<AnalysisTap> analysisTap;
+        std::unique_ptr<AnalysisMeters> shownMeters;
+
+        // Statistics output (NULL if disabled), its period and the reporter thread.
+        FILE *statsFile;
+        unsigned int statsPeriodMs;
+        std::thread statsThread;
+        std::atomic<bool> statsRunning;
 };
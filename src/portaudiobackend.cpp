@@ -0,0 +1,306 @@
+#include "portaudiobackend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+PortAudioBackend::PortAudioBackend()
+        : m_stream(NULL),
+          m_inputDevice(-1),
+          m_outputDevice(-1),
+          m_callback(NULL),
+          m_userData(NULL) {
+     PaError err;
+     err = Pa_Initialize();
+     if( err != paNoError ) {
+      reportStreamError(err);
+     }
+}
+
+PortAudioBackend::~PortAudioBackend() {
+    close();
+    Pa_Terminate();
+}
+
+bool PortAudioBackend::checkDevice(unsigned int index, bool input) {
+    int numdevices = 0;
+    numdevices = Pa_GetDeviceCount();
+    if(numdevices == 0){
+        printf("\nNo devices found\n");
+        return false;
+    }
+    if(index >= (unsigned int)numdevices){
+        printf("\nInvalid index\n");
+        return false;
+    }
+    const PaDeviceInfo* info = Pa_GetDeviceInfo(index);
+    if(info == NULL){
+         printf("\nNInvalid index\n");
+        return false;
+    }
+    if((input ? info->maxInputChannels : info->maxOutputChannels) == 0){
+         printf("\nInvalid index\n");
+        return false;
+    }
+    printf("\n%s device set to: %u: %s\n", input ? "Input" : "Output", index, info->name);
+    return true;
+}
+
+bool PortAudioBackend::setInputDevice(unsigned int index) {
+    if (!checkDevice(index, true))
+        return false;
+    m_inputDevice = index;
+    return true;
+}
+
+bool PortAudioBackend::setOutputDevice(unsigned int index) {
+    if (!checkDevice(index, false))
+        return false;
+    m_outputDevice = index;
+    return true;
+}
+
+void PortAudioBackend::listDevices() {
+    const PaDeviceInfo *info;
+    int numdevices = 0;
+    numdevices = Pa_GetDeviceCount();
+    int defaultin = -1, defaultout = -1;
+
+    if(numdevices <= 0){
+      printf("no devices found\n");
+      return;
+    }
+    defaultin = Pa_GetDefaultInputDevice();
+    defaultout = Pa_GetDefaultOutputDevice();
+    if(defaultin == paNoDevice){ defaultin = -1;}
+    if(defaultout == paNoDevice){ defaultout = -1;}
+    printf("Devices:\n");
+    for (int i = 0; i < numdevices; i++) {
+        info = Pa_GetDeviceInfo(i);
+        const char* inout = "";
+        if (info->maxInputChannels > 0 && info->maxOutputChannels == 0) {
+            inout = "input";
+        } else if (info->maxInputChannels == 0 && info->maxOutputChannels > 0) {
+            inout = "output";
+        }
+
+        if (i == defaultin || i == defaultout){
+            printf("%i: (%s) %s (%s) --default--\n", i, inout, info->name, apiName(info->hostApi));
+        } else {
+            printf("%i: (%s) %s (%s)\n", i, inout, info->name, apiName(info->hostApi));
+        }
+    }
+}
+
+void PortAudioBackend::printDeviceInfo(unsigned int index) {
+    const PaDeviceInfo *info;
+    int numdevices = 0;
+    numdevices = Pa_GetDeviceCount();
+
+    if(numdevices <= 0){
+        printf("no devices found\n");
+        return;
+    }
+    if(index >= (unsigned int)numdevices ){
+        printf("invalid index\n");
+        return;
+    }
+
+    info = Pa_GetDeviceInfo(index);
+    printf("\nDevice: (%u)\n", index);
+    printf("%s\n", info->name);
+    printf("API: %s\n", apiName(info->hostApi));
+    printf("Input channels: %i\n", info->maxInputChannels);
+    printf("Output channels: %i\n", info->maxOutputChannels);
+    printf("Default sampling rate (Hz): %f\n", info->defaultSampleRate);
+    printf("Default low input latency (s): %f\n", info->defaultLowInputLatency);
+    printf("Default low input latency (s): %f\n", info->defaultLowOutputLatency);
+    printf("Default high input latency (s): %f\n", info->defaultHighInputLatency);
+    printf("Default high output latency (s): %f\n", info->defaultHighOutputLatency);
+}
+
+int PortAudioBackend::inputDevice() {
+    if (m_inputDevice >= 0)
+        return m_inputDevice;
+    PaDeviceIndex device = Pa_GetDefaultInputDevice();
+    return device != paNoDevice ? device : -1;
+}
+
+int PortAudioBackend::outputDevice() {
+    if (m_outputDevice >= 0)
+        return m_outputDevice;
+    PaDeviceIndex device = Pa_GetDefaultOutputDevice();
+    return device != paNoDevice ? device : -1;
+}
+
+unsigned int PortAudioBackend::nativeRate() {
+    PaDeviceIndex device = m_inputDevice >= 0 ? m_inputDevice : Pa_GetDefaultInputDevice();
+    const PaDeviceInfo *info = device != paNoDevice ? Pa_GetDeviceInfo(device) : NULL;
+    return info != NULL && info->defaultSampleRate > 0 ? (unsigned int)lround(info->defaultSampleRate) : 0;
+}
+
+bool PortAudioBackend::open(const AudioStreamSettings &settings, AudioCallback callback, void *userData) {
+    PaError err;
+    PaStreamParameters outputParameters;
+    PaStreamParameters inputParameters;
+
+    PaSampleFormat sampleFormat = settings.format == SAMPLE_INT24 ? paInt24
+                                : settings.format == SAMPLE_INT32 ? paInt32
+                                : settings.format == SAMPLE_FLOAT32 ? paFloat32 : paInt16;
+
+    // -set parameters
+    if( m_outputDevice < 0) {
+        outputParameters.device = Pa_GetDefaultOutputDevice(); /* default output device */
+    } else {
+        outputParameters.device = m_outputDevice;
+    }
+    if (outputParameters.device == paNoDevice) {
+     fprintf(stderr,"\nError: No default output device.\n");
+     return false;
+    }
+    outputParameters.channelCount = settings.channels;
+    outputParameters.sampleFormat = sampleFormat;
+    const PaDeviceInfo *info = Pa_GetDeviceInfo( outputParameters.device );
+    outputParameters.suggestedLatency = settings.lowLatency ? info->defaultLowOutputLatency
+                                                            : info->defaultHighOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = NULL;
+
+    if( m_inputDevice < 0) {
+        inputParameters.device = Pa_GetDefaultInputDevice(); /* default input device */
+    } else {
+        inputParameters.device = m_inputDevice;
+    }
+    if (inputParameters.device == paNoDevice) {
+      fprintf(stderr,"\nError: No default input device.\n");
+      return false;
+    }
+    inputParameters.channelCount = settings.channels;
+    inputParameters.sampleFormat = sampleFormat;
+    info = Pa_GetDeviceInfo( inputParameters.device );
+    inputParameters.suggestedLatency = settings.lowLatency ? info->defaultLowInputLatency
+                                                           : info->defaultHighInputLatency;
+    inputParameters.hostApiSpecificStreamInfo = NULL;
+
+    m_callback = callback;
+    m_userData = userData;
+    err = Pa_OpenStream (
+                &m_stream,
+                &inputParameters,
+                &outputParameters,
+                settings.sampleRate,
+                settings.framesPerBuffer,
+                paClipOff,
+                callback != NULL ? &PortAudioBackend::streamCallback : NULL,
+                callback != NULL ? this : NULL );
+
+    if( err != paNoError ) {
+        m_stream = NULL;
+        reportStreamError(err);
+        return false;
+    }
+    return true;
+}
+
+bool PortAudioBackend::start() {
+    PaError err = Pa_StartStream( m_stream );
+    if( err != paNoError ) {
+        reportStreamError(err);
+        return false;
+    }
+    return true;
+}
+
+void PortAudioBackend::stop() {
+
+    PaError err = 0;
+
+    if(m_stream != NULL && !Pa_IsStreamStopped(m_stream))
+        err = Pa_StopStream( m_stream );
+
+    if( err !=  paNoError)
+        reportStreamError(err);
+}
+
+void PortAudioBackend::close() {
+    if (m_stream == NULL)
+        return;
+    if (!Pa_IsStreamStopped(m_stream))
+        Pa_AbortStream(m_stream);
+    Pa_CloseStream(m_stream);
+    m_stream = NULL;
+}
+
+bool PortAudioBackend::isActive() {
+    return m_stream != NULL && Pa_IsStreamActive(m_stream) == 1;
+}
+
+AudioStatus PortAudioBackend::read(void *buffer, unsigned long frames) {
+    PaError err = Pa_ReadStream(m_stream, buffer, frames);
+    if (err == paInputOverflowed)
+        return AUDIO_INPUT_OVERFLOW;
+    if (err) {
+        reportStreamError(err);
+        return AUDIO_ERROR;
+    }
+    return AUDIO_OK;
+}
+
+AudioStatus PortAudioBackend::write(const void *buffer, unsigned long frames) {
+    PaError err = Pa_WriteStream(m_stream, buffer, frames);
+    if (err == paOutputUnderflowed)
+        return AUDIO_OUTPUT_UNDERFLOW;
+    if (err) {
+        reportStreamError(err);
+        return AUDIO_ERROR;
+    }
+    return AUDIO_OK;
+}
+
+double PortAudioBackend::latency() {
+    const PaStreamInfo *info = m_stream != NULL ? Pa_GetStreamInfo(m_stream) : NULL;
+    return info != NULL ? info->inputLatency + info->outputLatency : 0;
+}
+
+int PortAudioBackend::streamCallback(const void *input, void *output, unsigned long frameCount,
+                                     const PaStreamCallbackTimeInfo *timeInfo,
+                                     PaStreamCallbackFlags statusFlags, void *userData) {
+    PortAudioBackend *backend = (PortAudioBackend*)userData;
+    AudioTime time = {0, 0, 0};
+    if (timeInfo != NULL) {
+        time.inputAdc = timeInfo->inputBufferAdcTime;
+        time.current = timeInfo->currentTime;
+        time.outputDac = timeInfo->outputBufferDacTime;
+    }
+    unsigned int flags = 0;
+    if (statusFlags & paInputOverflow)
+        flags |= AUDIO_FLAG_INPUT_OVERFLOW;
+    if (statusFlags & paOutputUnderflow)
+        flags |= AUDIO_FLAG_OUTPUT_UNDERFLOW;
+    backend->m_callback(input, output, frameCount, time, flags, backend->m_userData);
+    return paContinue;
+}
+
+void PortAudioBackend::reportStreamError(PaError err) {
+     fprintf( stderr, "\nAn error occured while using the portaudio stream\n" );
+     fprintf( stderr, "Error number: %d\n", err );
+     fprintf( stderr, "Error message: %s\n", Pa_GetErrorText( err ) );
+     fflush(stdout);
+}
+
+const char* PortAudioBackend::apiName(unsigned int index) {
+    const PaHostApiInfo* info;
+    int apicount = 0;
+
+    apicount =  Pa_GetHostApiCount();
+
+    if(apicount <= 0){
+        return "";
+    }
+    if(index > (unsigned int)apicount-1){
+        return "";
+    }
+
+    info =  Pa_GetHostApiInfo(index);
+
+    return info->name;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+// Include portaudio library - low level audio apis.
+#include "portaudio.h"
+
+#include "audiobackend.h"
+
+// PortAudioBackend
+//
+// Sound cards through the portaudio library. Only the APIs needed for this
+// project are used (portaudio is million times more extensive than what has
+// been used here).
+class PortAudioBackend : public AudioBackend {
+    public:
+        // Initializes portaudio.
+        PortAudioBackend();
+
+        // Closes the stream and terminates portaudio.
+        ~PortAudioBackend();
+
+        const char* name() const { return "portaudio"; }
+        void listDevices();
+        void printDeviceInfo(unsigned int index);
+        bool setInputDevice(unsigned int index);
+        bool setOutputDevice(unsigned int index);
+        int inputDevice();
+        int outputDevice();
+        unsigned int nativeRate();
+        bool open(const AudioStreamSettings &settings, AudioCallback callback, void *userData);
+        bool start();
+        void stop();
+        void close();
+        bool isActive();
+        AudioStatus read(void *buffer, unsigned long frames);
+        AudioStatus write(const void *buffer, unsigned long frames);
+        double latency();
+
+    private:
+        // PortAudio stream callback, forwards to m_callback.
+        static int streamCallback(const void *input, void *output, unsigned long frameCount,
+                                  const PaStreamCallbackTimeInfo *timeInfo,
+                                  PaStreamCallbackFlags statusFlags, void *userData);
+
+        // Check that index is a device with channels in the given direction,
+        // printing why not.
+        bool checkDevice(unsigned int index, bool input);
+
+        // Get the API name of the device.
+        // index: index of the device.
+        // Returns pointer to string with API info.
+        const char* apiName(unsigned int index);
+
+        // Handle error.
+        // This prints the error.
+        void reportStreamError(PaError err);
+
+        // Pointer to audio stream, NULL when closed.
+        PaStream *m_stream;
+
+        // Input and output devices, -1 for the defaults.
+        int m_inputDevice;
+        int m_outputDevice;
+
+        // Callback of the open stream and its user data.
+        AudioCallback m_callback;
+        void *m_userData;
+};
@@ -0,0 +1,200 @@
+#include "resampler.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "simdkernels.h"
+
+#define RESAMPLER_PI 3.14159265358979323846
+
+// Taps per phase when upsampling (downsampling needs more, in proportion to
+// the ratio) and Kaiser window beta.
+static const int kBaseTaps = 48;
+static const double kBeta = 8.5;
+
+// Cutoff in units of the lower rate: the transition band of the window ends
+// at its Nyquist frequency.
+static const double kCutoff = 0.443;
+
+// Modified Bessel function of the first kind, order 0 (series).
+static double besselI0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static int64_t gcd(int64_t a, int64_t b) {
+    while (b != 0) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+Resampler::Resampler()
+        : m_inRate(0),
+          m_outRate(0),
+          m_channels(0),
+          m_up(1),
+          m_down(1),
+          m_phases(1),
+          m_taps(0),
+          m_stride(0),
+          m_fill(0),
+          m_pos(0),
+          m_phase(0) {
+}
+
+void Resampler::initialize(int inRate, int outRate, int channels) {
+    m_inRate = inRate;
+    m_outRate = outRate;
+    m_channels = channels;
+    int64_t g = gcd(inRate, outRate);
+    m_up = outRate / g;
+    m_down = inRate / g;
+    m_phases = (int)std::min(m_up, (int64_t)MAX_PHASES);
+
+    // Cutoff in cycles per input sample, and enough taps for the same
+    // transition band at the lower rate.
+    double ratio = std::min(1.0, (double)outRate / inRate);
+    double cutoff = kCutoff * ratio;
+    m_taps = ((int)ceil(kBaseTaps / ratio) + 7) / 8 * 8;
+
+    // Phase p stands for an output p / m_phases input frames after the centre
+    // of its window, tap k for input frame k of the window.
+    m_filters.resize((size_t)(m_phases + 1) * m_taps);
+    double centre = m_taps / 2 - 1;
+    double half = m_taps / 2;
+    for (int p = 0; p <= m_phases; p++) {
+        float *taps = &m_filters[(size_t)p * m_taps];
+        std::vector<double> h(m_taps);
+        double sum = 0;
+        for (int k = 0; k < m_taps; k++) {
+            double t = k - centre - (double)p / m_phases;
+            double x = 2 * cutoff * t;
+            double sinc = x == 0 ? 1 : sin(RESAMPLER_PI * x) / (RESAMPLER_PI * x);
+            double u = t / half;
+            double window = besselI0(kBeta * sqrt(std::max(0.0, 1 - u * u))) / besselI0(kBeta);
+            h[k] = sinc * window;
+            sum += h[k];
+        }
+        // Unity gain at DC in every phase.
+        for (int k = 0; k < m_taps; k++)
+            taps[k] = (float)(h[k] / sum);
+    }
+
+    m_stride = m_taps - 1 + BLOCK_LEN;
+    m_buffer.resize(m_channels * m_stride);
+    size_t maxOut = maxOutput(BLOCK_LEN);
+    m_outPos.resize(maxOut);
+    m_outTaps.resize(maxOut);
+    m_nextTaps.resize(maxOut);
+    m_outWeight.resize(maxOut);
+    m_windows.resize(maxOut);
+    m_nextOut.resize(maxOut);
+    m_planar.resize(m_channels * maxOut);
+    m_inPointers.resize(m_channels);
+    m_outPointers.resize(m_channels);
+    for (int ch = 0; ch < m_channels; ch++)
+        m_outPointers[ch] = &m_planar[ch * maxOut];
+    reset();
+}
+
+void Resampler::reset() {
+    // History in front of the first input frame, so that output j stands
+    // for input frame j * M / L exactly.
+    std::fill(m_buffer.begin(), m_buffer.end(), 0.0f);
+    m_fill = m_taps / 2 - 1;
+    m_pos = 0;
+    m_phase = 0;
+}
+
+size_t Resampler::maxOutput(size_t frames) const {
+    return (size_t)(((int64_t)frames * m_up + m_down - 1) / m_down) + 1;
+}
+
+size_t Resampler::process(const float *in, size_t frames, float *out) {
+    size_t produced = 0;
+    for (size_t pos = 0; pos < frames; pos += BLOCK_LEN) {
+        size_t n = std::min(frames - pos, (size_t)BLOCK_LEN);
+        produced += processBlock(in + pos * m_channels, n, out + produced * m_channels);
+    }
+    return produced;
+}
+
+size_t Resampler::processBlock(const float *in, size_t frames, float *out) {
+    const SimdKernels &k = simdKernels();
+
+    // Append the input to the history of each channel.
+    for (int ch = 0; ch < m_channels; ch++)
+        m_inPointers[ch] = &m_buffer[ch * m_stride + m_fill];
+    k.deinterleave(m_inPointers.data(), in, m_channels, frames);
+    m_fill += frames;
+
+    // Every output whose window has fully arrived, the same for all channels.
+    // The step of M / L input frames is split into whole frames and a
+    // remainder, so that there is no division per output.
+    size_t count = 0;
+    bool exact = m_phases == m_up;
+    size_t stepFrames = (size_t)(m_down / m_up);
+    int64_t stepPhase = m_down % m_up;
+    double phaseScale = (double)m_phases / m_up;
+    size_t pos = m_pos;
+    int64_t phase = m_phase;
+    size_t end = m_fill - std::min(m_fill, (size_t)m_taps - 1);
+    const float *filters = m_filters.data();
+    while (pos < end) {
+        size_t p = (size_t)phase;
+        float weight = 0;
+        if (!exact) {
+            double scaled = phase * phaseScale;
+            p = (size_t)scaled;
+            weight = (float)(scaled - p);
+        }
+        m_outPos[count] = pos;
+        m_outTaps[count] = filters + p * m_taps;
+        m_nextTaps[count] = filters + (p + 1) * m_taps;
+        m_outWeight[count] = weight;
+        count++;
+        pos += stepFrames;
+        phase += stepPhase;
+        if (phase >= m_up) {
+            phase -= m_up;
+            pos++;
+        }
+    }
+    m_pos = pos;
+    m_phase = phase;
+
+    size_t maxOut = m_outPos.size();
+    for (int ch = 0; ch < m_channels; ch++) {
+        const float *x = &m_buffer[ch * m_stride];
+        float *y = &m_planar[ch * maxOut];
+        for (size_t i = 0; i < count; i++)
+            m_windows[i] = x + m_outPos[i];
+        k.dots(y, m_windows.data(), m_outTaps.data(), m_taps, count);
+        if (!exact) {
+            k.dots(m_nextOut.data(), m_windows.data(), m_nextTaps.data(), m_taps, count);
+            for (size_t i = 0; i < count; i++)
+                y[i] = y[i] + m_outWeight[i] * (m_nextOut[i] - y[i]);
+        }
+    }
+    k.interleave(out, m_outPointers.data(), m_channels, count);
+
+    // Keep only the input later outputs need.
+    size_t drop = std::min(m_pos, m_fill);
+    if (drop > 0) {
+        for (int ch = 0; ch < m_channels; ch++) {
+            float *x = &m_buffer[ch * m_stride];
+            memmove(x, x + drop, (m_fill - drop) * sizeof(float));
+        }
+        m_fill -= drop;
+        m_pos -= drop;
+    }
+    return count;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Resampler
+//
+// Streaming sample rate converter for interleaved frames, e.g. between the
+// native rate of an audio device and the rate the effects run at.
+// The rate ratio is reduced to L/M (output/input rate) and every output
+// sample is one dot product of a windowed sinc filter phase with the input
+// around it (polyphase form): the filter runs at L times the input rate in
+// theory, but only the taps that meet input samples are ever computed.
+// Ratios with more than MAX_PHASES phases (e.g. 44100 to 47999 Hz)
+// interpolate linearly between the two nearest of MAX_PHASES phases.
+// Up to 0.38 times the lower of the two rates the output is within -85 dB of
+// the ideal one, and images and aliases are rejected by about 90 dB.
+// Dot products run on the SIMD kernels.
+//
+// Input can come in blocks of any size; each call returns the output frames
+// whose input has fully arrived, so the count varies by a frame or so from
+// call to call but never drifts from the ratio.
+class Resampler {
+    public:
+        // Most phases of the filter table.
+        enum { MAX_PHASES = 512 };
+
+        Resampler();
+
+        // Set the input and output rates in Hz and the number of channels.
+        // Allocates the filter table and clears the history.
+        void initialize(int inRate, int outRate, int channels);
+
+        // Returns the input and output rate.
+        int inRate() const { return m_inRate; }
+        int outRate() const { return m_outRate; }
+
+        // Clear the history, as if the input had been silent.
+        void reset();
+
+        // Returns the number of input frames an output frame lags the input
+        // it stands for (the filter looks this far ahead).
+        size_t latency() const { return m_taps / 2; }
+
+        // Returns the most output frames process() can return for frames
+        // input frames.
+        size_t maxOutput(size_t frames) const;
+
+        // Resample frames interleaved frames in into out, which must hold
+        // maxOutput(frames) frames. Returns the number of frames written.
+        size_t process(const float *in, size_t frames, float *out);
+
+    private:
+        // Most input frames handled at once.
+        enum { BLOCK_LEN = 1024 };
+
+        // Resample up to BLOCK_LEN frames (see process()).
+        size_t processBlock(const float *in, size_t frames, float *out);
+
+        int m_inRate;
+        int m_outRate;
+        int m_channels;
+
+        // Reduced ratio: L output frames for every M input frames.
+        int64_t m_up;
+        int64_t m_down;
+
+        // Number of filter phases (L, or MAX_PHASES when L is larger and the
+        // phases are interpolated), taps per phase (a multiple of 8) and the
+        // taps of phases 0 to m_phases (the last one is phase 0 one input
+        // frame later, for interpolation).
+        int m_phases;
+        int m_taps;
+        std::vector<float> m_filters;
+
+        // Input of each channel (m_stride samples each): the history the
+        // next outputs need followed by new input, m_fill samples in all.
+        std::vector<float> m_buffer;
+        size_t m_stride;
+        size_t m_fill;
+
+        // Window start of the next output in m_buffer, and its phase in
+        // units of 1/L input frames (0 <= m_phase < L).
+        size_t m_pos;
+        int64_t m_phase;
+
+        // Window start, filter phase (and the next one) and interpolation
+        // weight of each output of a block, shared by all the channels.
+        std::vector<size_t> m_outPos;
+        std::vector<const float*> m_outTaps;
+        std::vector<const float*> m_nextTaps;
+        std::vector<float> m_outWeight;
+
+        // Input window of each output of a block in one channel, and the
+        // output of the next phase for interpolation.
+        std::vector<const float*> m_windows;
+        std::vector<float> m_nextOut;
+
+        // Output of each channel for a block, and channel pointers.
+        std::vector<float> m_planar;
+        std::vector<float*> m_inPointers;
+        std::vector<const float*> m_outPointers;
+};
@@ -0,0 +1,74 @@
+#include "sampleformat.h"
+
+size_t sampleSize(SampleFormat format) {
+    switch (format) {
+        case SAMPLE_INT24: return sizeof(Int24);
+        case SAMPLE_INT32: return sizeof(int32_t);
+        case SAMPLE_FLOAT32: return sizeof(float);
+        default: return sizeof(int16_t);
+    }
+}
+
+const char* sampleFormatName(SampleFormat format) {
+    switch (format) {
+        case SAMPLE_INT24: return "int24";
+        case SAMPLE_INT32: return "int32";
+        case SAMPLE_FLOAT32: return "float32";
+        default: return "int16";
+    }
+}
+
+template <typename Sample>
+static void toUnit(float *y, const void *x, size_t n) {
+    SampleTraits<Sample>::toFloat(y, (const Sample*)x, n);
+    const float scale = 1.0f / SampleTraits<Sample>::kFullScale;
+    for (size_t i = 0; i < n; i++)
+        y[i] *= scale;
+}
+
+template <typename Sample>
+static void fromUnit(void *y, float *x, size_t n) {
+    const float scale = SampleTraits<Sample>::kFullScale;
+    for (size_t i = 0; i < n; i++)
+        x[i] *= scale;
+    SampleTraits<Sample>::fromFloat((Sample*)y, x, n);
+}
+
+void samplesToUnit(SampleFormat format, float *y, const void *x, size_t n) {
+    switch (format) {
+        case SAMPLE_INT24: toUnit<Int24>(y, x, n); break;
+        case SAMPLE_INT32: toUnit<int32_t>(y, x, n); break;
+        case SAMPLE_FLOAT32: toUnit<float>(y, x, n); break;
+        default: toUnit<int16_t>(y, x, n); break;
+    }
+}
+
+void unitToSamples(SampleFormat format, void *y, float *x, size_t n) {
+    switch (format) {
+        case SAMPLE_INT24: fromUnit<Int24>(y, x, n); break;
+        case SAMPLE_INT32: fromUnit<int32_t>(y, x, n); break;
+        case SAMPLE_FLOAT32: fromUnit<float>(y, x, n); break;
+        default: fromUnit<int16_t>(y, x, n); break;
+    }
+}
+
+void TpdfDither::apply(float *x, size_t n, float lsb) {
+    if (lsb == 0)
+        return;
+
+    // 24 random bits are exact in a float, two draws per sample.
+    const float unit = lsb / 16777216.0f;
+    uint32_t s = m_state;
+    for (size_t i = 0; i < n; i++) {
+        s ^= s << 13;
+        s ^= s >> 17;
+        s ^= s << 5;
+        uint32_t u1 = s >> 8;
+        s ^= s << 13;
+        s ^= s >> 17;
+        s ^= s << 5;
+        uint32_t u2 = s >> 8;
+        x[i] += unit * (float)((int32_t)u1 - (int32_t)u2);
+    }
+    m_state = s;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string.h>
+
+#include "simdkernels.h"
+
+// Packed 24 bit sample, 3 little-endian bytes (e.g. paInt24).
+struct Int24 {
+    uint8_t bytes[3];
+};
+
+// Sample formats of an audio stream.
+enum SampleFormat {
+    SAMPLE_INT16,       // Signed 16 bit integer (int16_t).
+    SAMPLE_INT24,       // Packed signed 24 bit integer (Int24).
+    SAMPLE_INT32,       // Signed 32 bit integer (int32_t).
+    SAMPLE_FLOAT32      // 32 bit float (float).
+};
+
+// Size of one sample of format in bytes.
+size_t sampleSize(SampleFormat format);
+
+// Name of format, e.g. "int16".
+const char* sampleFormatName(SampleFormat format);
+
+// Convert n samples of format to float samples where full scale is 1, and
+// back, e.g. for audio that does not come from the effects (test tones, files).
+// Converting back scales x in place, then rounds and saturates like
+// SampleTraits::fromFloat.
+void samplesToUnit(SampleFormat format, float *y, const void *x, size_t n);
+void unitToSamples(SampleFormat format, void *y, float *x, size_t n);
+
+// SampleTraits
+//
+// Conversion between the samples of a device or file format and the float
+// samples processed by the effects, a block at a time with the SIMD kernels.
+// Integer samples are processed in the range of 16 bit samples: other widths
+// are scaled to it, and converting back rounds to nearest and saturates
+// instead of wrapping around. Float samples are processed as they are
+// (kNative), so float streams need no conversion at all.
+// Sample: int16_t, Int24, int32_t or float.
+template <typename Sample>
+struct SampleTraits;
+
+template <>
+struct SampleTraits<int16_t> {
+    static constexpr bool kNative = false;
+    // Level of a full scale sample (see EffectParams::fullScale).
+    static constexpr float kFullScale = 32767.0f;
+    // Step between two output values, as a float sample.
+    static constexpr float kLsb = 1.0f;
+
+    static void toFloat(float *y, const int16_t *x, size_t n) {
+        simdKernels().fromInt16(y, x, 1.0f, n);
+    }
+    static void fromFloat(int16_t *y, const float *x, size_t n) {
+        simdKernels().toInt16(y, x, 1.0f, n);
+    }
+};
+
+template <>
+struct SampleTraits<Int24> {
+    static constexpr bool kNative = false;
+    static constexpr float kFullScale = 32767.0f;
+    static constexpr float kLsb = 1.0f / 256;
+
+    static void toFloat(float *y, const Int24 *x, size_t n) {
+        simdKernels().fromInt24(y, x->bytes, 1.0f / 256, n);
+    }
+    static void fromFloat(Int24 *y, const float *x, size_t n) {
+        simdKernels().toInt24(y->bytes, x, 256.0f, n);
+    }
+};
+
+template <>
+struct SampleTraits<int32_t> {
+    static constexpr bool kNative = false;
+    static constexpr float kFullScale = 32767.0f;
+    static constexpr float kLsb = 1.0f / 65536;
+
+    static void toFloat(float *y, const int32_t *x, size_t n) {
+        simdKernels().fromInt32(y, x, 1.0f / 65536, n);
+    }
+    static void fromFloat(int32_t *y, const float *x, size_t n) {
+        simdKernels().toInt32(y, x, 65536.0f, n);
+    }
+};
+
+template <>
+struct SampleTraits<float> {
+    static constexpr bool kNative = true;
+    static constexpr float kFullScale = 1.0f;
+    // Float samples are not rounded, so they need no dither.
+    static constexpr float kLsb = 0.0f;
+
+    static void toFloat(float *y, const float *x, size_t n) {
+        if (y != x)
+            memcpy(y, x, sizeof(float) * n);
+    }
+    static void fromFloat(float *y, const float *x, size_t n) {
+        if (y != x)
+            memcpy(y, x, sizeof(float) * n);
+    }
+};
+
+// TpdfDither
+//
+// Triangular (TPDF) dither: noise of up to one output step, added to the float
+// samples before they are rounded to an integer format, so that quiet sounds
+// fade into a steady hiss instead of distortion correlated with the signal.
+class TpdfDither {
+    public:
+        TpdfDither() : m_state(0x9e3779b9u) {}
+
+        // x[i] += lsb * (u1 - u2), with u1 and u2 uniform in [0, 1).
+        // lsb: output step (SampleTraits::kLsb), nothing is added if it is 0.
+        void apply(float *x, size_t n, float lsb);
+
+    private:
+        // State of the xorshift random number generator (never 0).
+        uint32_t m_state;
+};
@@ -0,0 +1,1122 @@
+#include "simdkernels.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNELS 1
+#endif
+
+
+// Scalar kernels, also used for the tails of the vectorized ones.
+
+static void mix2Scalar(float *y, const float *x0, const float *x1,
+                       float a, float b, float norm, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        y[i] = norm * (a * x0[i] + b * x1[i]);
+}
+
+static void mix3Scalar(float *y, const float *x0, const float *x1, const float *x2,
+                       float a, float b, float c, float norm, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        y[i] = norm * (a * x0[i] + b * x1[i] + c * x2[i]);
+}
+
+static void clampScaleScalar(float *y, const float *x, float limit, float gain, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        y[i] = gain * std::min(std::max(x[i], -limit), limit);
+}
+
+static void modulateScalar(float *y, const float *x, const float *g, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        y[i] = g[i] * x[i];
+}
+
+static void oscillateScalar(float *y, float *c, float *s, float stepCos, float stepSin, size_t n) {
+    for (size_t i = 0; i < n; i += 8) {
+        size_t len = std::min((size_t)8, n - i);
+        for (size_t k = 0; k < len; k++)
+            y[i + k] = std::min(std::max(0.5f + 0.5f * c[k], 0.0f), 1.0f);
+        if (len < 8)
+            break;
+        for (int k = 0; k < 8; k++) {
+            float ck = c[k] * stepCos - s[k] * stepSin;
+            float sk = c[k] * stepSin + s[k] * stepCos;
+            c[k] = ck;
+            s[k] = sk;
+        }
+    }
+}
+
+static void biquadPipelineScalar(float *y, const float *x, const float *coeffs, float *state,
+                                 size_t n) {
+    const int L = SimdKernels::PIPELINE_LANES;
+    const float *b0 = coeffs, *b1 = coeffs + L, *b2 = coeffs + 2 * L;
+    const float *a1 = coeffs + 3 * L, *a2 = coeffs + 4 * L;
+    float *s1 = state, *s2 = state + L, *out = state + 2 * L;
+    for (size_t i = 0; i < n; i++) {
+        // Last lane first, so every lane reads the output of the one before
+        // from the previous step.
+        for (int k = L - 1; k >= 0; k--) {
+            float in = k == 0 ? x[i] : out[k - 1];
+            float o = b0[k] * in + s1[k];
+            s1[k] = (b1[k] * in + s2[k]) - a1[k] * o;
+            s2[k] = b2[k] * in - a2[k] * o;
+            out[k] = o;
+        }
+        y[i] = out[L - 1];
+    }
+}
+
+static void complexMacScalar(float *accRe, float *accIm, const float *aRe, const float *aIm,
+                             const float *bRe, const float *bIm, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        accRe[i] = accRe[i] + (aRe[i] * bRe[i] - aIm[i] * bIm[i]);
+        accIm[i] = accIm[i] + (aRe[i] * bIm[i] + aIm[i] * bRe[i]);
+    }
+}
+
+static void firScalar(float *y, const float *x, const float *taps, int count, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        const float *xi = x + i;
+        float acc = 0.0f;
+        for (int j = 0; j < count; j++)
+            acc = acc + taps[j] * xi[-j];
+        y[i] = acc;
+    }
+}
+
+static void dotsScalar(float *y, const float *const *x, const float *const *h, int count, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        float s[8] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        for (int j = 0; j < count; j += 8) {
+            for (int k = 0; k < 8; k++)
+                s[k] = s[k] + x[i][j + k] * h[i][j + k];
+        }
+        y[i] = ((s[0] + s[4]) + (s[2] + s[6])) + ((s[1] + s[5]) + (s[3] + s[7]));
+    }
+}
+
+static void fftStageScalar(float *re, float *im, const float *wr, const float *wi, size_t h, size_t n) {
+    for (size_t g = 0; g < n; g += 2 * h) {
+        float *ar = re + g, *ai = im + g, *br = re + g + h, *bi = im + g + h;
+        for (size_t j = 0; j < h; j++) {
+            float tr = wr[j] * br[j] - wi[j] * bi[j];
+            float ti = wr[j] * bi[j] + wi[j] * br[j];
+            br[j] = ar[j] - tr;
+            bi[j] = ai[j] - ti;
+            ar[j] = ar[j] + tr;
+            ai[j] = ai[j] + ti;
+        }
+    }
+}
+
+// Frames from begin to n.
+static void deinterleaveFrom(float *const *y, const float *x, int channels, size_t begin, size_t n) {
+    for (int ch = 0; ch < channels; ch++) {
+        for (size_t i = begin; i < n; i++)
+            y[ch][i] = x[i * channels + ch];
+    }
+}
+
+static void interleaveFrom(float *y, const float *const *x, int channels, size_t begin, size_t n) {
+    for (int ch = 0; ch < channels; ch++) {
+        for (size_t i = begin; i < n; i++)
+            y[i * channels + ch] = x[ch][i];
+    }
+}
+
+static void deinterleaveScalar(float *const *y, const float *x, int channels, size_t n) {
+    deinterleaveFrom(y, x, channels, 0, n);
+}
+
+static void interleaveScalar(float *y, const float *const *x, int channels, size_t n) {
+    interleaveFrom(y, x, channels, 0, n);
+}
+
+// Integer conversions round to nearest (lrintf, like the vector conversions)
+// and saturate. Every float from 2^31 up saturates to INT32_MAX.
+static const float kInt24Min = -8388608.0f, kInt24Max = 8388607.0f;
+static const float kInt32Limit = 2147483648.0f;
+
+static void fromInt16Scalar(float *y, const int16_t *x, float scale, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        y[i] = scale * (float)x[i];
+}
+
+static void fromInt24Scalar(float *y, const uint8_t *x, float scale, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t *b = x + 3 * i;
+        // Assemble in the top bytes, the arithmetic shift extends the sign.
+        int32_t v = (int32_t)((uint32_t)b[0] << 8 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 24) >> 8;
+        y[i] = scale * (float)v;
+    }
+}
+
+static void fromInt32Scalar(float *y, const int32_t *x, float scale, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        y[i] = scale * (float)x[i];
+}
+
+static void toInt16Scalar(int16_t *y, const float *x, float scale, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        y[i] = (int16_t)lrintf(std::min(std::max(scale * x[i], -32768.0f), 32767.0f));
+}
+
+static void toInt24Scalar(uint8_t *y, const float *x, float scale, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        int32_t v = (int32_t)lrintf(std::min(std::max(scale * x[i], kInt24Min), kInt24Max));
+        y[3 * i] = (uint8_t)v;
+        y[3 * i + 1] = (uint8_t)(v >> 8);
+        y[3 * i + 2] = (uint8_t)(v >> 16);
+    }
+}
+
+static void toInt32Scalar(int32_t *y, const float *x, float scale, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        float v = scale * x[i];
+        y[i] = v >= kInt32Limit ? INT32_MAX : v > -kInt32Limit ? (int32_t)lrintf(v) : INT32_MIN;
+    }
+}
+
+static const SimdKernels kScalarKernels = {
+    "scalar", mix2Scalar, mix3Scalar, clampScaleScalar, modulateScalar, oscillateScalar,
+    biquadPipelineScalar, complexMacScalar, firScalar, dotsScalar, fftStageScalar,
+    deinterleaveScalar, interleaveScalar,
+    fromInt16Scalar, fromInt24Scalar, fromInt32Scalar,
+    toInt16Scalar, toInt24Scalar, toInt32Scalar
+};
+
+
+#ifdef HAVE_X86_KERNELS
+
+// SSE2 kernels (4 floats per vector).
+
+TARGET_SSE2 static void mix2Sse2(float *y, const float *x0, const float *x1,
+                                 float a, float b, float norm, size_t n) {
+    __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b), vn = _mm_set1_ps(norm);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 s = _mm_add_ps(_mm_mul_ps(va, _mm_loadu_ps(x0 + i)),
+                              _mm_mul_ps(vb, _mm_loadu_ps(x1 + i)));
+        _mm_storeu_ps(y + i, _mm_mul_ps(vn, s));
+    }
+    mix2Scalar(y + i, x0 + i, x1 + i, a, b, norm, n - i);
+}
+
+TARGET_SSE2 static void mix3Sse2(float *y, const float *x0, const float *x1, const float *x2,
+                                 float a, float b, float c, float norm, size_t n) {
+    __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b), vc = _mm_set1_ps(c), vn = _mm_set1_ps(norm);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 s = _mm_add_ps(_mm_mul_ps(va, _mm_loadu_ps(x0 + i)),
+                              _mm_mul_ps(vb, _mm_loadu_ps(x1 + i)));
+        s = _mm_add_ps(s, _mm_mul_ps(vc, _mm_loadu_ps(x2 + i)));
+        _mm_storeu_ps(y + i, _mm_mul_ps(vn, s));
+    }
+    mix3Scalar(y + i, x0 + i, x1 + i, x2 + i, a, b, c, norm, n - i);
+}
+
+TARGET_SSE2 static void clampScaleSse2(float *y, const float *x, float limit, float gain, size_t n) {
+    __m128 vlo = _mm_set1_ps(-limit), vhi = _mm_set1_ps(limit), vg = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(x + i), vlo), vhi);
+        _mm_storeu_ps(y + i, _mm_mul_ps(vg, v));
+    }
+    clampScaleScalar(y + i, x + i, limit, gain, n - i);
+}
+
+TARGET_SSE2 static void modulateSse2(float *y, const float *x, const float *g, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(y + i, _mm_mul_ps(_mm_loadu_ps(g + i), _mm_loadu_ps(x + i)));
+    modulateScalar(y + i, x + i, g + i, n - i);
+}
+
+// The 8 lanes are two vectors.
+TARGET_SSE2 static void oscillateSse2(float *y, float *c, float *s, float stepCos, float stepSin, size_t n) {
+    __m128 vc = _mm_set1_ps(stepCos), vs = _mm_set1_ps(stepSin);
+    __m128 half = _mm_set1_ps(0.5f), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    __m128 c0 = _mm_loadu_ps(c), c1 = _mm_loadu_ps(c + 4);
+    __m128 s0 = _mm_loadu_ps(s), s1 = _mm_loadu_ps(s + 4);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 y0 = _mm_add_ps(half, _mm_mul_ps(half, c0));
+        __m128 y1 = _mm_add_ps(half, _mm_mul_ps(half, c1));
+        _mm_storeu_ps(y + i, _mm_min_ps(_mm_max_ps(y0, zero), one));
+        _mm_storeu_ps(y + i + 4, _mm_min_ps(_mm_max_ps(y1, zero), one));
+        __m128 r0 = _mm_sub_ps(_mm_mul_ps(c0, vc), _mm_mul_ps(s0, vs));
+        __m128 r1 = _mm_sub_ps(_mm_mul_ps(c1, vc), _mm_mul_ps(s1, vs));
+        s0 = _mm_add_ps(_mm_mul_ps(c0, vs), _mm_mul_ps(s0, vc));
+        s1 = _mm_add_ps(_mm_mul_ps(c1, vs), _mm_mul_ps(s1, vc));
+        c0 = r0;
+        c1 = r1;
+    }
+    _mm_storeu_ps(c, c0);
+    _mm_storeu_ps(c + 4, c1);
+    _mm_storeu_ps(s, s0);
+    _mm_storeu_ps(s + 4, s1);
+    oscillateScalar(y + i, c, s, stepCos, stepSin, n - i);
+}
+
+// One step of four lanes of biquadPipeline.
+TARGET_SSE2 static inline void biquadStepSse2(__m128 in, __m128 &out, __m128 &s1, __m128 &s2,
+                                              const float *coeffs) {
+    const int L = SimdKernels::PIPELINE_LANES;
+    out = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(coeffs), in), s1);
+    s1 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(coeffs + L), in), s2),
+                    _mm_mul_ps(_mm_loadu_ps(coeffs + 3 * L), out));
+    s2 = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(coeffs + 2 * L), in),
+                    _mm_mul_ps(_mm_loadu_ps(coeffs + 4 * L), out));
+}
+
+// Four vectors of lanes, shifted up by one lane per step with a shuffle and a
+// move. The state stays in registers, the coefficients are loaded every step.
+TARGET_SSE2 static void biquadPipelineSse2(float *y, const float *x, const float *coeffs,
+                                           float *state, size_t n) {
+    const int L = SimdKernels::PIPELINE_LANES;
+    __m128 s10 = _mm_loadu_ps(state), s11 = _mm_loadu_ps(state + 4);
+    __m128 s12 = _mm_loadu_ps(state + 8), s13 = _mm_loadu_ps(state + 12);
+    __m128 s20 = _mm_loadu_ps(state + L), s21 = _mm_loadu_ps(state + L + 4);
+    __m128 s22 = _mm_loadu_ps(state + L + 8), s23 = _mm_loadu_ps(state + L + 12);
+    __m128 out0 = _mm_loadu_ps(state + 2 * L), out1 = _mm_loadu_ps(state + 2 * L + 4);
+    __m128 out2 = _mm_loadu_ps(state + 2 * L + 8), out3 = _mm_loadu_ps(state + 2 * L + 12);
+    for (size_t i = 0; i < n; i++) {
+        // Rotate every vector up by one lane, then fill lane 0 from the vector before.
+        __m128 rot0 = _mm_shuffle_ps(out0, out0, _MM_SHUFFLE(2, 1, 0, 3));
+        __m128 rot1 = _mm_shuffle_ps(out1, out1, _MM_SHUFFLE(2, 1, 0, 3));
+        __m128 rot2 = _mm_shuffle_ps(out2, out2, _MM_SHUFFLE(2, 1, 0, 3));
+        __m128 rot3 = _mm_shuffle_ps(out3, out3, _MM_SHUFFLE(2, 1, 0, 3));
+        biquadStepSse2(_mm_move_ss(rot0, _mm_load_ss(x + i)), out0, s10, s20, coeffs);
+        biquadStepSse2(_mm_move_ss(rot1, rot0), out1, s11, s21, coeffs + 4);
+        biquadStepSse2(_mm_move_ss(rot2, rot1), out2, s12, s22, coeffs + 8);
+        biquadStepSse2(_mm_move_ss(rot3, rot2), out3, s13, s23, coeffs + 12);
+        _mm_store_ss(y + i, _mm_shuffle_ps(out3, out3, _MM_SHUFFLE(3, 3, 3, 3)));
+    }
+    _mm_storeu_ps(state, s10);
+    _mm_storeu_ps(state + 4, s11);
+    _mm_storeu_ps(state + 8, s12);
+    _mm_storeu_ps(state + 12, s13);
+    _mm_storeu_ps(state + L, s20);
+    _mm_storeu_ps(state + L + 4, s21);
+    _mm_storeu_ps(state + L + 8, s22);
+    _mm_storeu_ps(state + L + 12, s23);
+    _mm_storeu_ps(state + 2 * L, out0);
+    _mm_storeu_ps(state + 2 * L + 4, out1);
+    _mm_storeu_ps(state + 2 * L + 8, out2);
+    _mm_storeu_ps(state + 2 * L + 12, out3);
+}
+
+TARGET_SSE2 static void complexMacSse2(float *accRe, float *accIm, const float *aRe, const float *aIm,
+                                       const float *bRe, const float *bIm, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 ar = _mm_loadu_ps(aRe + i), ai = _mm_loadu_ps(aIm + i);
+        __m128 br = _mm_loadu_ps(bRe + i), bi = _mm_loadu_ps(bIm + i);
+        __m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+        __m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+        _mm_storeu_ps(accRe + i, _mm_add_ps(_mm_loadu_ps(accRe + i), re));
+        _mm_storeu_ps(accIm + i, _mm_add_ps(_mm_loadu_ps(accIm + i), im));
+    }
+    complexMacScalar(accRe + i, accIm + i, aRe + i, aIm + i, bRe + i, bIm + i, n - i);
+}
+
+TARGET_SSE2 static void firSse2(float *y, const float *x, const float *taps, int count, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float *xi = x + i;
+        __m128 acc = _mm_setzero_ps();
+        for (int j = 0; j < count; j++)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(taps[j]), _mm_loadu_ps(xi - j)));
+        _mm_storeu_ps(y + i, acc);
+    }
+    firScalar(y + i, x + i, taps, count, n - i);
+}
+
+// Sum of the lanes of v in the order of dotsScalar() (v holds s[k] + s[k + 4]).
+TARGET_SSE2 static float sumLanesSse2(__m128 v) {
+    __m128 w = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(w, _mm_shuffle_ps(w, w, 1)));
+}
+
+// Two dot products at a time, partial sums 0-3 in a and 4-7 in b, so that
+// four independent additions are in flight.
+TARGET_SSE2 static void dotsSse2(float *y, const float *const *x, const float *const *h, int count, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const float *x0 = x[i], *h0 = h[i], *x1 = x[i + 1], *h1 = h[i + 1];
+        __m128 a0 = _mm_setzero_ps(), b0 = _mm_setzero_ps();
+        __m128 a1 = _mm_setzero_ps(), b1 = _mm_setzero_ps();
+        for (int j = 0; j < count; j += 8) {
+            a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(x0 + j), _mm_loadu_ps(h0 + j)));
+            b0 = _mm_add_ps(b0, _mm_mul_ps(_mm_loadu_ps(x0 + j + 4), _mm_loadu_ps(h0 + j + 4)));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(x1 + j), _mm_loadu_ps(h1 + j)));
+            b1 = _mm_add_ps(b1, _mm_mul_ps(_mm_loadu_ps(x1 + j + 4), _mm_loadu_ps(h1 + j + 4)));
+        }
+        y[i] = sumLanesSse2(_mm_add_ps(a0, b0));
+        y[i + 1] = sumLanesSse2(_mm_add_ps(a1, b1));
+    }
+    dotsScalar(y + i, x + i, h + i, count, n - i);
+}
+
+// Groups narrower than a vector are left to the scalar code.
+TARGET_SSE2 static void fftStageSse2(float *re, float *im, const float *wr, const float *wi, size_t h, size_t n) {
+    if (h % 4 != 0) {
+        fftStageScalar(re, im, wr, wi, h, n);
+        return;
+    }
+    for (size_t g = 0; g < n; g += 2 * h) {
+        float *ar = re + g, *ai = im + g, *br = re + g + h, *bi = im + g + h;
+        for (size_t j = 0; j < h; j += 4) {
+            __m128 cr = _mm_loadu_ps(wr + j), ci = _mm_loadu_ps(wi + j);
+            __m128 xr = _mm_loadu_ps(br + j), xi = _mm_loadu_ps(bi + j);
+            __m128 tr = _mm_sub_ps(_mm_mul_ps(cr, xr), _mm_mul_ps(ci, xi));
+            __m128 ti = _mm_add_ps(_mm_mul_ps(cr, xi), _mm_mul_ps(ci, xr));
+            __m128 yr = _mm_loadu_ps(ar + j), yi = _mm_loadu_ps(ai + j);
+            _mm_storeu_ps(br + j, _mm_sub_ps(yr, tr));
+            _mm_storeu_ps(bi + j, _mm_sub_ps(yi, ti));
+            _mm_storeu_ps(ar + j, _mm_add_ps(yr, tr));
+            _mm_storeu_ps(ai + j, _mm_add_ps(yi, ti));
+        }
+    }
+}
+
+// Stereo is split with shuffles, multiples of four channels with 4x4
+// transposes. Other channel counts are left to the scalar loops.
+TARGET_SSE2 static void deinterleaveSse2(float *const *y, const float *x, int channels, size_t n) {
+    size_t i = 0;
+    if (channels == 2) {
+        for (; i + 4 <= n; i += 4) {
+            __m128 a = _mm_loadu_ps(x + 2 * i);
+            __m128 b = _mm_loadu_ps(x + 2 * i + 4);
+            _mm_storeu_ps(y[0] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(y[1] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+    } else if (channels % 4 == 0) {
+        for (; i + 4 <= n; i += 4) {
+            for (int ch = 0; ch < channels; ch += 4) {
+                const float *src = x + i * channels + ch;
+                __m128 r0 = _mm_loadu_ps(src);
+                __m128 r1 = _mm_loadu_ps(src + channels);
+                __m128 r2 = _mm_loadu_ps(src + 2 * channels);
+                __m128 r3 = _mm_loadu_ps(src + 3 * channels);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                _mm_storeu_ps(y[ch] + i, r0);
+                _mm_storeu_ps(y[ch + 1] + i, r1);
+                _mm_storeu_ps(y[ch + 2] + i, r2);
+                _mm_storeu_ps(y[ch + 3] + i, r3);
+            }
+        }
+    }
+    deinterleaveFrom(y, x, channels, i, n);
+}
+
+TARGET_SSE2 static void interleaveSse2(float *y, const float *const *x, int channels, size_t n) {
+    size_t i = 0;
+    if (channels == 2) {
+        for (; i + 4 <= n; i += 4) {
+            __m128 a = _mm_loadu_ps(x[0] + i);
+            __m128 b = _mm_loadu_ps(x[1] + i);
+            _mm_storeu_ps(y + 2 * i, _mm_unpacklo_ps(a, b));
+            _mm_storeu_ps(y + 2 * i + 4, _mm_unpackhi_ps(a, b));
+        }
+    } else if (channels % 4 == 0) {
+        for (; i + 4 <= n; i += 4) {
+            for (int ch = 0; ch < channels; ch += 4) {
+                float *dst = y + i * channels + ch;
+                __m128 r0 = _mm_loadu_ps(x[ch] + i);
+                __m128 r1 = _mm_loadu_ps(x[ch + 1] + i);
+                __m128 r2 = _mm_loadu_ps(x[ch + 2] + i);
+                __m128 r3 = _mm_loadu_ps(x[ch + 3] + i);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                _mm_storeu_ps(dst, r0);
+                _mm_storeu_ps(dst + channels, r1);
+                _mm_storeu_ps(dst + 2 * channels, r2);
+                _mm_storeu_ps(dst + 3 * channels, r3);
+            }
+        }
+    }
+    interleaveFrom(y, x, channels, i, n);
+}
+
+TARGET_SSE2 static void fromInt16Sse2(float *y, const int16_t *x, float scale, size_t n) {
+    __m128 vs = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(x + i));
+        // Unpacking a vector with itself puts every sample in the top half of
+        // a 32 bit lane, the arithmetic shift extends the sign.
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(y + i, _mm_mul_ps(vs, _mm_cvtepi32_ps(lo)));
+        _mm_storeu_ps(y + i + 4, _mm_mul_ps(vs, _mm_cvtepi32_ps(hi)));
+    }
+    fromInt16Scalar(y + i, x + i, scale, n - i);
+}
+
+TARGET_SSE2 static void fromInt32Sse2(float *y, const int32_t *x, float scale, size_t n) {
+    __m128 vs = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(x + i)));
+        _mm_storeu_ps(y + i, _mm_mul_ps(vs, v));
+    }
+    fromInt32Scalar(y + i, x + i, scale, n - i);
+}
+
+// _mm_cvtps_epi32 rounds to nearest like lrintf, _mm_packs_epi32 saturates.
+TARGET_SSE2 static void toInt16Sse2(int16_t *y, const float *x, float scale, size_t n) {
+    __m128 vs = _mm_set1_ps(scale);
+    __m128 vlo = _mm_set1_ps(-32768.0f), vhi = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(vs, _mm_loadu_ps(x + i)), vlo), vhi);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(vs, _mm_loadu_ps(x + i + 4)), vlo), vhi);
+        _mm_storeu_si128((__m128i*)(y + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+    toInt16Scalar(y + i, x + i, scale, n - i);
+}
+
+// Out of range conversions return INT32_MIN, which is right for negative
+// overflow and flipped to INT32_MAX for positive overflow.
+TARGET_SSE2 static void toInt32Sse2(int32_t *y, const float *x, float scale, size_t n) {
+    __m128 vs = _mm_set1_ps(scale), vlimit = _mm_set1_ps(kInt32Limit);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_mul_ps(vs, _mm_loadu_ps(x + i));
+        __m128i over = _mm_castps_si128(_mm_cmpge_ps(v, vlimit));
+        _mm_storeu_si128((__m128i*)(y + i), _mm_xor_si128(_mm_cvtps_epi32(v), over));
+    }
+    toInt32Scalar(y + i, x + i, scale, n - i);
+}
+
+// Packed 24 bit samples need byte shuffles (SSSE3), SSE2 uses the scalar code.
+static const SimdKernels kSse2Kernels = {
+    "sse2", mix2Sse2, mix3Sse2, clampScaleSse2, modulateSse2, oscillateSse2,
+    biquadPipelineSse2, complexMacSse2, firSse2, dotsSse2, fftStageSse2,
+    deinterleaveSse2, interleaveSse2,
+    fromInt16Sse2, fromInt24Scalar, fromInt32Sse2,
+    toInt16Sse2, toInt24Scalar, toInt32Sse2
+};
+
+
+// AVX2 kernels (8 floats per vector).
+// The upper halves of the registers are cleared before handing the tail to the
+// SSE2 kernels, otherwise all following SSE code (e.g. libm) runs much slower.
+
+TARGET_AVX2 static void mix2Avx2(float *y, const float *x0, const float *x1,
+                                 float a, float b, float norm, size_t n) {
+    __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b), vn = _mm256_set1_ps(norm);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 s = _mm256_add_ps(_mm256_mul_ps(va, _mm256_loadu_ps(x0 + i)),
+                                 _mm256_mul_ps(vb, _mm256_loadu_ps(x1 + i)));
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(vn, s));
+    }
+    _mm256_zeroupper();
+    mix2Sse2(y + i, x0 + i, x1 + i, a, b, norm, n - i);
+}
+
+TARGET_AVX2 static void mix3Avx2(float *y, const float *x0, const float *x1, const float *x2,
+                                 float a, float b, float c, float norm, size_t n) {
+    __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b), vc = _mm256_set1_ps(c);
+    __m256 vn = _mm256_set1_ps(norm);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 s = _mm256_add_ps(_mm256_mul_ps(va, _mm256_loadu_ps(x0 + i)),
+                                 _mm256_mul_ps(vb, _mm256_loadu_ps(x1 + i)));
+        s = _mm256_add_ps(s, _mm256_mul_ps(vc, _mm256_loadu_ps(x2 + i)));
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(vn, s));
+    }
+    _mm256_zeroupper();
+    mix3Sse2(y + i, x0 + i, x1 + i, x2 + i, a, b, c, norm, n - i);
+}
+
+TARGET_AVX2 static void clampScaleAvx2(float *y, const float *x, float limit, float gain, size_t n) {
+    __m256 vlo = _mm256_set1_ps(-limit), vhi = _mm256_set1_ps(limit), vg = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(x + i), vlo), vhi);
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(vg, v));
+    }
+    _mm256_zeroupper();
+    clampScaleSse2(y + i, x + i, limit, gain, n - i);
+}
+
+TARGET_AVX2 static void modulateAvx2(float *y, const float *x, const float *g, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(_mm256_loadu_ps(g + i), _mm256_loadu_ps(x + i)));
+    _mm256_zeroupper();
+    modulateSse2(y + i, x + i, g + i, n - i);
+}
+
+// The 8 lanes are one vector.
+TARGET_AVX2 static void oscillateAvx2(float *y, float *c, float *s, float stepCos, float stepSin, size_t n) {
+    __m256 vc = _mm256_set1_ps(stepCos), vs = _mm256_set1_ps(stepSin);
+    __m256 half = _mm256_set1_ps(0.5f), zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    __m256 vcos = _mm256_loadu_ps(c), vsin = _mm256_loadu_ps(s);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_add_ps(half, _mm256_mul_ps(half, vcos));
+        _mm256_storeu_ps(y + i, _mm256_min_ps(_mm256_max_ps(v, zero), one));
+        __m256 r = _mm256_sub_ps(_mm256_mul_ps(vcos, vc), _mm256_mul_ps(vsin, vs));
+        vsin = _mm256_add_ps(_mm256_mul_ps(vcos, vs), _mm256_mul_ps(vsin, vc));
+        vcos = r;
+    }
+    _mm256_storeu_ps(c, vcos);
+    _mm256_storeu_ps(s, vsin);
+    _mm256_zeroupper();
+    oscillateScalar(y + i, c, s, stepCos, stepSin, n - i);
+}
+
+// One step of eight lanes of biquadPipeline.
+TARGET_AVX2 static inline void biquadStepAvx2(__m256 in, __m256 &out, __m256 &s1, __m256 &s2,
+                                              const float *coeffs) {
+    const int L = SimdKernels::PIPELINE_LANES;
+    out = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(coeffs), in), s1);
+    s1 = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(coeffs + L), in), s2),
+                       _mm256_mul_ps(_mm256_loadu_ps(coeffs + 3 * L), out));
+    s2 = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(coeffs + 2 * L), in),
+                       _mm256_mul_ps(_mm256_loadu_ps(coeffs + 4 * L), out));
+}
+
+// Two vectors of lanes, shifted up by one lane per step with a permute and a blend.
+TARGET_AVX2 static void biquadPipelineAvx2(float *y, const float *x, const float *coeffs,
+                                           float *state, size_t n) {
+    const int L = SimdKernels::PIPELINE_LANES;
+    const __m256i up = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+    __m256 s10 = _mm256_loadu_ps(state), s11 = _mm256_loadu_ps(state + 8);
+    __m256 s20 = _mm256_loadu_ps(state + L), s21 = _mm256_loadu_ps(state + L + 8);
+    __m256 out0 = _mm256_loadu_ps(state + 2 * L), out1 = _mm256_loadu_ps(state + 2 * L + 8);
+    for (size_t i = 0; i < n; i++) {
+        __m256 rot0 = _mm256_permutevar8x32_ps(out0, up);
+        __m256 rot1 = _mm256_permutevar8x32_ps(out1, up);
+        biquadStepAvx2(_mm256_blend_ps(rot0, _mm256_broadcast_ss(x + i), 1), out0, s10, s20, coeffs);
+        biquadStepAvx2(_mm256_blend_ps(rot1, rot0, 1), out1, s11, s21, coeffs + 8);
+        __m128 top = _mm256_extractf128_ps(out1, 1);
+        _mm_store_ss(y + i, _mm_shuffle_ps(top, top, _MM_SHUFFLE(3, 3, 3, 3)));
+    }
+    _mm256_storeu_ps(state, s10);
+    _mm256_storeu_ps(state + 8, s11);
+    _mm256_storeu_ps(state + L, s20);
+    _mm256_storeu_ps(state + L + 8, s21);
+    _mm256_storeu_ps(state + 2 * L, out0);
+    _mm256_storeu_ps(state + 2 * L + 8, out1);
+    _mm256_zeroupper();
+}
+
+TARGET_AVX2 static void complexMacAvx2(float *accRe, float *accIm, const float *aRe, const float *aIm,
+                                       const float *bRe, const float *bIm, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 ar = _mm256_loadu_ps(aRe + i), ai = _mm256_loadu_ps(aIm + i);
+        __m256 br = _mm256_loadu_ps(bRe + i), bi = _mm256_loadu_ps(bIm + i);
+        __m256 re = _mm256_sub_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(ai, bi));
+        __m256 im = _mm256_add_ps(_mm256_mul_ps(ar, bi), _mm256_mul_ps(ai, br));
+        _mm256_storeu_ps(accRe + i, _mm256_add_ps(_mm256_loadu_ps(accRe + i), re));
+        _mm256_storeu_ps(accIm + i, _mm256_add_ps(_mm256_loadu_ps(accIm + i), im));
+    }
+    _mm256_zeroupper();
+    complexMacSse2(accRe + i, accIm + i, aRe + i, aIm + i, bRe + i, bIm + i, n - i);
+}
+
+// Two vectors of outputs at a time, sharing the tap broadcasts.
+TARGET_AVX2 static void firAvx2(float *y, const float *x, const float *taps, int count, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const float *xi = x + i;
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        for (int j = 0; j < count; j++) {
+            __m256 t = _mm256_set1_ps(taps[j]);
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(t, _mm256_loadu_ps(xi - j)));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(t, _mm256_loadu_ps(xi + 8 - j)));
+        }
+        _mm256_storeu_ps(y + i, acc0);
+        _mm256_storeu_ps(y + i + 8, acc1);
+    }
+    _mm256_zeroupper();
+    firSse2(y + i, x + i, taps, count, n - i);
+}
+
+// Four dot products at a time, each in its own accumulator.
+TARGET_AVX2 static void dotsAvx2(float *y, const float *const *x, const float *const *h, int count, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float *x0 = x[i], *x1 = x[i + 1], *x2 = x[i + 2], *x3 = x[i + 3];
+        const float *h0 = h[i], *h1 = h[i + 1], *h2 = h[i + 2], *h3 = h[i + 3];
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+        __m256 a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+        for (int j = 0; j < count; j += 8) {
+            a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(x0 + j), _mm256_loadu_ps(h0 + j)));
+            a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_loadu_ps(x1 + j), _mm256_loadu_ps(h1 + j)));
+            a2 = _mm256_add_ps(a2, _mm256_mul_ps(_mm256_loadu_ps(x2 + j), _mm256_loadu_ps(h2 + j)));
+            a3 = _mm256_add_ps(a3, _mm256_mul_ps(_mm256_loadu_ps(x3 + j), _mm256_loadu_ps(h3 + j)));
+        }
+        y[i] = sumLanesSse2(_mm_add_ps(_mm256_castps256_ps128(a0), _mm256_extractf128_ps(a0, 1)));
+        y[i + 1] = sumLanesSse2(_mm_add_ps(_mm256_castps256_ps128(a1), _mm256_extractf128_ps(a1, 1)));
+        y[i + 2] = sumLanesSse2(_mm_add_ps(_mm256_castps256_ps128(a2), _mm256_extractf128_ps(a2, 1)));
+        y[i + 3] = sumLanesSse2(_mm_add_ps(_mm256_castps256_ps128(a3), _mm256_extractf128_ps(a3, 1)));
+    }
+    _mm256_zeroupper();
+    dotsSse2(y + i, x + i, h + i, count, n - i);
+}
+
+TARGET_AVX2 static void fftStageAvx2(float *re, float *im, const float *wr, const float *wi, size_t h, size_t n) {
+    if (h % 8 != 0) {
+        fftStageSse2(re, im, wr, wi, h, n);
+        return;
+    }
+    for (size_t g = 0; g < n; g += 2 * h) {
+        float *ar = re + g, *ai = im + g, *br = re + g + h, *bi = im + g + h;
+        for (size_t j = 0; j < h; j += 8) {
+            __m256 cr = _mm256_loadu_ps(wr + j), ci = _mm256_loadu_ps(wi + j);
+            __m256 xr = _mm256_loadu_ps(br + j), xi = _mm256_loadu_ps(bi + j);
+            __m256 tr = _mm256_sub_ps(_mm256_mul_ps(cr, xr), _mm256_mul_ps(ci, xi));
+            __m256 ti = _mm256_add_ps(_mm256_mul_ps(cr, xi), _mm256_mul_ps(ci, xr));
+            __m256 yr = _mm256_loadu_ps(ar + j), yi = _mm256_loadu_ps(ai + j);
+            _mm256_storeu_ps(br + j, _mm256_sub_ps(yr, tr));
+            _mm256_storeu_ps(bi + j, _mm256_sub_ps(yi, ti));
+            _mm256_storeu_ps(ar + j, _mm256_add_ps(yr, tr));
+            _mm256_storeu_ps(ai + j, _mm256_add_ps(yi, ti));
+        }
+    }
+    _mm256_zeroupper();
+}
+
+TARGET_AVX2 static void fromInt16Avx2(float *y, const int16_t *x, float scale, size_t n) {
+    __m256 vs = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(x + i)));
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(vs, _mm256_cvtepi32_ps(v)));
+    }
+    _mm256_zeroupper();
+    fromInt16Scalar(y + i, x + i, scale, n - i);
+}
+
+// Four packed samples per 16 byte load, so the loop stops 4 bytes early to
+// never read past the end of x.
+TARGET_AVX2 static void fromInt24Avx2(float *y, const uint8_t *x, float scale, size_t n) {
+    // Bytes of each sample to the top of a 32 bit lane (-1 gives a zero byte).
+    const __m128i spread = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    __m128 vs = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; 3 * i + 16 <= 3 * n; i += 4) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(x + 3 * i)), spread);
+        v = _mm_srai_epi32(v, 8);
+        _mm_storeu_ps(y + i, _mm_mul_ps(vs, _mm_cvtepi32_ps(v)));
+    }
+    fromInt24Scalar(y + i, x + 3 * i, scale, n - i);
+}
+
+TARGET_AVX2 static void fromInt32Avx2(float *y, const int32_t *x, float scale, size_t n) {
+    __m256 vs = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(x + i)));
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(vs, v));
+    }
+    _mm256_zeroupper();
+    fromInt32Sse2(y + i, x + i, scale, n - i);
+}
+
+TARGET_AVX2 static void toInt16Avx2(int16_t *y, const float *x, float scale, size_t n) {
+    __m256 vs = _mm256_set1_ps(scale);
+    __m256 vlo = _mm256_set1_ps(-32768.0f), vhi = _mm256_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(vs, _mm256_loadu_ps(x + i)), vlo), vhi);
+        __m256i r = _mm256_cvtps_epi32(v);
+        __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(r), _mm256_extracti128_si256(r, 1));
+        _mm_storeu_si128((__m128i*)(y + i), packed);
+    }
+    _mm256_zeroupper();
+    toInt16Sse2(y + i, x + i, scale, n - i);
+}
+
+// Four samples are packed into 12 bytes, stored as 8 and 4 bytes.
+TARGET_AVX2 static void toInt24Avx2(uint8_t *y, const float *x, float scale, size_t n) {
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    __m128 vs = _mm_set1_ps(scale);
+    __m128 vlo = _mm_set1_ps(kInt24Min), vhi = _mm_set1_ps(kInt24Max);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(vs, _mm_loadu_ps(x + i)), vlo), vhi);
+        __m128i r = _mm_shuffle_epi8(_mm_cvtps_epi32(v), pack);
+        _mm_storel_epi64((__m128i*)(y + 3 * i), r);
+        int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(r, 8));
+        memcpy(y + 3 * i + 8, &tail, 4);
+    }
+    toInt24Scalar(y + 3 * i, x + i, scale, n - i);
+}
+
+TARGET_AVX2 static void toInt32Avx2(int32_t *y, const float *x, float scale, size_t n) {
+    __m256 vs = _mm256_set1_ps(scale), vlimit = _mm256_set1_ps(kInt32Limit);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_mul_ps(vs, _mm256_loadu_ps(x + i));
+        __m256i over = _mm256_castps_si256(_mm256_cmp_ps(v, vlimit, _CMP_GE_OQ));
+        _mm256_storeu_si256((__m256i*)(y + i), _mm256_xor_si256(_mm256_cvtps_epi32(v), over));
+    }
+    _mm256_zeroupper();
+    toInt32Sse2(y + i, x + i, scale, n - i);
+}
+
+// Interleaving only moves data, the SSE2 shuffles keep up with memory.
+static const SimdKernels kAvx2Kernels = {
+    "avx2", mix2Avx2, mix3Avx2, clampScaleAvx2, modulateAvx2, oscillateAvx2,
+    biquadPipelineAvx2, complexMacAvx2, firAvx2, dotsAvx2, fftStageAvx2,
+    deinterleaveSse2, interleaveSse2,
+    fromInt16Avx2, fromInt24Avx2, fromInt32Avx2,
+    toInt16Avx2, toInt24Avx2, toInt32Avx2
+};
+
+#endif  // HAVE_X86_KERNELS
+
+
+#ifdef HAVE_NEON_KERNELS
+
+// NEON kernels (4 floats per vector). Multiplies and adds are kept separate
+// (no vfma) to match the scalar code bit for bit.
+
+static void mix2Neon(float *y, const float *x0, const float *x1,
+                     float a, float b, float norm, size_t n) {
+    float32x4_t va = vdupq_n_f32(a), vb = vdupq_n_f32(b), vn = vdupq_n_f32(norm);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t s = vaddq_f32(vmulq_f32(va, vld1q_f32(x0 + i)),
+                                  vmulq_f32(vb, vld1q_f32(x1 + i)));
+        vst1q_f32(y + i, vmulq_f32(vn, s));
+    }
+    mix2Scalar(y + i, x0 + i, x1 + i, a, b, norm, n - i);
+}
+
+static void mix3Neon(float *y, const float *x0, const float *x1, const float *x2,
+                     float a, float b, float c, float norm, size_t n) {
+    float32x4_t va = vdupq_n_f32(a), vb = vdupq_n_f32(b), vc = vdupq_n_f32(c);
+    float32x4_t vn = vdupq_n_f32(norm);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t s = vaddq_f32(vmulq_f32(va, vld1q_f32(x0 + i)),
+                                  vmulq_f32(vb, vld1q_f32(x1 + i)));
+        s = vaddq_f32(s, vmulq_f32(vc, vld1q_f32(x2 + i)));
+        vst1q_f32(y + i, vmulq_f32(vn, s));
+    }
+    mix3Scalar(y + i, x0 + i, x1 + i, x2 + i, a, b, c, norm, n - i);
+}
+
+static void clampScaleNeon(float *y, const float *x, float limit, float gain, size_t n) {
+    float32x4_t vlo = vdupq_n_f32(-limit), vhi = vdupq_n_f32(limit), vg = vdupq_n_f32(gain);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v = vminq_f32(vmaxq_f32(vld1q_f32(x + i), vlo), vhi);
+        vst1q_f32(y + i, vmulq_f32(vg, v));
+    }
+    clampScaleScalar(y + i, x + i, limit, gain, n - i);
+}
+
+static void modulateNeon(float *y, const float *x, const float *g, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(y + i, vmulq_f32(vld1q_f32(g + i), vld1q_f32(x + i)));
+    modulateScalar(y + i, x + i, g + i, n - i);
+}
+
+static void oscillateNeon(float *y, float *c, float *s, float stepCos, float stepSin, size_t n) {
+    float32x4_t vc = vdupq_n_f32(stepCos), vs = vdupq_n_f32(stepSin);
+    float32x4_t half = vdupq_n_f32(0.5f), zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f);
+    float32x4_t c0 = vld1q_f32(c), c1 = vld1q_f32(c + 4);
+    float32x4_t s0 = vld1q_f32(s), s1 = vld1q_f32(s + 4);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t y0 = vaddq_f32(half, vmulq_f32(half, c0));
+        float32x4_t y1 = vaddq_f32(half, vmulq_f32(half, c1));
+        vst1q_f32(y + i, vminq_f32(vmaxq_f32(y0, zero), one));
+        vst1q_f32(y + i + 4, vminq_f32(vmaxq_f32(y1, zero), one));
+        float32x4_t r0 = vsubq_f32(vmulq_f32(c0, vc), vmulq_f32(s0, vs));
+        float32x4_t r1 = vsubq_f32(vmulq_f32(c1, vc), vmulq_f32(s1, vs));
+        s0 = vaddq_f32(vmulq_f32(c0, vs), vmulq_f32(s0, vc));
+        s1 = vaddq_f32(vmulq_f32(c1, vs), vmulq_f32(s1, vc));
+        c0 = r0;
+        c1 = r1;
+    }
+    vst1q_f32(c, c0);
+    vst1q_f32(c + 4, c1);
+    vst1q_f32(s, s0);
+    vst1q_f32(s + 4, s1);
+    oscillateScalar(y + i, c, s, stepCos, stepSin, n - i);
+}
+
+// One step of four lanes of biquadPipeline.
+static inline void biquadStepNeon(float32x4_t in, float32x4_t &out, float32x4_t &s1,
+                                  float32x4_t &s2, const float *coeffs) {
+    const int L = SimdKernels::PIPELINE_LANES;
+    out = vaddq_f32(vmulq_f32(vld1q_f32(coeffs), in), s1);
+    s1 = vsubq_f32(vaddq_f32(vmulq_f32(vld1q_f32(coeffs + L), in), s2),
+                   vmulq_f32(vld1q_f32(coeffs + 3 * L), out));
+    s2 = vsubq_f32(vmulq_f32(vld1q_f32(coeffs + 2 * L), in),
+                   vmulq_f32(vld1q_f32(coeffs + 4 * L), out));
+}
+
+// Four vectors of lanes, shifted up by one lane per step with vext.
+static void biquadPipelineNeon(float *y, const float *x, const float *coeffs, float *state,
+                               size_t n) {
+    const int L = SimdKernels::PIPELINE_LANES;
+    float32x4_t s10 = vld1q_f32(state), s11 = vld1q_f32(state + 4);
+    float32x4_t s12 = vld1q_f32(state + 8), s13 = vld1q_f32(state + 12);
+    float32x4_t s20 = vld1q_f32(state + L), s21 = vld1q_f32(state + L + 4);
+    float32x4_t s22 = vld1q_f32(state + L + 8), s23 = vld1q_f32(state + L + 12);
+    float32x4_t out0 = vld1q_f32(state + 2 * L), out1 = vld1q_f32(state + 2 * L + 4);
+    float32x4_t out2 = vld1q_f32(state + 2 * L + 8), out3 = vld1q_f32(state + 2 * L + 12);
+    for (size_t i = 0; i < n; i++) {
+        float32x4_t in1 = vextq_f32(out0, out1, 3);
+        float32x4_t in2 = vextq_f32(out1, out2, 3);
+        float32x4_t in3 = vextq_f32(out2, out3, 3);
+        biquadStepNeon(vextq_f32(vdupq_n_f32(x[i]), out0, 3), out0, s10, s20, coeffs);
+        biquadStepNeon(in1, out1, s11, s21, coeffs + 4);
+        biquadStepNeon(in2, out2, s12, s22, coeffs + 8);
+        biquadStepNeon(in3, out3, s13, s23, coeffs + 12);
+        y[i] = vgetq_lane_f32(out3, 3);
+    }
+    vst1q_f32(state, s10);
+    vst1q_f32(state + 4, s11);
+    vst1q_f32(state + 8, s12);
+    vst1q_f32(state + 12, s13);
+    vst1q_f32(state + L, s20);
+    vst1q_f32(state + L + 4, s21);
+    vst1q_f32(state + L + 8, s22);
+    vst1q_f32(state + L + 12, s23);
+    vst1q_f32(state + 2 * L, out0);
+    vst1q_f32(state + 2 * L + 4, out1);
+    vst1q_f32(state + 2 * L + 8, out2);
+    vst1q_f32(state + 2 * L + 12, out3);
+}
+
+static void complexMacNeon(float *accRe, float *accIm, const float *aRe, const float *aIm,
+                           const float *bRe, const float *bIm, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t ar = vld1q_f32(aRe + i), ai = vld1q_f32(aIm + i);
+        float32x4_t br = vld1q_f32(bRe + i), bi = vld1q_f32(bIm + i);
+        float32x4_t re = vsubq_f32(vmulq_f32(ar, br), vmulq_f32(ai, bi));
+        float32x4_t im = vaddq_f32(vmulq_f32(ar, bi), vmulq_f32(ai, br));
+        vst1q_f32(accRe + i, vaddq_f32(vld1q_f32(accRe + i), re));
+        vst1q_f32(accIm + i, vaddq_f32(vld1q_f32(accIm + i), im));
+    }
+    complexMacScalar(accRe + i, accIm + i, aRe + i, aIm + i, bRe + i, bIm + i, n - i);
+}
+
+static void firNeon(float *y, const float *x, const float *taps, int count, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float *xi = x + i;
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        for (int j = 0; j < count; j++)
+            acc = vaddq_f32(acc, vmulq_f32(vdupq_n_f32(taps[j]), vld1q_f32(xi - j)));
+        vst1q_f32(y + i, acc);
+    }
+    firScalar(y + i, x + i, taps, count, n - i);
+}
+
+// Sum of the lanes of v in the order of dotsScalar() (v holds s[k] + s[k + 4]).
+static float sumLanesNeon(float32x4_t v) {
+    float32x2_t w = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(w, 0) + vget_lane_f32(w, 1);
+}
+
+// Two dot products at a time, partial sums 0-3 in a and 4-7 in b.
+static void dotsNeon(float *y, const float *const *x, const float *const *h, int count, size_t n) {
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const float *x0 = x[i], *h0 = h[i], *x1 = x[i + 1], *h1 = h[i + 1];
+        float32x4_t a0 = vdupq_n_f32(0.0f), b0 = vdupq_n_f32(0.0f);
+        float32x4_t a1 = vdupq_n_f32(0.0f), b1 = vdupq_n_f32(0.0f);
+        for (int j = 0; j < count; j += 8) {
+            a0 = vaddq_f32(a0, vmulq_f32(vld1q_f32(x0 + j), vld1q_f32(h0 + j)));
+            b0 = vaddq_f32(b0, vmulq_f32(vld1q_f32(x0 + j + 4), vld1q_f32(h0 + j + 4)));
+            a1 = vaddq_f32(a1, vmulq_f32(vld1q_f32(x1 + j), vld1q_f32(h1 + j)));
+            b1 = vaddq_f32(b1, vmulq_f32(vld1q_f32(x1 + j + 4), vld1q_f32(h1 + j + 4)));
+        }
+        y[i] = sumLanesNeon(vaddq_f32(a0, b0));
+        y[i + 1] = sumLanesNeon(vaddq_f32(a1, b1));
+    }
+    dotsScalar(y + i, x + i, h + i, count, n - i);
+}
+
+static void fftStageNeon(float *re, float *im, const float *wr, const float *wi, size_t h, size_t n) {
+    if (h % 4 != 0) {
+        fftStageScalar(re, im, wr, wi, h, n);
+        return;
+    }
+    for (size_t g = 0; g < n; g += 2 * h) {
+        float *ar = re + g, *ai = im + g, *br = re + g + h, *bi = im + g + h;
+        for (size_t j = 0; j < h; j += 4) {
+            float32x4_t cr = vld1q_f32(wr + j), ci = vld1q_f32(wi + j);
+            float32x4_t xr = vld1q_f32(br + j), xi = vld1q_f32(bi + j);
+            float32x4_t tr = vsubq_f32(vmulq_f32(cr, xr), vmulq_f32(ci, xi));
+            float32x4_t ti = vaddq_f32(vmulq_f32(cr, xi), vmulq_f32(ci, xr));
+            float32x4_t yr = vld1q_f32(ar + j), yi = vld1q_f32(ai + j);
+            vst1q_f32(br + j, vsubq_f32(yr, tr));
+            vst1q_f32(bi + j, vsubq_f32(yi, ti));
+            vst1q_f32(ar + j, vaddq_f32(yr, tr));
+            vst1q_f32(ai + j, vaddq_f32(yi, ti));
+        }
+    }
+}
+
+// Stereo and four channels use the structure loads and stores.
+static void deinterleaveNeon(float *const *y, const float *x, int channels, size_t n) {
+    size_t i = 0;
+    if (channels == 2) {
+        for (; i + 4 <= n; i += 4) {
+            float32x4x2_t v = vld2q_f32(x + 2 * i);
+            vst1q_f32(y[0] + i, v.val[0]);
+            vst1q_f32(y[1] + i, v.val[1]);
+        }
+    } else if (channels == 4) {
+        for (; i + 4 <= n; i += 4) {
+            float32x4x4_t v = vld4q_f32(x + 4 * i);
+            for (int ch = 0; ch < 4; ch++)
+                vst1q_f32(y[ch] + i, v.val[ch]);
+        }
+    }
+    deinterleaveFrom(y, x, channels, i, n);
+}
+
+static void interleaveNeon(float *y, const float *const *x, int channels, size_t n) {
+    size_t i = 0;
+    if (channels == 2) {
+        for (; i + 4 <= n; i += 4) {
+            float32x4x2_t v = {{vld1q_f32(x[0] + i), vld1q_f32(x[1] + i)}};
+            vst2q_f32(y + 2 * i, v);
+        }
+    } else if (channels == 4) {
+        for (; i + 4 <= n; i += 4) {
+            float32x4x4_t v = {{vld1q_f32(x[0] + i), vld1q_f32(x[1] + i),
+                                vld1q_f32(x[2] + i), vld1q_f32(x[3] + i)}};
+            vst4q_f32(y + 4 * i, v);
+        }
+    }
+    interleaveFrom(y, x, channels, i, n);
+}
+
+#if defined(__aarch64__)
+static void fromInt16Neon(float *y, const int16_t *x, float scale, size_t n) {
+    float32x4_t vs = vdupq_n_f32(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16(x + i);
+        vst1q_f32(y + i, vmulq_f32(vs, vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)))));
+        vst1q_f32(y + i + 4, vmulq_f32(vs, vcvtq_f32_s32(vmovl_high_s16(v))));
+    }
+    fromInt16Scalar(y + i, x + i, scale, n - i);
+}
+
+static void fromInt32Neon(float *y, const int32_t *x, float scale, size_t n) {
+    float32x4_t vs = vdupq_n_f32(scale);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(y + i, vmulq_f32(vs, vcvtq_f32_s32(vld1q_s32(x + i))));
+    fromInt32Scalar(y + i, x + i, scale, n - i);
+}
+
+// vcvtnq rounds to nearest and saturates, vqmovn saturates to 16 bits.
+static void toInt16Neon(int16_t *y, const float *x, float scale, size_t n) {
+    float32x4_t vs = vdupq_n_f32(scale);
+    float32x4_t vlo = vdupq_n_f32(-32768.0f), vhi = vdupq_n_f32(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t a = vminq_f32(vmaxq_f32(vmulq_f32(vs, vld1q_f32(x + i)), vlo), vhi);
+        float32x4_t b = vminq_f32(vmaxq_f32(vmulq_f32(vs, vld1q_f32(x + i + 4)), vlo), vhi);
+        vst1q_s16(y + i, vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)), vqmovn_s32(vcvtnq_s32_f32(b))));
+    }
+    toInt16Scalar(y + i, x + i, scale, n - i);
+}
+
+static void toInt32Neon(int32_t *y, const float *x, float scale, size_t n) {
+    float32x4_t vs = vdupq_n_f32(scale);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        vst1q_s32(y + i, vcvtnq_s32_f32(vmulq_f32(vs, vld1q_f32(x + i))));
+    toInt32Scalar(y + i, x + i, scale, n - i);
+}
+#else
+// 32 bit NEON has no round to nearest conversion.
+#define fromInt16Neon fromInt16Scalar
+#define fromInt32Neon fromInt32Scalar
+#define toInt16Neon toInt16Scalar
+#define toInt32Neon toInt32Scalar
+#endif
+
+// Packed 24 bit samples use the scalar code.
+static const SimdKernels kNeonKernels = {
+    "neon", mix2Neon, mix3Neon, clampScaleNeon, modulateNeon, oscillateNeon,
+    biquadPipelineNeon, complexMacNeon, firNeon, dotsNeon, fftStageNeon,
+    deinterleaveNeon, interleaveNeon,
+    fromInt16Neon, fromInt24Scalar, fromInt32Neon,
+    toInt16Neon, toInt24Scalar, toInt32Neon
+};
+
+#endif  // HAVE_NEON_KERNELS
+
+
+// Returns the kernels for the given instruction set if the CPU supports it.
+static const SimdKernels* findKernels(const char *name) {
+    if (strcmp(name, "scalar") == 0)
+        return &kScalarKernels;
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+        return &kSse2Kernels;
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+        return &kAvx2Kernels;
+#endif
+#ifdef HAVE_NEON_KERNELS
+    if (strcmp(name, "neon") == 0)
+        return &kNeonKernels;
+#endif
+    return NULL;
+}
+
+// Select the kernels at startup: SAE_SIMD if set, otherwise the best available.
+static const SimdKernels* detectKernels() {
+    const char *env = getenv("SAE_SIMD");
+    if (env != NULL && findKernels(env) != NULL)
+        return findKernels(env);
+
+    const char *preferred[] = {"avx2", "sse2", "neon"};
+    for (const char *name : preferred) {
+        const SimdKernels *kernels = findKernels(name);
+        if (kernels != NULL)
+            return kernels;
+    }
+    return &kScalarKernels;
+}
+
+// Kernels in use, selected on first use.
+static const SimdKernels*& currentKernels() {
+    static const SimdKernels *kernels = detectKernels();
+    return kernels;
+}
+
+const SimdKernels& simdKernels() {
+    return *currentKernels();
+}
+
+bool forceSimdKernels(const char *name) {
+    const SimdKernels *kernels = findKernels(name);
+    if (kernels == NULL)
+        return false;
+    currentKernels() = kernels;
+    return true;
+}
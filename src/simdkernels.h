@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// SimdKernels
+//
+// Table of the vectorized inner loops used by the sound effects,
+// by the conversion between interleaved and per channel samples and by the
+// conversion between float samples and the integer samples of devices and files.
+// One table exists per instruction set (scalar, SSE2, AVX2 or NEON) and the
+// best one supported by the CPU is selected at startup. All of them produce
+// bit-identical output: every kernel does the same multiplies and adds in the
+// same order as the scalar code and never fuses them.
+struct SimdKernels {
+    // Number of lanes (sections) of biquadPipeline.
+    enum { PIPELINE_LANES = 16 };
+
+    // Name of the instruction set ("scalar", "sse2", "avx2" or "neon").
+    const char *name;
+
+    // y[i] = norm * (a * x0[i] + b * x1[i])
+    void (*mix2)(float *y, const float *x0, const float *x1,
+                 float a, float b, float norm, size_t n);
+
+    // y[i] = norm * (a * x0[i] + b * x1[i] + c * x2[i])
+    void (*mix3)(float *y, const float *x0, const float *x1, const float *x2,
+                 float a, float b, float c, float norm, size_t n);
+
+    // y[i] = gain * clamp(x[i], -limit, limit)
+    void (*clampScale)(float *y, const float *x, float limit, float gain, size_t n);
+
+    // y[i] = g[i] * x[i]
+    void (*modulate)(float *y, const float *x, const float *g, size_t n);
+
+    // Eight quadrature oscillators side by side (c[k], s[k] are the cosine and
+    // sine of lane k): y[i] = (1 + c[i % 8]) / 2 clamped to [0, 1], and after
+    // every 8 samples each lane is rotated by the angle whose cosine and sine
+    // are stepCos and stepSin. c and s hold the 8 lanes in and out, a final
+    // partial group is not rotated.
+    void (*oscillate)(float *y, float *c, float *s, float stepCos, float stepSin, size_t n);
+
+    // PIPELINE_LANES biquad sections in series (transposed direct form II),
+    // one per lane, run as a pipeline: at step i lane 0 filters x[i], every
+    // other lane filters the output of the lane before it from step i - 1, and
+    // y[i] is the output of the last lane. Each lane computes
+    // out = b0 * in + s1, s1 = (b1 * in + s2) - a1 * out, s2 = b2 * in - a2 * out.
+    // coeffs: b0, b1, b2, a1 and a2 of every lane (5 x PIPELINE_LANES).
+    // state: s1, s2 and the last output of every lane (3 x PIPELINE_LANES), in and out.
+    void (*biquadPipeline)(float *y, const float *x, const float *coeffs, float *state, size_t n);
+
+    // Complex multiply-accumulate of spectra kept as real and imaginary parts:
+    // acc[i] += a[i] * b[i], i.e.
+    // accRe[i] += aRe[i] * bRe[i] - aIm[i] * bIm[i]
+    // accIm[i] += aRe[i] * bIm[i] + aIm[i] * bRe[i]
+    void (*complexMac)(float *accRe, float *accIm, const float *aRe, const float *aIm,
+                       const float *bRe, const float *bIm, size_t n);
+
+    // FIR filter: y[i] = taps[0] * x[i] + taps[1] * x[i - 1] + ... +
+    // taps[count - 1] * x[i - count + 1], summed in that order. The count - 1
+    // samples before x[0] must be readable (the history).
+    void (*fir)(float *y, const float *x, const float *taps, int count, size_t n);
+
+    // n dot products y[i] = x[i] . h[i] of count samples each (count a
+    // multiple of 8): eight partial sums s[k] = x[i][k] * h[i][k] +
+    // x[i][k + 8] * h[i][k + 8] + ..., added up as
+    // ((s[0] + s[4]) + (s[2] + s[6])) + ((s[1] + s[5]) + (s[3] + s[7])).
+    void (*dots)(float *y, const float *const *x, const float *const *h, int count, size_t n);
+
+    // One radix 2 stage of a decimation in time FFT of n complex points
+    // (re, im): every group of 2 * h points g..g+2h is combined with
+    // t = w[j] * b[j], b[j] = a[j] - t, a[j] = a[j] + t, where a[j] is point
+    // g + j, b[j] is point g + h + j and w[j] is wr[j] + i wi[j] (j < h).
+    // t is (wr * br - wi * bi) + i (wr * bi + wi * br).
+    void (*fftStage)(float *re, float *im, const float *wr, const float *wi, size_t h, size_t n);
+
+    // y[ch][i] = x[i * channels + ch], n interleaved frames to one buffer per channel.
+    void (*deinterleave)(float *const *y, const float *x, int channels, size_t n);
+
+    // y[i * channels + ch] = x[ch][i], one buffer per channel to n interleaved frames.
+    void (*interleave)(float *y, const float *const *x, int channels, size_t n);
+
+    // Integer samples to float: y[i] = scale * x[i].
+    // 24 bit samples are packed in 3 little-endian bytes.
+    void (*fromInt16)(float *y, const int16_t *x, float scale, size_t n);
+    void (*fromInt24)(float *y, const uint8_t *x, float scale, size_t n);
+    void (*fromInt32)(float *y, const int32_t *x, float scale, size_t n);
+
+    // Float samples to integer: y[i] = scale * x[i] rounded to nearest,
+    // saturated to the range of the integer format instead of wrapping around.
+    void (*toInt16)(int16_t *y, const float *x, float scale, size_t n);
+    void (*toInt24)(uint8_t *y, const float *x, float scale, size_t n);
+    void (*toInt32)(int32_t *y, const float *x, float scale, size_t n);
+};
+
+// Returns the kernels used for processing.
+// This is the best instruction set supported by the CPU, unless the SAE_SIMD
+// environment variable or forceSimdKernels() selects another one.
+const SimdKernels& simdKernels();
+
+// Force the kernels for the given instruction set ("scalar", "sse2", "avx2", "neon").
+// Call before any processing starts.
+// Returns false if the instruction set is unknown or not supported by the CPU.
+bool forceSimdKernels(const char *name);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+
+// Snapshot
+//
+// Lock-free hand over of the latest value of some settings from one writer
+// thread (e.g. a control thread) to one reader thread (e.g. the audio thread).
+// The writer fills a back buffer and swaps it with the shared middle buffer,
+// the reader swaps the middle buffer with its front buffer when there is a
+// newer value. With three buffers neither side ever waits for the other, and
+// the reader always gets a complete value, never a half written one.
+// T: value type (copyable without allocating).
+template <typename T>
+class Snapshot {
+    public:
+        Snapshot() : m_back(0), m_middle(1), m_front(2) {}
+
+        // Writer: publish value. Never blocks.
+        void publish(const T &value) {
+            m_slots[m_back] = value;
+            m_back = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel) & INDEX;
+        }
+
+        // Reader: copy the latest published value to value. Never blocks.
+        // Returns false, leaving value as is, if nothing was published since
+        // the last fetch().
+        bool fetch(T &value) {
+            if ((m_middle.load(std::memory_order_relaxed) & FRESH) == 0)
+                return false;
+            m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+            value = m_slots[m_front];
+            return true;
+        }
+
+    private:
+        // Buffer index bits and flag for a middle buffer not yet fetched.
+        enum { INDEX = 3, FRESH = 4 };
+
+        T m_slots[3];
+
+        // Buffer owned by the writer.
+        int m_back;
+
+        // Buffer shared by both sides (index | FRESH).
+        std::atomic<int> m_middle;
+
+        // Buffer owned by the reader.
+        int m_front;
+};
@@ -16,22 +16,97 @@
 // discrete-time signals and systems.
 
 #include "soundprocessor.h"
+#include "denormals.h"
+#include "effects.h"
+#include "lanes.h"
+#include "simdkernels.h"
 
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include <string>
 
-#define PI 3.14159265359
+
+// Input of the unused lanes (see lanes.h).
+static const float kZeros[CHUNK_LEN] = {0};
+
+// Level, relative to full scale, the tails of the feedback effects are taken
+// to start from: above full scale, for the gain of the effects.
+static const double kTailLevel = 16;
+
+// Run the Natural Echo over n samples of channels x[0..w) into y[0..w)
+// (see SoundProcessor::naturalEcho()).
+// yN: output of each channel N samples ago.
+// frames: scratch of (W + 1) * CHUNK_LEN samples, and as much again for yN.
+// x1, y1: last input and output sample of each channel.
+template <int W>
+static void naturalEchoLanes(float a, float norm, const float* const* x, float* const* y,
+                             const float* const* yN, int w, size_t n, float* frames,
+                             float* x1s, float* y1s) {
+    float* framesN = frames + (W + 1) * CHUNK_LEN;
+    const float* xs[W];
+    const float* yNs[W];
+    float* ys[W];
+    lanePointers<W>(x, w, kZeros, xs);
+    lanePointers<W>(yN, w, kZeros, yNs);
+    lanePointers<W>(y, w, frames + W * CHUNK_LEN, ys);
+
+    float x1[W] = {0}, y1[W] = {0};
+    for (int l = 0; l < w; l++) {
+        x1[l] = x1s[l];
+        y1[l] = y1s[l];
+    }
+
+    // A single channel is processed in place.
+    const float* in = W == 1 ? xs[0] : frames;
+    const float* inN = W == 1 ? yNs[0] : framesN;
+    float* out = W == 1 ? ys[0] : frames;
+    if (W > 1) {
+        simdKernels().interleave(frames, xs, W, n);
+        simdKernels().interleave(framesN, yNs, W, n);
+    }
+    for (size_t i = 0; i < n; i++) {
+        for (int l = 0; l < W; l++) {
+            float x0 = in[i * W + l];
+            float y0 = norm * (
+                        x0
+              -     a * x1[l]
+              +     a * y1[l]
+              + (1-a) * inN[i * W + l]);
+            x1[l] = x0;
+            y1[l] = y0;
+            out[i * W + l] = y0;
+        }
+    }
+    if (W > 1)
+        simdKernels().deinterleave(ys, frames, W, n);
+
+    for (int l = 0; l < w; l++) {
+        x1s[l] = x1[l];
+        y1s[l] = y1[l];
+    }
+}
 
 
 SoundProcessor::SoundProcessor()
         : m_sampleRate(44100),
-          m_idxX(0),
-          m_idxY(0),
+          m_channels(1),
+          m_echoDelay(0),
+          m_reverbDelay(0),
+          m_flangerDelay(0),
+          m_arenaSize(0),
+          m_blockSize(256),
+          m_antiDenormal(false),
+          m_silenceBypass(false),
+          m_silenceLevel((float)pow(10.0, SILENCE_THRESHOLD_DB / 20.0)),
+          m_tailLength(0),
+          m_quietSamples(0),
+          m_blocks(0),
+          m_bypassedBlocks(0),
           m_idxF(0) {
-    memset(m_pX, 0, sizeof(float) * BUF_LEN);
-    memset(m_pY, 0, sizeof(float) * BUF_LEN);
+    initialize(m_sampleRate, m_channels);
 }
 
 
@@ -39,196 +114,659 @@ SoundProcessor::~SoundProcessor() {
 }
 
 
+void SoundProcessor::initialize(int sampleRate, int channels) {
+    m_sampleRate = sampleRate;
+    channels = std::min(std::max(channels, 1), MAX_CHANNELS);
+    if (channels != m_channels || !m_lanes) {
+        m_channels = channels;
+        m_planar.reset(m_channels > 1 ? new float[m_channels * CHUNK_LEN] : NULL);
+        // Frames of the recursive effects: the input or output of each lane
+        // plus one filler lane, twice (see naturalEchoLanes()).
+        m_lanes.reset(new float[2 * (laneWidth(std::min(m_channels, (int)LANES)) + 1) * CHUNK_LEN]);
+        m_filter.setChannels(m_channels);
+        m_equalizer.setChannels(m_channels);
+    }
+    // Delays, and so the history sizes, depend on the sample rate.
+    setDelays();
+    setOscillators();
+    setFilters();
+    setFunction(m_idxF);
+}
+
+
 void SoundProcessor::setFunction(int idxF) {
     m_idxF = idxF;
-    m_idxX = 0;
-    m_idxY = 0;
-    memset(m_pX, 0, sizeof(float) * BUF_LEN);
-    memset(m_pY, 0, sizeof(float) * BUF_LEN);
+
+    size_t historyX = 0;
+    size_t historyY = 0;
+    effectHistory(idxF, historyX, historyY);
+
+    // The histories of all channels live in one contiguous arena.
+    size_t sizeX = History::storageSize(historyX);
+    size_t sizeY = History::storageSize(historyY);
+    size_t size = m_channels * (sizeX + sizeY);
+    if (size > m_arenaSize) {
+        m_arena.reset(new float[size]);
+        m_arenaSize = size;
+    }
+    for (int ch = 0; ch < m_channels; ch++) {
+        float *storage = m_arena.get() + ch * (sizeX + sizeY);
+        m_x[ch].attach(storage, historyX);
+        m_y[ch].attach(storage + sizeX, historyY);
+
+        m_x1[ch] = m_y1[ch] = 0;
+    }
+    m_filter.reset();
+    m_equalizer.reset();
+    m_tremoloLfo.reset();
+    m_flangerLfo.reset();
+
+    // Numbering should match with the indices
+    // in kCoreProcesses array defined above.
+    if (idxF == 10) {
+        std::shared_ptr<const ImpulseResponse> ir = m_impulseResponse;
+        if (!ir)
+            ir = ImpulseResponse::synthetic(2.0, m_sampleRate);
+        m_convolver.reset(new ConvolutionReverb());
+        m_convolver->initialize(*ir, m_sampleRate, m_channels, m_blockSize);
+        m_convolver->setMix(m_params.convolutionMix);
+    } else {
+        m_convolver.reset();
+    }
+    if (idxF == 6)
+        m_fuzzOversampler.initialize(m_params.fuzzOversampling, m_channels);
+
+    m_quietSamples = 0;
+    setTail();
 }
 
 
-float SoundProcessor::process(float sample) {
-    // Push input sample up input buffer.
-    m_pX[m_idxX] = sample;
+size_t SoundProcessor::latency() const {
+    if (m_convolver)
+        return m_convolver->latency();
+    if (m_idxF == 6)
+        return (size_t)lround(m_fuzzOversampler.latency());
+    return 0;
+}
 
-    float y = coreProcess();
 
-    // Push output sample up output buffer.
-    m_pY[m_idxY] = y;
+void SoundProcessor::setParams(const EffectParams &params) {
+    bool resize = !params.sameDelays(m_params);
+    m_params = params;
+    setDelays();
+    setOscillators();
+    setFilters();
+    if (m_convolver)
+        m_convolver->setMix(m_params.convolutionMix);
+    if (resize)
+        setFunction(m_idxF);
+    else
+        setTail();
+}
 
-    // Increment pointers.
-    m_idxX = (m_idxX + 1) % BUF_LEN;
-    m_idxY = (m_idxY + 1) % BUF_LEN;
 
-    return y;
+void SoundProcessor::setSilenceBypass(bool enable, double thresholdDb) {
+    m_silenceBypass = enable;
+    m_silenceLevel = (float)pow(10.0, thresholdDb / 20);
+    m_quietSamples = 0;
+    setTail();
+}
+
+
+void SoundProcessor::setTail() {
+    // Effects without feedback: the longest delay of their input.
+    size_t historyX = 0;
+    size_t historyY = 0;
+    effectHistory(m_idxF, historyX, historyY);
+    size_t tail = historyX;
+
+    // Feedback decays from kTailLevel down to the threshold by the gain of
+    // its loop every delay (see the effects for a and norm).
+    double ratio = std::min(m_silenceLevel / kTailLevel, 0.5);
+    auto periods = [ratio](double gain) { return (size_t)ceil(log(ratio) / log(gain)); };
+    // Numbering should match with the indices
+    // in kCoreProcesses array defined above.
+    switch (m_idxF) {
+        case 2:
+            // IIR Echo: norm a, with a = 0.7 and norm = 1 - a^2.
+            tail = periods((1 - 0.7 * 0.7) * 0.7) * m_echoDelay;
+            break;
+        case 3:
+            // Natural Echo: every mode of y[n] = norm (a y[n-1] + (1-a) y[n-N])
+            // decays by at least norm (1-a) / (1 - norm a) = 1 - a per delay,
+            // with a = 0.7 and norm = 1 / (1+a).
+            tail = periods(1 - 0.7) * m_echoDelay;
+            break;
+        case 4:
+            // Reverb: x[n-N], then a = 0.8 every delay.
+            tail = m_reverbDelay + periods(0.8) * m_reverbDelay;
+            break;
+        case 5:
+            tail = m_filter.decayLength(ratio);
+            break;
+        case 6:
+            tail = m_fuzzOversampler.memory();
+            break;
+        case 9:
+            tail = m_equalizer.decayLength(ratio);
+            break;
+        case 10:
+            tail = m_convolver ? m_convolver->length() + m_convolver->latency() : 0;
+            break;
+    }
+    m_tailLength = tail;
+}
+
+
+void SoundProcessor::setDelays() {
+    m_echoDelay = delaySamples(m_params.echoDelay);
+    m_reverbDelay = delaySamples(m_params.reverbDelay);
+    m_flangerDelay = delaySamples(FLANGER_DELAY);
+}
+
+
+void SoundProcessor::setOscillators() {
+    m_tremoloLfo.setRate(m_params.tremoloRate, m_sampleRate);
+    m_tremoloLfo.setShape(m_params.tremoloShape);
+    m_flangerLfo.setRate(m_params.flangerRate, m_sampleRate);
+    m_flangerLfo.setShape(m_params.flangerShape);
+}
+
+
+void SoundProcessor::setFilters() {
+    BiquadCoeffs filterOut = filterOutCoeffs();
+    m_filter.setSections(&filterOut, 1);
+
+    // One octave wide bands.
+    BiquadCoeffs bands[EQ_BANDS];
+    for (int b = 0; b < EQ_BANDS; b++) {
+        // Bands above Nyquist are left out.
+        if (kEqFrequencies[b] < 0.45 * m_sampleRate)
+            bands[b] = BiquadCoeffs::peaking(kEqFrequencies[b], sqrt(2.0), m_params.eqGains[b], m_sampleRate);
+        else
+            bands[b] = BiquadCoeffs::identity();
+    }
+    m_equalizer.setSections(bands, EQ_BANDS);
 }
 
-float SoundProcessor::coreProcess() {
+
+bool SoundProcessor::feedForward(size_t &overlap) {
+    size_t historyY = 0;
+    overlap = 0;
+    effectHistory(m_idxF, overlap, historyY);
+    if (m_idxF == 6)
+        overlap = m_fuzzOversampler.memory();
+    // Numbering should match with the indices
+    // in kCoreProcesses array defined above.
+    // Pass, Echo and Fuzz.
+    return m_idxF == 0 || m_idxF == 1 || m_idxF == 6;
+}
+
+
+const char *kEffectParamNames =
+    "echo-delay, reverb-delay, fuzz-threshold, fuzz-gain, fuzz-oversampling (1, 2, 4 or 8), "
+    "tremolo-rate, flanger-rate, "
+    "tremolo-shape, flanger-shape (0 sine, 1 triangle, 2 square), "
+    "eq-31, eq-62, eq-125, eq-250, eq-500, eq-1k, eq-2k, eq-4k, eq-8k, eq-16k (dB), "
+    "convolution-mix";
+
+// Names of the Equalizer gains, in the order of kEqFrequencies.
+static const char *kEqParamNames[EQ_BANDS] = {
+    "eq-31", "eq-62", "eq-125", "eq-250", "eq-500", "eq-1k", "eq-2k", "eq-4k", "eq-8k", "eq-16k"};
+
+
+bool setEffectParam(EffectParams &params, const std::string &name, double value) {
+    // Ranges keep the history of the delays to a few MB at most.
+    if (name == "echo-delay" && value > 0 && value <= 2)
+        params.echoDelay = value;
+    else if (name == "reverb-delay" && value > 0 && value <= 0.5)
+        params.reverbDelay = value;
+    else if (name == "fuzz-threshold" && value > 0 && value <= 1)
+        params.fuzzThreshold = (float)value;
+    else if (name == "fuzz-gain" && value > 0 && value <= 100)
+        params.fuzzGain = (float)value;
+    else if (name == "fuzz-oversampling" && (value == 1 || value == 2 || value == 4 || value == 8))
+        params.fuzzOversampling = (int)value;
+    else if (name == "tremolo-rate" && value > 0 && value <= 50)
+        params.tremoloRate = value;
+    else if (name == "flanger-rate" && value > 0 && value <= 50)
+        params.flangerRate = value;
+    else if (name == "tremolo-shape" && (value == LFO_SINE || value == LFO_TRIANGLE || value == LFO_SQUARE))
+        params.tremoloShape = (LfoShape)(int)value;
+    else if (name == "flanger-shape" && (value == LFO_SINE || value == LFO_TRIANGLE || value == LFO_SQUARE))
+        params.flangerShape = (LfoShape)(int)value;
+    else if (name == "convolution-mix" && value >= 0 && value <= 1)
+        params.convolutionMix = (float)value;
+    else {
+        for (int b = 0; b < EQ_BANDS; b++) {
+            if (name == kEqParamNames[b] && value >= -24 && value <= 24) {
+                params.eqGains[b] = (float)value;
+                return true;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+
+void SoundProcessor::effectHistory(int idxF, size_t &historyX, size_t &historyY) {
     // Numbering should match with the indices
     // in kCoreProcesses array defined above.
+    // Longest delays read by each effect (see the effects below).
+    switch (idxF) {
+        case 1:
+            historyX = 2 * m_echoDelay;
+            break;
+        case 2:
+        case 3:
+            historyY = m_echoDelay;
+            break;
+        case 4:
+            historyX = m_reverbDelay;
+            historyY = m_reverbDelay;
+            break;
+        case 7:
+            historyX = FLANGER_DEPTH * m_flangerDelay;
+            break;
+        default:
+            // Pass, Fuzz and Tremolo keep no history, Filter Out and
+            // Equalizer keep theirs in their BiquadCascade, Convolution
+            // Reverb in its ConvolutionReverb.
+            break;
+    }
+}
+
+
+float SoundProcessor::process(float sample) {
     float y;
+    processBlock(&sample, &y, 1);
+    return y;
+}
+
+
+void SoundProcessor::processBlock(const float* in, float* out, size_t n) {
+    if (m_channels == 1) {
+        processChannels(&in, &out, n);
+        return;
+    }
+
+    float* planar[MAX_CHANNELS];
+    for (int ch = 0; ch < m_channels; ch++)
+        planar[ch] = m_planar.get() + ch * CHUNK_LEN;
+
+    while (n > 0) {
+        size_t len = std::min(n, (size_t)CHUNK_LEN);
+
+        // Deinterleave, process and interleave again.
+        simdKernels().deinterleave(planar, in, m_channels, len);
+        processChannels(planar, planar, len);
+        simdKernels().interleave(out, planar, m_channels, len);
+
+        in += len * m_channels;
+        out += len * m_channels;
+        n -= len;
+    }
+}
+
+
+void SoundProcessor::processChannels(const float* const* in, float* const* out, size_t n) {
+    const float* x[MAX_CHANNELS];
+    float* y[MAX_CHANNELS];
+
+    for (size_t pos = 0; pos < n; pos += CHUNK_LEN) {
+        size_t len = std::min(n - pos, (size_t)CHUNK_LEN);
+
+        for (int ch = 0; ch < m_channels; ch++) {
+            x[ch] = in[ch] + pos;
+            y[ch] = out[ch] + pos;
+        }
+        m_blocks++;
+        if (m_silenceBypass && bypass(x, y, len)) {
+            m_bypassedBlocks++;
+            continue;
+        }
+
+        // Push input samples up input history.
+        for (int ch = 0; ch < m_channels; ch++)
+            m_x[ch].write(x[ch], len);
+
+        coreProcess(x, y, len);
+    }
+}
+
+
+bool SoundProcessor::bypass(const float* const* x, float* const* y, size_t n) {
+    if (!silent(x, n)) {
+        m_quietSamples = 0;
+        return false;
+    }
+
+    // The output can stay above the threshold for the tail of the effect
+    // after the last loud input.
+    bool done = m_quietSamples >= m_tailLength;
+    m_quietSamples += n;
+    if (!done)
+        return false;
+
+    // Keep the histories going, a block at a time like the effects do:
+    // the input, and silence as the output. The input first, the output
+    // may be the same buffer.
+    for (int ch = 0; ch < m_channels; ch++) {
+        m_x[ch].write(x[ch], n);
+        memset(y[ch], 0, sizeof(float) * n);
+    }
+    commit(y, 0, n);
+    // Oscillators carry on, so that the effect wakes up in phase.
+    if (m_idxF == 7)
+        m_flangerLfo.skip(n);
+    else if (m_idxF == 8)
+        m_tremoloLfo.skip(n);
+    return true;
+}
+
+
+bool SoundProcessor::silent(const float* const* x, size_t n) const {
+    float level = m_silenceLevel * m_params.fullScale;
+    float limit = level * level * n;
+
+    // Eight partial sums, so that the sum of squares vectorizes.
+    enum { SUMS = 8 };
+    for (int ch = 0; ch < m_channels; ch++) {
+        const float *xc = x[ch];
+        float sums[SUMS] = {0};
+        size_t i = 0;
+        for (; i + SUMS <= n; i += SUMS) {
+            for (int k = 0; k < SUMS; k++)
+                sums[k] += xc[i + k] * xc[i + k];
+        }
+        float energy = 0;
+        for (; i < n; i++)
+            energy += xc[i] * xc[i];
+        for (int k = 0; k < SUMS; k++)
+            energy += sums[k];
+        if (energy >= limit)
+            return false;
+    }
+    return true;
+}
+
+
+void SoundProcessor::coreProcess(const float* const* x, float* const* y, size_t n) {
+    // Numbering should match with the indices
+    // in kCoreProcesses array defined above.
     switch (m_idxF) {
         case 0:
         default:
-            y = pass();
+            pass(x, y, n);
             break;
         case 1:
-            y = echo();
+            echo(x, y, n);
             break;
         case 2:
-            y = iirEcho();
+            iirEcho(x, y, n);
             break;
         case 3:
-            y = naturalEcho();
+            naturalEcho(x, y, n);
             break;
         case 4:
-            y = reverb();
+            reverb(x, y, n);
             break;
         case 5:
-            y = biQuad();
+            biQuad(x, y, n);
             break;
         case 6:
-            y = fuzz();
+            fuzz(x, y, n);
             break;
         case 7:
-            y = flanger();
+            flanger(x, y, n);
             break;
         case 8:
-            y = tremolo();
+            tremolo(x, y, n);
+            break;
+        case 9:
+            equalizer(x, y, n);
+            break;
+        case 10:
+            convolution(x, y, n);
             break;
     }
-    return y;
 }
 
-float SoundProcessor::pass() {
-  return m_pX[m_idxX];
+void SoundProcessor::commit(const float* const* y, size_t pos, size_t n) {
+    for (int ch = 0; ch < m_channels; ch++) {
+        m_y[ch].write(y[ch] + pos, n);
+        m_x[ch].advance(n);
+        m_y[ch].advance(n);
+    }
 }
 
+void SoundProcessor::addAntiDenormal(const float* const* x, float* const* y, size_t pos, size_t n) {
+    if (!m_antiDenormal)
+        return;
+    for (int ch = 0; ch < m_channels; ch++) {
+        for (size_t i = pos; i < pos + n; i++)
+            y[ch][i] = x[ch][i] + kAntiDenormal;
+    }
+}
 
-float SoundProcessor::echo() {
+void SoundProcessor::pass(const float* const* x, float* const* y, size_t n) {
+    for (int ch = 0; ch < m_channels; ch++) {
+        if (y[ch] != x[ch])
+            memcpy(y[ch], x[ch], sizeof(float) * n);
+    }
+    commit(y, 0, n);
+}
+
+
+void SoundProcessor::echo(const float* const* x, float* const* y, size_t n) {
     // Echo signal model:
     // y[n] = (ax[n] + bx[n-N] + cx[n-2N])/(a+b+c)
-    static float a = 1;
-    static float b = 0.7f;
-    static float c = 0.5f;
-    static float norm = 1.0f / (a+b+c);
-    static int N = (int)(0.3 * m_sampleRate);
-
-    return norm * (
-      a * m_pX[m_idxX]
-    + b * m_pX[(m_idxX + BUF_LEN - N) %  BUF_LEN]
-    + c * m_pX[(m_idxX + BUF_LEN - 2*N) % BUF_LEN]);
+    const float a = 1;
+    const float b = 0.7f;
+    const float c = 0.5f;
+    const float norm = 1.0f / (a+b+c);
+    int N = m_echoDelay;
+
+    for (int ch = 0; ch < m_channels; ch++)
+        simdKernels().mix3(y[ch], x[ch], m_x[ch].span(N), m_x[ch].span(2*N), a, b, c, norm, n);
+    commit(y, 0, n);
 }
 
 
-float SoundProcessor::iirEcho() {
+void SoundProcessor::iirEcho(const float* const* x, float* const* y, size_t n) {
     // Echo signal model:
     // y[n] = x[n] + ay[n-N]
-    static float a = 0.7f;
-    static float norm = (1 - a * a);
-    static int N = (int)(0.3 * m_sampleRate);
-
-    return norm * (
-            m_pX[m_idxX]
-      + a * m_pY[(m_idxY + BUF_LEN - N) % BUF_LEN]);
+    const float a = 0.7f;
+    const float norm = (1 - a * a);
+    int N = m_echoDelay;
+
+    // At most N samples at a time, so that all of y[n-N] is already known
+    // and the feedback can be computed like a feed-forward tap, vectorized
+    // along time in every channel.
+    size_t maxLen = std::max(N, 1);
+
+    for (size_t pos = 0; pos < n; pos += maxLen) {
+        size_t len = std::min(n - pos, maxLen);
+        // x[n] is scaled by 1, which is exact.
+        for (int ch = 0; ch < m_channels; ch++)
+            simdKernels().mix2(y[ch] + pos, x[ch] + pos, m_y[ch].span(N), 1.0f, a, norm, len);
+        addAntiDenormal(y, y, pos, len);
+        commit(y, pos, len);
+    }
 }
 
 
-float SoundProcessor::naturalEcho() {
+void SoundProcessor::naturalEcho(const float* const* x, float* const* y, size_t n) {
     // Echo signal model:
     // y[n] = x[n] + y[n-N] * h[n], h[n] is leaky integrator.
-    static float a = 0.7f;
-    static float norm = 1.0f / (1+a);
-    static int N = (int)(0.3 * m_sampleRate);
-
-    return norm * (
-                m_pX[m_idxX]
-      -     a * m_pX[(m_idxX + BUF_LEN - 1) % BUF_LEN]
-      +     a * m_pY[(m_idxY + BUF_LEN - 1) % BUF_LEN]
-      + (1-a) * m_pY[(m_idxY + BUF_LEN - N) % BUF_LEN]);
+    const float a = 0.7f;
+    const float norm = 1.0f / (1+a);
+    int N = m_echoDelay;
+
+    // At most N samples at a time, so that all of y[n-N] is already known.
+    size_t maxLen = std::max(N, 1);
+
+    // The anti-denormal bias goes into the input, so that it reaches the
+    // leaky integrator as well as the delayed output.
+    const float* const* in = m_antiDenormal ? y : x;
+
+    for (size_t pos = 0; pos < n; pos += maxLen) {
+        size_t len = std::min(n - pos, maxLen);
+        addAntiDenormal(x, y, pos, len);
+
+        // History is carried in registers across the block, for up to
+        // LANES channels at a time.
+        for (int c0 = 0; c0 < m_channels; c0 += LANES) {
+            int w = std::min((int)LANES, m_channels - c0);
+            const float* xs[LANES];
+            float* ys[LANES];
+            const float* yN[LANES];
+            for (int l = 0; l < w; l++) {
+                xs[l] = in[c0 + l] + pos;
+                ys[l] = y[c0 + l] + pos;
+                yN[l] = m_y[c0 + l].span(N);
+            }
+            float* x1 = m_x1 + c0;
+            float* y1 = m_y1 + c0;
+            float* frames = m_lanes.get();
+            switch (laneWidth(w)) {
+                case 1: naturalEchoLanes<1>(a, norm, xs, ys, yN, w, len, frames, x1, y1); break;
+                case 2: naturalEchoLanes<2>(a, norm, xs, ys, yN, w, len, frames, x1, y1); break;
+                case 4: naturalEchoLanes<4>(a, norm, xs, ys, yN, w, len, frames, x1, y1); break;
+                default: naturalEchoLanes<LANES>(a, norm, xs, ys, yN, w, len, frames, x1, y1); break;
+            }
+        }
+        commit(y, pos, len);
+    }
 }
 
 
-float SoundProcessor::reverb() {
+void SoundProcessor::reverb(const float* const* x, float* const* y, size_t n) {
     // Reverb model:
     // y[n] = -ax[n] + x[n-N] + ay[n-N]
-    static float a = 0.8f;
-    static float norm = 1.0f;
-    static int N = (int)(0.02 * m_sampleRate);
-
-    return norm * (
-      - a * m_pX[m_idxX]
-      +     m_pX[(m_idxX + BUF_LEN - N) % BUF_LEN]
-      + a * m_pY[(m_idxY + BUF_LEN - N) % BUF_LEN]);
+    const float a = 0.8f;
+    const float norm = 1.0f;
+    int N = m_reverbDelay;
+
+    // At most N samples at a time, so that all of y[n-N] is already known
+    // and the feedback can be computed like a feed-forward tap.
+    size_t maxLen = std::max(N, 1);
+
+    for (size_t pos = 0; pos < n; pos += maxLen) {
+        size_t len = std::min(n - pos, maxLen);
+        // x[n-N] is scaled by 1, which is exact.
+        for (int ch = 0; ch < m_channels; ch++)
+            simdKernels().mix3(y[ch] + pos, x[ch] + pos, m_x[ch].span(N), m_y[ch].span(N),
+                               -a, 1.0f, a, norm, len);
+        addAntiDenormal(y, y, pos, len);
+        commit(y, pos, len);
+    }
 }
 
 
-float SoundProcessor::biQuad() {
+void SoundProcessor::biQuad(const float* const* x, float* const* y, size_t n) {
     // Filtering operation:
     // y[n] = x[n] + b_1x[n-1] + b_2x[n-2] - a_1y[n-1] - a_2y[n-2]
-
-    // Pole (magnitude and phase).
-    static float pm = 0.98f;
-    static float pp = (float)(0.1 * PI);
-    // Zero (magnitude and phase).
-    static float zm = 0.9f;
-    static float zp = (float)(0.06 * PI);
-    static float norm = 0.5f;
-
-    float b1 = -2*zm*cos(zp);
-    float b2 = zm*zm;
-    float a1 = -2*pm*cos(pp);
-    float a2 = pm*pm;
-
-    return norm * (
-               m_pX[m_idxX]
-        + b1 * m_pX[(m_idxX + BUF_LEN - 1) % BUF_LEN]
-        + b2 * m_pX[(m_idxX + BUF_LEN - 2) % BUF_LEN]
-        - a1 * m_pY[(m_idxY + BUF_LEN - 1) % BUF_LEN]
-        - a2 * m_pY[(m_idxY + BUF_LEN - 2) % BUF_LEN]);
+    // (see filterOutCoeffs() for the pole and zero)
+    // The anti-denormal bias goes into the input, the state of the filter
+    // is its only feedback.
+    if (m_antiDenormal) {
+        addAntiDenormal(x, y, 0, n);
+        x = y;
+    }
+    m_filter.process(x, y, n);
+    commit(y, 0, n);
 }
 
 
-float SoundProcessor::fuzz() {
+void SoundProcessor::fuzz(const float* const* x, float* const* y, size_t n) {
     // Fuzz operation:
     // y[n] = a trunc(x[n]/a)
-    static float T = 0.005f;
-    static float G = 5;
-
-    static float limit = 32767 * T;
-
-    float y = m_pX[m_idxX];
-    if (y > limit)
-    y = limit;
-    if (y < -limit)
-    y = -limit;
-    return G*y;
+    float T = m_params.fuzzThreshold;
+    float G = m_params.fuzzGain;
+
+    float limit = m_params.fullScale * T;
+
+    // Clipping at F times the sample rate, so that the harmonics above
+    // Nyquist are filtered out before they can alias.
+    size_t F = m_fuzzOversampler.factor();
+    for (int ch = 0; ch < m_channels; ch++) {
+        if (F == 1) {
+            simdKernels().clampScale(y[ch], x[ch], limit, G, n);
+        } else {
+            float *v = m_fuzzOversampler.up(ch, x[ch], n);
+            simdKernels().clampScale(v, v, limit, G, n * F);
+            m_fuzzOversampler.down(ch, v, y[ch], n);
+        }
+    }
+    commit(y, 0, n);
 }
 
 
-float SoundProcessor::tremolo() {
+void SoundProcessor::tremolo(const float* const* x, float* const* y, size_t n) {
     // Tremolo model:
-    // y[n] = (1 + cos(wn)) x[n]
-
-    static double phi = 5 * 2*PI / m_sampleRate;  // 5Hz oscillator
-    static double omega = 0;
-
-    omega = omega + phi;
-    return (float)(((1 + cos(omega))/2) * m_pX[m_idxX]);
+    // y[n] = (1 + cos(wn))/2 x[n]
+    // (or another waveform of the oscillator, see Lfo)
+
+    // The gain is rendered in chunks, once for all channels, and applied
+    // with a vector kernel.
+    enum { GAIN_LEN = 256 };
+    float gain[GAIN_LEN];
+
+    for (size_t pos = 0; pos < n; pos += GAIN_LEN) {
+        size_t len = std::min((size_t)GAIN_LEN, n - pos);
+        m_tremoloLfo.render(gain, len);
+        for (int ch = 0; ch < m_channels; ch++)
+            simdKernels().modulate(y[ch] + pos, x[ch] + pos, gain, len);
+    }
+    commit(y, 0, n);
 }
 
 
-float SoundProcessor::flanger() {
+void SoundProcessor::flanger(const float* const* x, float* const* y, size_t n) {
     // Flanger model:
     // y[n] = x[n] + x[n - d ( 1+cos(wn) )]
+    // (or another waveform of the oscillator, see Lfo)
+
+    int N = m_flangerDelay;  // minimum delay
+    int FD = FLANGER_DEPTH;  // maximum delay factor
+
+    // The delay changes every sample, so each delayed sample has its own span.
+    // It is computed in chunks, once for all channels.
+    enum { DELAY_LEN = 256 };
+    float depth[DELAY_LEN];
+    int delay[DELAY_LEN];
+
+    for (size_t pos = 0; pos < n; pos += DELAY_LEN) {
+        size_t len = std::min((size_t)DELAY_LEN, n - pos);
+        m_flangerLfo.render(depth, len);
+        for (size_t i = 0; i < len; i++)
+            delay[i] = (int)(N * FD * depth[i]);
+        for (int ch = 0; ch < m_channels; ch++) {
+            for (size_t i = pos; i < pos + len; i++)
+                y[ch][i] = 0.5f + (x[ch][i] + m_x[ch].span(delay[i - pos])[i]);
+        }
+    }
+    commit(y, 0, n);
+}
+
+
+void SoundProcessor::equalizer(const float* const* x, float* const* y, size_t n) {
+    // Equalizer model, one peaking biquad per band in series:
+    // y = H_10(...H_2(H_1(x))), H_b boosting or cutting around the band centre.
+    if (m_antiDenormal) {
+        addAntiDenormal(x, y, 0, n);
+        x = y;
+    }
+    m_equalizer.process(x, y, n);
+    commit(y, 0, n);
+}
 
-    static int N = (int)(0.002 * m_sampleRate);  // minimum delay
-    static int FD = 2;  // maximum delay factor
-    static double phi = 1 * 2*PI / m_sampleRate;  // 1Hz oscillator
-    static double omega = 0;
 
-    int d = (int)(N * FD * (1 + cos(omega))/2);
-    omega = omega + phi;
-    return 0.5f + (m_pX[m_idxX] + m_pX[(m_idxX + BUF_LEN - d) % BUF_LEN]);
+void SoundProcessor::convolution(const float* const* x, float* const* y, size_t n) {
+    // Convolution reverb model, h is the impulse response of a room:
+    // y[n] = (1-m)x[n-L] + m(h * x)[n-L], L is the latency.
+    m_convolver->process(x, y, n);
+    commit(y, 0, n);
 }
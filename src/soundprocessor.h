@@ -1,9 +1,23 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
 
-// Buffer length 1.5 seconds @ 44100Hz.
-#define BUF_LEN 66150
+#include "biquad.h"
+#include "convolutionreverb.h"
+#include "delayline.h"
+#include "effects.h"
+#include "lfo.h"
+#include "oversampler.h"
+
+// Maximum number of samples the effects process in one go.
+#define CHUNK_LEN 1024
+
+// Maximum number of channels SoundProcessor processes.
+#define MAX_CHANNELS 64
 
 // List of sound effects that SoundProcessor class supports.
 const std::string kCoreProcesses[] = {
@@ -15,11 +29,78 @@ const std::string kCoreProcesses[] = {
     "Filter Out",
     "Fuzz",
     "Flanger",
-    "Tremolo"};
+    "Tremolo",
+    "Equalizer",
+    "Convolution Reverb"};
+
+// Number of sound effects in kCoreProcesses.
+const int kNumCoreProcesses = sizeof(kCoreProcesses) / sizeof(kCoreProcesses[0]);
+
+// Default silence threshold in dB relative to full scale (see
+// SoundProcessor::setSilenceBypass()).
+#define SILENCE_THRESHOLD_DB -90
+
+// Number of bands of the Equalizer.
+#define EQ_BANDS 10
+
+// Centre frequencies of the Equalizer bands in Hz (octaves).
+const double kEqFrequencies[EQ_BANDS] = {31.25, 62.5, 125, 250, 500, 1000, 2000, 4000, 8000, 16000};
+
+// Parameters of the sound effects that can be changed while they run
+// (see SoundProcessor::setParams()).
+struct EffectParams {
+    // Delay of Echo, IIR Echo and Natural Echo in seconds.
+    double echoDelay = ECHO_DELAY;
+
+    // Delay of Reverb in seconds.
+    double reverbDelay = REVERB_DELAY;
+
+    // Fuzz clipping level (fraction of full scale) and gain.
+    float fuzzThreshold = 0.005f;
+    float fuzzGain = 5;
+
+    // Fuzz oversampling factor (1, 2, 4 or 8, see Oversampler).
+    int fuzzOversampling = 4;
+
+    // Tremolo and Flanger oscillator rates in Hz and waveforms.
+    double tremoloRate = 5;
+    double flangerRate = 1;
+    LfoShape tremoloShape = LFO_SINE;
+    LfoShape flangerShape = LFO_SINE;
+
+    // Gain of each Equalizer band in dB (see kEqFrequencies).
+    float eqGains[EQ_BANDS] = {6, 4, 2, 0, -2, -2, 0, 2, 4, 6};
+
+    // Share of the reverb in the output of Convolution Reverb (0 to 1).
+    float convolutionMix = 0.4f;
+
+    // Level of a full scale sample: 32767 for samples in the range of 16 bit
+    // integers, 1 for float devices (see SampleTraits). Not a user setting.
+    float fullScale = 32767;
+
+    // Returns true if other has the same delays and Fuzz oversampling, so
+    // that switching to it needs no change to the effect history.
+    bool sameDelays(const EffectParams &other) const {
+        return echoDelay == other.echoDelay && reverbDelay == other.reverbDelay &&
+               fuzzOversampling == other.fuzzOversampling;
+    }
+};
+
+// Set the parameter called name (e.g. "echo-delay", see kEffectParamNames)
+// of params to value.
+// Returns false if there is no such parameter or value is out of its range.
+bool setEffectParam(EffectParams &params, const std::string &name, double value);
+
+// Names of the parameters accepted by setEffectParam(), comma separated.
+extern const char *kEffectParamNames;
 
 // SoundProcessor
 //
 // Class responsible for generating audio or sound effects.
+// Every channel has its own history and state, and instances share nothing,
+// so several processors (at any sample rates) can run on different threads. Channels are processed as
+// structure of arrays (one buffer per channel), and the effects that recurse
+// sample by sample run the channels side by side in vector lanes.
 class SoundProcessor {
     public:
         // Constructor.
@@ -28,11 +109,63 @@ class SoundProcessor {
         // Destructor.
         ~SoundProcessor();
 
-        // Initialize or set sample rate as desired before using this class.
-        // Default is 44.1kHz.
-        void initialize(int sampleRate) { m_sampleRate = sampleRate; }
+        // Initialize or set sample rate and number of channels (1 to MAX_CHANNELS)
+        // as desired before using this class.
+        // Default is 44.1kHz mono. This resets the current effect like setFunction().
+        void initialize(int sampleRate, int channels = 1);
+
+        // Returns the number of channels.
+        int channels() const { return m_channels; }
+
+        // Set the number of frames per block the stream delivers, which sets
+        // the partition length and latency of Convolution Reverb (see
+        // ConvolutionReverb::headLength()). Default is 256.
+        // Applies at the next setFunction() or initialize().
+        void setBlockSize(size_t blockSize) { m_blockSize = blockSize; }
+
+        // Set the impulse response of Convolution Reverb. NULL (the default)
+        // selects a synthetic 2 second room.
+        // Applies at the next setFunction() or initialize().
+        void setImpulseResponse(std::shared_ptr<const ImpulseResponse> ir) { m_impulseResponse = ir; }
+
+        // Add kAntiDenormal to the signal of IIR Echo, Natural Echo, Reverb,
+        // Filter Out and Equalizer, so that their tails never decay into
+        // subnormal floats (see denormals.h). For CPUs that cannot flush them
+        // to zero; off by default, which keeps the output bit-exact.
+        void setAntiDenormal(bool enable) { m_antiDenormal = enable; }
+
+        // Silence bypass: once the input of every channel has stayed below
+        // thresholdDb (mean square level of a block, in dB relative to full
+        // scale) for the tail of the effect (see tailLength()), blocks are not
+        // processed and the output is silence, until a block is above the
+        // threshold again. Bypassed blocks still go through the histories
+        // (the input, and silence as the output), as cheaply as a copy of
+        // the block, and the oscillators keep running, so the first loud
+        // block is processed right away as after real silence. Filter and
+        // Convolution Reverb state is left as is, it only holds levels below
+        // the threshold by then. Off by default.
+        void setSilenceBypass(bool enable, double thresholdDb = SILENCE_THRESHOLD_DB);
+
+        // Returns the number of samples the output of the current effect can
+        // stay above the silence threshold after its input went below it: the
+        // longest delay of the effects without feedback (2N for Echo), and for
+        // the others the time their feedback takes to decay from above full
+        // scale to the threshold.
+        size_t tailLength() const { return m_tailLength; }
+
+        // Returns the number of blocks (of up to CHUNK_LEN frames) processed,
+        // and how many of them were bypassed as silent.
+        uint64_t blocks() const { return m_blocks; }
+        uint64_t bypassedBlocks() const { return m_bypassedBlocks; }
+
+        // Returns the number of samples the output of the current effect lags
+        // its input (Convolution Reverb, and Fuzz when oversampled).
+        size_t latency() const;
 
         // Select the audio/sound effect function.
+        // Only the history the effect needs is allocated (and zeroed).
+        // Convolution Reverb also computes the spectra of its impulse response
+        // and starts its background thread here.
         // idxF: Index to the sound effect or dsp function (see kCoreProcesses at the top).
         void setFunction(int idxF);
 
@@ -41,57 +174,197 @@ class SoundProcessor {
         // Returns processed audio sample.
         float process(float sample);
 
+        // Process a block of audio samples to produce sound effect.
+        // The effect is selected once per block and each effect runs a tight
+        // loop over the block, so this is much cheaper than calling process()
+        // for every sample. Several channels are deinterleaved, processed with
+        // processChannels() and interleaved again.
+        // in: input audio samples (interleaved frames)
+        // out: processed audio samples (can be the same buffer as in)
+        // n: number of frames (samples per channel) in the block
+        void processBlock(const float* in, float* out, size_t n);
+
+        // Process a block of audio samples with one buffer per channel.
+        // in: input audio samples of each channel
+        // out: processed audio samples of each channel (can be the same buffers as in)
+        // n: number of samples per channel in the block
+        void processChannels(const float* const* in, float* const* out, size_t n);
+
         // Returns the index of the current audo effect in use.
         int option() { return m_idxF; }
 
+        // Set the effect parameters.
+        // Gains and rates apply right away without touching the history, so
+        // they can be changed between blocks on the audio thread. Changed
+        // delays resize the history and reset the effect like setFunction().
+        void setParams(const EffectParams &params);
+
+        // Returns the current effect parameters.
+        const EffectParams& params() const { return m_params; }
+
+        // Returns true if the output of the current effect only depends on
+        // the last overlap input samples of each channel (no feedback and no
+        // oscillator), so a signal can be cut anywhere and processed in
+        // pieces that each start overlap samples early.
+        bool feedForward(size_t &overlap);
+
     private:
+        // Delay line for input or output history.
+        typedef DelayLine<float, CHUNK_LEN> History;
+
+        // Number of samples of input and output history an effect reads.
+        // idxF: Index to the sound effect (see kCoreProcesses at the top).
+        void effectHistory(int idxF, size_t &historyX, size_t &historyY);
+
+        // Returns an effect delay given in seconds in samples, at least one
+        // (shorter delays would leave the history of the effect empty).
+        int delaySamples(double seconds) { return std::max((int)(seconds * m_sampleRate), 1); }
+
+        // Number of channels processed side by side by the recursive effects.
+        enum { LANES = 8 };
+
         // Process dispatcher.
-        float coreProcess();
+        // Runs the selected effect over n (<= CHUNK_LEN) samples of every
+        // channel. The input samples have already been written to the input
+        // history.
+        void coreProcess(const float* const* x, float* const* y, size_t n);
+
+        // Push n output samples of every channel, starting at pos, up output
+        // history and move both histories past them.
+        void commit(const float* const* y, size_t pos, size_t n);
+
+        // Silence bypass: returns true, after outputting silence into y, if
+        // the n samples of input x can be skipped (see setSilenceBypass()).
+        bool bypass(const float* const* x, float* const* y, size_t n);
+
+        // Returns true if the mean square of the n samples of every channel
+        // of x is below the silence threshold.
+        bool silent(const float* const* x, size_t n) const;
+
+        // Set the tail of the current effect from the delays, filters and
+        // silence threshold (see tailLength()).
+        void setTail();
+
+        // With anti-denormal on, set n samples of every channel of y, starting
+        // at pos, to those of x plus kAntiDenormal (x and y may be the same
+        // buffers). Does nothing otherwise.
+        void addAntiDenormal(const float* const* x, float* const* y, size_t pos, size_t n);
 
         // Core processing algorithms.
+        // Each one processes n input samples x into n output samples y of
+        // every channel (x and y may be the same buffers) and commits them.
         // No effect.
-        float pass();
+        void pass(const float* const* x, float* const* y, size_t n);
 
         // Echo (ideal).
-        float echo();
+        void echo(const float* const* x, float* const* y, size_t n);
 
         // Echo (ideal with feedback).
-        float iirEcho();
+        void iirEcho(const float* const* x, float* const* y, size_t n);
 
         // Echo (natural, something closer to what happens in real life).
-        float naturalEcho();
+        void naturalEcho(const float* const* x, float* const* y, size_t n);
 
         // Reverberation.
-        float reverb();
+        void reverb(const float* const* x, float* const* y, size_t n);
 
         // Filter the input to discard high frequencies.
-        float biQuad();
+        void biQuad(const float* const* x, float* const* y, size_t n);
 
         // Tremolo effect.
-        float tremolo();
+        void tremolo(const float* const* x, float* const* y, size_t n);
 
         // Fuzz effect.
-        float fuzz();
+        void fuzz(const float* const* x, float* const* y, size_t n);
 
         // Flanger effect.
-        float flanger();
+        void flanger(const float* const* x, float* const* y, size_t n);
+
+        // Ten band graphic equalizer.
+        void equalizer(const float* const* x, float* const* y, size_t n);
+
+        // Reverberation by convolution with an impulse response.
+        void convolution(const float* const* x, float* const* y, size_t n);
+
+        // Set the delays in samples from m_params and the sample rate.
+        void setDelays();
+
+        // Set the rates and waveforms of the oscillators from m_params.
+        void setOscillators();
+
+        // Set the sections of the filters from m_params.
+        void setFilters();
 
         // Sample rate or frequency in Hz.
         int m_sampleRate;
 
-        // Buffer length.
-        //enum {BUF_LEN = 60000};
-        //enum {BUF_MASK = BUF_LEN};
+        // Number of channels.
+        int m_channels;
+
+        // Delays of Echo, IIR Echo and Natural Echo, of Reverb and the
+        // minimum delay of Flanger in samples (see setDelays()).
+        int m_echoDelay;
+        int m_reverbDelay;
+        int m_flangerDelay;
+
+        // Output history of each channel, empty if the effect does not need it.
+        History m_y[MAX_CHANNELS];
+
+        // Input history of each channel, empty if the effect does not need it.
+        History m_x[MAX_CHANNELS];
+
+        // Storage of the histories of all channels, sized for the selected effect.
+        // It only grows, so switching effects never allocates more than once.
+        std::unique_ptr<float[]> m_arena;
+        size_t m_arenaSize;
+
+        // Deinterleaved chunk of every channel for processBlock()
+        // (CHUNK_LEN samples per channel, only with several channels).
+        std::unique_ptr<float[]> m_planar;
+
+        // Scratch of the effects that run channels side by side in vector
+        // lanes (see LANES).
+        std::unique_ptr<float[]> m_lanes;
+
+        // Last input and output sample of each channel, for Natural Echo
+        // (kept out of the delay lines).
+        float m_x1[MAX_CHANNELS];
+        float m_y1[MAX_CHANNELS];
+
+        // Filters of Filter Out and Equalizer.
+        BiquadCascade m_filter;
+        BiquadCascade m_equalizer;
+
+        // Convolution Reverb, only while it is the selected effect, its
+        // impulse response and the block size it is set up for.
+        std::unique_ptr<ConvolutionReverb> m_convolver;
+        std::shared_ptr<const ImpulseResponse> m_impulseResponse;
+        size_t m_blockSize;
+
+        // Up and downsampling filters of Fuzz.
+        Oversampler m_fuzzOversampler;
+
+        // Oscillators of Tremolo and Flanger.
+        Lfo m_tremoloLfo;
+        Lfo m_flangerLfo;
+
+        // Effect parameters.
+        EffectParams m_params;
+
+        // Bias the feedback effects away from subnormals (see setAntiDenormal()).
+        bool m_antiDenormal;
 
-        // Output buffer.
-        float m_pY[BUF_LEN];
-        // Output buffer index.
-        int m_idxY;
+        // Silence bypass (see setSilenceBypass()): enabled, threshold as a
+        // fraction of full scale, tail of the current effect, input samples
+        // below the threshold in a row.
+        bool m_silenceBypass;
+        float m_silenceLevel;
+        size_t m_tailLength;
+        size_t m_quietSamples;
 
-        // Input buffer.
-        float m_pX[BUF_LEN];
-        // Input buffer index.
-        int m_idxX;
+        // Blocks processed, and bypassed as silent.
+        uint64_t m_blocks;
+        uint64_t m_bypassedBlocks;
 
         // Index for sound effect or dsp function (see kCoreProcesses at the top).
         int m_idxF;
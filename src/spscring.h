@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string.h>
+
+// SpscRing
+//
+// Wait-free ring buffer for exactly one producer thread and one consumer
+// thread (e.g. an audio callback and a DSP thread). All memory is allocated
+// up front; write() and read() never block, lock or allocate, they just
+// transfer as many elements as currently fit or are available.
+// T: element type (trivially copyable).
+template <typename T>
+class SpscRing {
+    public:
+        // capacity: minimum number of elements the ring can hold (rounded up to a power of two).
+        explicit SpscRing(size_t capacity)
+                : m_head(0),
+                  m_tail(0) {
+            m_capacity = 1;
+            while (m_capacity < capacity)
+                m_capacity *= 2;
+            m_buf.reset(new T[m_capacity]);
+        }
+
+        // Maximum number of elements in the ring.
+        size_t capacity() const { return m_capacity; }
+
+        // Number of elements that can be read (exact for the consumer).
+        size_t readAvailable() const {
+            return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+        }
+
+        // Number of elements that can be written (exact for the producer).
+        size_t writeAvailable() const { return m_capacity - readAvailable(); }
+
+        // Producer: append up to n elements. Returns the number written.
+        size_t write(const T *data, size_t n) {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            size_t tail = m_tail.load(std::memory_order_acquire);
+            size_t count = m_capacity - (head - tail);
+            if (n < count)
+                count = n;
+            copyIn(head, data, count);
+            m_head.store(head + count, std::memory_order_release);
+            return count;
+        }
+
+        // Consumer: take up to n elements. Returns the number read.
+        size_t read(T *data, size_t n) {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            size_t head = m_head.load(std::memory_order_acquire);
+            size_t count = head - tail;
+            if (n < count)
+                count = n;
+            copyOut(tail, data, count);
+            m_tail.store(tail + count, std::memory_order_release);
+            return count;
+        }
+
+    private:
+        // Copy count elements into the ring starting at index pos, wrapping at the end.
+        void copyIn(size_t pos, const T *data, size_t count) {
+            size_t start = pos & (m_capacity - 1);
+            size_t first = m_capacity - start < count ? m_capacity - start : count;
+            memcpy(&m_buf[start], data, sizeof(T) * first);
+            memcpy(&m_buf[0], data + first, sizeof(T) * (count - first));
+        }
+
+        // Copy count elements out of the ring starting at index pos, wrapping at the end.
+        void copyOut(size_t pos, T *data, size_t count) const {
+            size_t start = pos & (m_capacity - 1);
+            size_t first = m_capacity - start < count ? m_capacity - start : count;
+            memcpy(data, &m_buf[start], sizeof(T) * first);
+            memcpy(data + first, &m_buf[0], sizeof(T) * (count - first));
+        }
+
+        // Free running write and read indices, on separate cache lines so the
+        // producer and the consumer do not contend.
+        alignas(64) std::atomic<size_t> m_head;
+        alignas(64) std::atomic<size_t> m_tail;
+
+        alignas(64) size_t m_capacity;
+        std::unique_ptr<T[]> m_buf;
+};
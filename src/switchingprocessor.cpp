@@ -0,0 +1,162 @@
+#include "switchingprocessor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+SwitchingProcessor::SwitchingProcessor()
+        : m_active(0),
+          m_standby(STANDBY_IDLE),
+          m_fadeLen(1),
+          m_fadePos(0),
+          m_sampleRate(44100),
+          m_channels(1),
+          m_idxF(0),
+          m_blockSize(256),
+          m_antiDenormal(false),
+          m_silenceBypass(false),
+          m_silenceThresholdDb(SILENCE_THRESHOLD_DB),
+          m_latency(0),
+          m_blocks(0),
+          m_bypassedBlocks(0) {
+    initialize(m_sampleRate, m_channels);
+}
+
+void SwitchingProcessor::initialize(int sampleRate, int channels) {
+    m_sampleRate = sampleRate;
+    m_fadeLen = std::max((size_t)(CROSSFADE_TIME * sampleRate), (size_t)1);
+
+    for (int i = 0; i < 2; i++) {
+        m_processors[i].setBlockSize(m_blockSize);
+        m_processors[i].setImpulseResponse(m_impulseResponse);
+        m_processors[i].setAntiDenormal(m_antiDenormal);
+        m_processors[i].setSilenceBypass(m_silenceBypass, m_silenceThresholdDb);
+        m_processors[i].initialize(sampleRate, channels);
+    }
+    m_channels = m_processors[0].channels();
+    m_fadeBlock.reset(new float[CHUNK_LEN * m_channels]);
+    m_active = 0;
+    m_standby = STANDBY_IDLE;
+
+    m_processors[m_active].setParams(m_params);
+    m_processors[m_active].setFunction(m_idxF);
+    m_audioParams = m_params;
+    m_latency = m_processors[m_active].latency();
+}
+
+void SwitchingProcessor::setFunction(int idxF) {
+    m_idxF = idxF;
+    prepareStandby();
+}
+
+void SwitchingProcessor::setParams(const EffectParams &params) {
+    bool sameDelays = params.sameDelays(m_params);
+    m_params = params;
+    m_paramSnapshot.publish(params);
+    if (!sameDelays)
+        prepareStandby();
+}
+
+void SwitchingProcessor::prepareStandby() {
+    // Take back a standby processor the audio thread has not picked up yet,
+    // or wait for the running crossfade to end.
+    while (true) {
+        int state = m_standby.load(std::memory_order_acquire);
+        if (state == STANDBY_IDLE)
+            break;
+        if (state == STANDBY_READY &&
+            m_standby.compare_exchange_strong(state, STANDBY_IDLE, std::memory_order_acq_rel))
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Allocating and clearing the history happens here, off the audio thread.
+    SoundProcessor &standby = m_processors[1 - m_active];
+    standby.setParams(m_params);
+    standby.setBlockSize(m_blockSize);
+    standby.setImpulseResponse(m_impulseResponse);
+    standby.setAntiDenormal(m_antiDenormal);
+    standby.setSilenceBypass(m_silenceBypass, m_silenceThresholdDb);
+    standby.setFunction(m_idxF);
+    m_latency = standby.latency();
+
+    m_standby.store(STANDBY_READY, std::memory_order_release);
+}
+
+void SwitchingProcessor::applyParams(SoundProcessor &processor) {
+    // Only gains and rates: the delays and Fuzz oversampling of a processor
+    // are set by the control thread, together with the history they need.
+    EffectParams params = m_audioParams;
+    params.echoDelay = processor.params().echoDelay;
+    params.reverbDelay = processor.params().reverbDelay;
+    params.fuzzOversampling = processor.params().fuzzOversampling;
+    processor.setParams(params);
+}
+
+void SwitchingProcessor::processBlock(const float* in, float* out, size_t n) {
+    // Pick up a prepared effect and new parameters at the block boundary.
+    int state = STANDBY_READY;
+    bool startFade = m_standby.compare_exchange_strong(state, STANDBY_FADING,
+                                                       std::memory_order_acq_rel);
+    bool fading = startFade || state == STANDBY_FADING;
+    bool newParams = m_paramSnapshot.fetch(m_audioParams);
+
+    if (startFade)
+        m_fadePos = 0;
+    if (newParams || startFade) {
+        applyParams(m_processors[m_active]);
+        if (fading)
+            applyParams(m_processors[1 - m_active]);
+    }
+
+    if (fading) {
+        size_t done = crossfade(in, out, n);
+        in += done * m_channels;
+        out += done * m_channels;
+        n -= done;
+    }
+    if (n > 0)
+        m_processors[m_active].processBlock(in, out, n);
+
+    // Counted by the processors, per block of up to CHUNK_LEN frames.
+    m_blocks.store(m_processors[0].blocks() + m_processors[1].blocks(), std::memory_order_relaxed);
+    m_bypassedBlocks.store(m_processors[0].bypassedBlocks() + m_processors[1].bypassedBlocks(),
+                           std::memory_order_relaxed);
+}
+
+size_t SwitchingProcessor::crossfade(const float* in, float* out, size_t n) {
+    SoundProcessor &from = m_processors[m_active];
+    SoundProcessor &to = m_processors[1 - m_active];
+    float step = 1.0f / m_fadeLen;
+    size_t done = 0;
+
+    while (done < n && m_fadePos < m_fadeLen) {
+        size_t len = std::min(std::min(n - done, (size_t)CHUNK_LEN), m_fadeLen - m_fadePos);
+
+        // The new effect first, out may be the same buffer as in.
+        const float *x = in + done * m_channels;
+        float *y = out + done * m_channels;
+        float *z = m_fadeBlock.get();
+        to.processBlock(x, z, len);
+        from.processBlock(x, y, len);
+
+        // Linear fade from the old to the new output, one gain per frame.
+        for (size_t i = 0; i < len; i++) {
+            float g = (m_fadePos + i + 1) * step;
+            for (int ch = 0; ch < m_channels; ch++) {
+                size_t k = i * m_channels + ch;
+                y[k] = y[k] + g * (z[k] - y[k]);
+            }
+        }
+        m_fadePos += len;
+        done += len;
+    }
+
+    if (m_fadePos == m_fadeLen) {
+        // The standby processor takes over, the old one goes back to the
+        // control thread.
+        m_active = 1 - m_active;
+        m_standby.store(STANDBY_IDLE, std::memory_order_release);
+    }
+    return done;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "snapshot.h"
+#include "soundprocessor.h"
+
+// Length of the crossfade between two effects in seconds.
+#define CROSSFADE_TIME 0.02
+
+// SwitchingProcessor
+//
+// SoundProcessor whose effect and parameters can be changed from a control
+// thread while the audio thread keeps processing.
+//
+// Only the control thread allocates: a new effect is prepared on a standby
+// SoundProcessor, which the audio thread picks up at the next block boundary
+// and crossfades to over CROSSFADE_TIME, so switching does not click. Gains
+// and rates are handed over through a lock-free Snapshot and applied at block
+// boundaries. processBlock() never locks, allocates or clears memory.
+//
+// There must be at most one control thread and one audio thread.
+class SwitchingProcessor {
+    public:
+        SwitchingProcessor();
+
+        // Initialize or set sample rate and number of channels before
+        // processing starts.
+        // This resets the current effect immediately, without a crossfade.
+        void initialize(int sampleRate, int channels = 1);
+
+        // Control thread: set the frames per block of the stream (see
+        // SoundProcessor::setBlockSize()).
+        // Applies the next time an effect is selected.
+        void setBlockSize(size_t blockSize) { m_blockSize = blockSize; }
+
+        // Control thread: set the impulse response of Convolution Reverb
+        // (see SoundProcessor::setImpulseResponse()).
+        // Applies the next time an effect is selected.
+        void setImpulseResponse(std::shared_ptr<const ImpulseResponse> ir) { m_impulseResponse = ir; }
+
+        // Control thread: bias the feedback effects away from subnormals
+        // (see SoundProcessor::setAntiDenormal()).
+        // Applies the next time an effect is selected.
+        void setAntiDenormal(bool enable) { m_antiDenormal = enable; }
+
+        // Control thread: skip silent blocks once the tail of the effect has
+        // passed (see SoundProcessor::setSilenceBypass()).
+        // Applies the next time an effect is selected.
+        void setSilenceBypass(bool enable, double thresholdDb = SILENCE_THRESHOLD_DB) {
+            m_silenceBypass = enable;
+            m_silenceThresholdDb = thresholdDb;
+        }
+
+        // Any thread: returns the number of blocks (of up to CHUNK_LEN frames)
+        // processed, and how many of them were bypassed as silent, summed
+        // over both processors (see SoundProcessor::blocks()); the blocks of
+        // a crossfade count for both. Updated after every processBlock().
+        uint64_t blocks() const { return m_blocks; }
+        uint64_t bypassedBlocks() const { return m_bypassedBlocks; }
+
+        // Control thread: returns the latency of the last selected effect in
+        // frames (see SoundProcessor::latency()).
+        size_t latency() const { return m_latency; }
+
+        // Control thread: switch to another audio/sound effect function.
+        // Waits (without holding up the audio thread) if a crossfade is running.
+        // idxF: Index to the sound effect or dsp function (see kCoreProcesses).
+        void setFunction(int idxF);
+
+        // Control thread: change the effect parameters.
+        // Changed delays need a new history and are crossfaded like an effect
+        // switch, the other parameters apply at the next block.
+        void setParams(const EffectParams &params);
+
+        // Control thread: returns the index of the last selected effect.
+        int option() const { return m_idxF; }
+
+        // Control thread: returns the last set effect parameters.
+        const EffectParams& params() const { return m_params; }
+
+        // Audio thread: process a block of audio samples.
+        // in: input audio samples (interleaved frames)
+        // out: processed audio samples (can be the same buffer as in)
+        // n: number of frames in the block
+        void processBlock(const float* in, float* out, size_t n);
+
+    private:
+        // State of the standby processor.
+        enum {
+            // Owned by the control thread.
+            STANDBY_IDLE,
+            // Prepared by the control thread, waiting for the audio thread.
+            STANDBY_READY,
+            // Owned by the audio thread, crossfading to it.
+            STANDBY_FADING
+        };
+
+        // Control thread: prepare the standby processor with the given effect
+        // and parameters and hand it to the audio thread.
+        void prepareStandby();
+
+        // Audio thread: set the gains and rates last fetched from the control
+        // thread on processor, keeping its delays.
+        void applyParams(SoundProcessor &processor);
+
+        // Audio thread: process n samples crossfading from the active to the
+        // standby processor. Returns the number of samples processed, fewer
+        // than n if the crossfade ended.
+        size_t crossfade(const float* in, float* out, size_t n);
+
+        // Active and standby processors.
+        SoundProcessor m_processors[2];
+
+        // Index of the active processor in m_processors. Only changed by the
+        // audio thread at the end of a crossfade.
+        int m_active;
+
+        // State of the standby processor (see the enum above).
+        std::atomic<int> m_standby;
+
+        // Parameters handed to the audio thread.
+        Snapshot<EffectParams> m_paramSnapshot;
+
+        // Crossfade length and position in frames.
+        size_t m_fadeLen;
+        size_t m_fadePos;
+
+        // Output of the standby processor during a crossfade (CHUNK_LEN frames).
+        std::unique_ptr<float[]> m_fadeBlock;
+
+        // Sample rate, number of channels, effect and parameters last set by
+        // the control thread.
+        int m_sampleRate;
+        int m_channels;
+        int m_idxF;
+        EffectParams m_params;
+
+        // Block size, impulse response, anti-denormal bias, silence bypass
+        // and latency last set for the processors by the control thread.
+        size_t m_blockSize;
+        std::shared_ptr<const ImpulseResponse> m_impulseResponse;
+        bool m_antiDenormal;
+        bool m_silenceBypass;
+        double m_silenceThresholdDb;
+        size_t m_latency;
+
+        // Parameters last applied by the audio thread.
+        EffectParams m_audioParams;
+
+        // Blocks processed and bypassed by the processors, published by the
+        // audio thread.
+        std::atomic<uint64_t> m_blocks;
+        std::atomic<uint64_t> m_bypassedBlocks;
+};
@@ -0,0 +1,53 @@
+#include "voicebank.h"
+
+#include <algorithm>
+
+// Groups are filled to whole vectors of lanes where possible.
+#define VOICE_LANES 8
+
+VoiceBank::VoiceBank()
+        : m_sampleRate(44100),
+          m_voices(0),
+          m_idxF(0) {
+    initialize(m_sampleRate, 1);
+}
+
+void VoiceBank::initialize(int sampleRate, int voices) {
+    m_sampleRate = sampleRate;
+    m_voices = std::max(voices, 1);
+
+    // As few groups as possible, of about the same size, rounded up to
+    // whole vectors so that only the last group has a partial one.
+    int groups = (m_voices + MAX_CHANNELS - 1) / MAX_CHANNELS;
+    int size = (m_voices + groups - 1) / groups;
+    size = std::min((size + VOICE_LANES - 1) / VOICE_LANES * VOICE_LANES, (int)MAX_CHANNELS);
+
+    m_groups.clear();
+    m_first.clear();
+    for (int first = 0; first < m_voices; first += size) {
+        std::unique_ptr<SoundProcessor> group(new SoundProcessor());
+        group->initialize(sampleRate, std::min(size, m_voices - first));
+        group->setParams(m_params);
+        group->setFunction(m_idxF);
+        m_groups.push_back(std::move(group));
+        m_first.push_back(first);
+    }
+    m_first.push_back(m_voices);
+}
+
+void VoiceBank::setFunction(int idxF) {
+    m_idxF = idxF;
+    for (auto &group : m_groups)
+        group->setFunction(idxF);
+}
+
+void VoiceBank::setParams(const EffectParams &params) {
+    m_params = params;
+    for (auto &group : m_groups)
+        group->setParams(params);
+}
+
+void VoiceBank::process(const float* const* in, float* const* out, size_t n) {
+    for (size_t g = 0; g < m_groups.size(); g++)
+        m_groups[g]->processChannels(in + m_first[g], out + m_first[g], n);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "soundprocessor.h"
+
+// VoiceBank
+//
+// Many independent mono voices (e.g. the streams of a conference mixer)
+// running the same effect with the same parameters.
+// The voices are the channels of SoundProcessors of up to MAX_CHANNELS
+// channels each, kept as structure of arrays, so the recursive effects run
+// one sample of several voices per vector lane instead of one voice at a
+// time, and the feed-forward ones share their per-block work (e.g. the
+// oscillator of Tremolo, which is in phase on all the voices).
+class VoiceBank {
+    public:
+        VoiceBank();
+
+        // Set the sample rate and number of voices (at least 1).
+        // Allocates, and resets the state of every voice.
+        void initialize(int sampleRate, int voices);
+
+        // Returns the number of voices.
+        int voices() const { return m_voices; }
+
+        // Select the effect of all the voices (see SoundProcessor::setFunction()).
+        void setFunction(int idxF);
+
+        // Set the effect parameters of all the voices (see SoundProcessor::setParams()).
+        void setParams(const EffectParams &params);
+
+        // Process n samples of every voice.
+        // in: input samples of each voice
+        // out: output samples of each voice (can be the same buffers as in)
+        void process(const float* const* in, float* const* out, size_t n);
+
+    private:
+        int m_sampleRate;
+        int m_voices;
+
+        // Effect and parameters of all the voices.
+        int m_idxF;
+        EffectParams m_params;
+
+        // Processors of consecutive groups of voices.
+        std::vector<std::unique_ptr<SoundProcessor>> m_groups;
+
+        // First voice of each group, and one past the last voice of the bank.
+        std::vector<int> m_first;
+};
@@ -0,0 +1,219 @@
+#include "wavfile.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// WAV format tags.
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+// Size of the header written for output files:
+// RIFF header (12) + fmt chunk (8 + 16) + data chunk header (8).
+#define WAV_HEADER_LEN 44
+
+
+static uint16_t readU16(const uint8_t *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t readU32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void writeU16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void writeU32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+
+WavFile::WavFile()
+        : m_fd(-1),
+          m_map(NULL),
+          m_mapSize(0),
+          m_data(NULL),
+          m_format(WAV_INT16),
+          m_channels(0),
+          m_sampleRate(0),
+          m_frames(0) {
+}
+
+WavFile::~WavFile() {
+    close();
+}
+
+int WavFile::bytesPerSample() const {
+    return m_format == WAV_FLOAT32 ? 4 : 2;
+}
+
+bool WavFile::openRead(const char *path) {
+    close();
+
+    m_fd = open(path, O_RDONLY);
+    if (m_fd < 0) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0 || st.st_size < 12) {
+        fprintf(stderr, "%s is not a WAV file\n", path);
+        close();
+        return false;
+    }
+
+    m_mapSize = st.st_size;
+    m_map = mmap(NULL, m_mapSize, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (m_map == MAP_FAILED) {
+        m_map = NULL;
+        fprintf(stderr, "Could not map %s\n", path);
+        close();
+        return false;
+    }
+    // Samples are streamed front to back exactly once.
+    madvise(m_map, m_mapSize, MADV_SEQUENTIAL);
+
+    if (!parse(path)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool WavFile::parse(const char *path) {
+    const uint8_t *p = (const uint8_t*)m_map;
+    const uint8_t *end = p + m_mapSize;
+
+    if (memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0) {
+        fprintf(stderr, "%s is not a WAV file\n", path);
+        return false;
+    }
+
+    bool haveFmt = false;
+    int formatTag = 0;
+    int bitsPerSample = 0;
+    p += 12;
+    while (p + 8 <= end) {
+        uint32_t chunkSize = readU32(p + 4);
+        const uint8_t *chunk = p + 8;
+
+        if (memcmp(p, "fmt ", 4) == 0 && chunkSize >= 16 && chunk + 16 <= end) {
+            formatTag = readU16(chunk);
+            m_channels = readU16(chunk + 2);
+            m_sampleRate = (int)readU32(chunk + 4);
+            bitsPerSample = readU16(chunk + 14);
+            // The sub-format GUID starts with the actual format tag.
+            if (formatTag == WAVE_FORMAT_EXTENSIBLE && chunkSize >= 26 && chunk + 26 <= end)
+                formatTag = readU16(chunk + 24);
+            haveFmt = true;
+        } else if (memcmp(p, "data", 4) == 0) {
+            if (!haveFmt)
+                break;
+            if (formatTag == WAVE_FORMAT_PCM && bitsPerSample == 16) {
+                m_format = WAV_INT16;
+            } else if (formatTag == WAVE_FORMAT_IEEE_FLOAT && bitsPerSample == 32) {
+                m_format = WAV_FLOAT32;
+            } else {
+                fprintf(stderr, "%s: unsupported sample format (tag %d, %d bits)\n",
+                        path, formatTag, bitsPerSample);
+                return false;
+            }
+            if (m_channels <= 0) {
+                fprintf(stderr, "%s: invalid channel count\n", path);
+                return false;
+            }
+            // Streamed files may have a bogus data size, never read past the end.
+            size_t available = end - chunk;
+            size_t size = chunkSize < available ? chunkSize : available;
+            m_data = (uint8_t*)chunk;
+            m_frames = size / (bytesPerSample() * m_channels);
+            return true;
+        }
+
+        // Chunks are padded to even sizes.
+        size_t skip = 8 + (size_t)chunkSize + (chunkSize & 1);
+        if (skip > (size_t)(end - p))
+            break;
+        p += skip;
+    }
+
+    fprintf(stderr, "%s: no audio data found\n", path);
+    return false;
+}
+
+bool WavFile::create(const char *path, WavFormat format, int channels, int sampleRate, size_t frames) {
+    close();
+
+    m_format = format;
+    m_channels = channels;
+    m_sampleRate = sampleRate;
+    m_frames = frames;
+
+    size_t dataSize = frames * channels * bytesPerSample();
+    if (dataSize > 0xFFFFFFFFu - (WAV_HEADER_LEN - 8)) {
+        fprintf(stderr, "%s: output is too large for a WAV file\n", path);
+        return false;
+    }
+
+    m_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0) {
+        fprintf(stderr, "Could not create %s\n", path);
+        return false;
+    }
+
+    // Preallocate the whole file so that streaming never extends it.
+    m_mapSize = WAV_HEADER_LEN + dataSize;
+    if (ftruncate(m_fd, m_mapSize) != 0) {
+        fprintf(stderr, "Could not allocate %zu bytes for %s\n", m_mapSize, path);
+        close();
+        return false;
+    }
+
+    m_map = mmap(NULL, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (m_map == MAP_FAILED) {
+        m_map = NULL;
+        fprintf(stderr, "Could not map %s\n", path);
+        close();
+        return false;
+    }
+
+    uint8_t *h = (uint8_t*)m_map;
+    int blockAlign = channels * bytesPerSample();
+    memcpy(h, "RIFF", 4);
+    writeU32(h + 4, (uint32_t)(m_mapSize - 8));
+    memcpy(h + 8, "WAVE", 4);
+    memcpy(h + 12, "fmt ", 4);
+    writeU32(h + 16, 16);
+    writeU16(h + 20, format == WAV_FLOAT32 ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+    writeU16(h + 22, (uint16_t)channels);
+    writeU32(h + 24, (uint32_t)sampleRate);
+    writeU32(h + 28, (uint32_t)(sampleRate * blockAlign));
+    writeU16(h + 32, (uint16_t)blockAlign);
+    writeU16(h + 34, (uint16_t)(8 * bytesPerSample()));
+    memcpy(h + 36, "data", 4);
+    writeU32(h + 40, (uint32_t)dataSize);
+
+    m_data = h + WAV_HEADER_LEN;
+    return true;
+}
+
+void WavFile::close() {
+    if (m_map != NULL)
+        munmap(m_map, m_mapSize);
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_fd = -1;
+    m_map = NULL;
+    m_mapSize = 0;
+    m_data = NULL;
+    m_frames = 0;
+}
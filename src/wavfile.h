@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Sample formats of the WAV files that can be read and written.
+enum WavFormat {
+    WAV_INT16,      // Signed 16 bit integer PCM.
+    WAV_FLOAT32     // 32 bit IEEE float.
+};
+
+// WavFile
+//
+// Memory-mapped WAV (RIFF) file.
+// Input files are mapped read-only. Output files are created at their final
+// size up front and mapped read-write, so sample data is read and written in
+// place through data() without any copying or allocation while streaming.
+// Only little-endian hosts are supported (WAV data is little-endian).
+class WavFile {
+    public:
+        WavFile();
+
+        // Destructor unmaps and closes the file.
+        ~WavFile();
+
+        // Open and map an existing WAV file for reading.
+        // path: path of the WAV file.
+        // Returns true on success, prints the reason and returns false otherwise.
+        bool openRead(const char *path);
+
+        // Create, preallocate and map a WAV file for writing.
+        // The header is written immediately, sample data is written through data().
+        // path: path of the WAV file (overwritten if it exists).
+        // format: sample format.
+        // channels: number of interleaved channels.
+        // sampleRate: sample rate in Hz.
+        // frames: number of frames (samples per channel) the file will hold.
+        // Returns true on success, prints the reason and returns false otherwise.
+        bool create(const char *path, WavFormat format, int channels, int sampleRate, size_t frames);
+
+        // Unmap and close the file. Called by the destructor.
+        void close();
+
+        // Sample format of the file.
+        WavFormat format() const { return m_format; }
+
+        // Number of interleaved channels.
+        int channels() const { return m_channels; }
+
+        // Sample rate in Hz.
+        int sampleRate() const { return m_sampleRate; }
+
+        // Number of frames (samples per channel).
+        size_t frames() const { return m_frames; }
+
+        // Size of one sample in bytes.
+        int bytesPerSample() const;
+
+        // Pointer to the first byte of interleaved sample data.
+        void* data() { return m_data; }
+        const void* data() const { return m_data; }
+
+    private:
+        // Parse RIFF header and chunks of a mapped input file.
+        bool parse(const char *path);
+
+        // File descriptor, -1 when closed.
+        int m_fd;
+
+        // Mapping of the whole file.
+        void *m_map;
+        size_t m_mapSize;
+
+        // Start of sample data within the mapping.
+        uint8_t *m_data;
+
+        WavFormat m_format;
+        int m_channels;
+        int m_sampleRate;
+        size_t m_frames;
+};
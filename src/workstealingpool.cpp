@@ -0,0 +1,67 @@
+#include "workstealingpool.h"
+
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(int threads)
+        : m_next(0),
+          m_steals(0) {
+    if (threads < 1)
+        threads = 1;
+    for (int i = 0; i < threads; i++)
+        m_queues.emplace_back(new Queue());
+}
+
+void WorkStealingPool::submit(Task task, int worker) {
+    if (worker < 0 || worker >= threads()) {
+        worker = m_next;
+        m_next = (m_next + 1) % threads();
+    }
+    m_queues[worker]->tasks.push_back(std::move(task));
+}
+
+void WorkStealingPool::run() {
+    m_steals = 0;
+
+    // The calling thread is worker 0.
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads(); i++)
+        workers.emplace_back(&WorkStealingPool::work, this, i);
+    work(0);
+    for (std::thread &t : workers)
+        t.join();
+}
+
+void WorkStealingPool::work(int worker) {
+    Task task;
+    // No tasks are added while running, so once every deque was found empty
+    // there is nothing left to do.
+    while (popOwn(worker, task) || steal(worker, task)) {
+        task(worker);
+        task = nullptr;
+    }
+}
+
+bool WorkStealingPool::popOwn(int worker, Task &task) {
+    Queue &q = *m_queues[worker];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.tasks.empty())
+        return false;
+    task = std::move(q.tasks.back());
+    q.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(int worker, Task &task) {
+    // Start with the next worker, so that thieves spread over the victims.
+    for (int i = 1; i < threads(); i++) {
+        Queue &q = *m_queues[(worker + i) % threads()];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.tasks.empty())
+            continue;
+        task = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        m_steals++;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// WorkStealingPool
+//
+// Runs a batch of tasks on a fixed number of worker threads. Every worker has
+// its own deque of tasks: it runs tasks from the back of its own deque and,
+// when that is empty, steals from the front of the other workers' deques, so
+// uneven tasks (long and short files) still keep all the cores busy. Tasks
+// are meant to be coarse (milliseconds or more), so each deque is simply
+// guarded by its own mutex; workers rarely touch the same one.
+class WorkStealingPool {
+    public:
+        // Task, called with the index of the worker running it.
+        typedef std::function<void(int worker)> Task;
+
+        // threads: number of worker threads (at least 1).
+        explicit WorkStealingPool(int threads);
+
+        // Number of worker threads.
+        int threads() const { return (int)m_queues.size(); }
+
+        // Queue a task on the given worker, or on the next worker in turn if
+        // worker is negative. Call before run().
+        void submit(Task task, int worker = -1);
+
+        // Run all the queued tasks on the worker threads and return when they
+        // are done. Tasks must not submit more tasks.
+        void run();
+
+        // Number of tasks run by a worker other than the one they were queued on,
+        // during the last run().
+        unsigned long steals() const { return m_steals; }
+
+    private:
+        // Deque of one worker.
+        struct Queue {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        // Worker thread: run own tasks, then steal until every deque is empty.
+        void work(int worker);
+
+        // Take a task from the back of the worker's own deque.
+        bool popOwn(int worker, Task &task);
+
+        // Take a task from the front of another worker's deque.
+        bool steal(int worker, Task &task);
+
+        std::vector<std::unique_ptr<Queue>> m_queues;
+
+        // Worker the next task without a worker is queued on.
+        int m_next;
+
+        std::atomic<unsigned long> m_steals;
+};